@@ -3,6 +3,7 @@
 #include <string.h>
 #include <time.h>
 #include <stdint.h>
+#include "packedDB.hpp"
 
 #define MAX_MUTATIONS 1024
 #define MIN_SEQ_LENGTH  16
@@ -99,6 +100,20 @@ void GenSequence(char * seq, uint32_t length)
     seq[ii] = GenRandomNucleotide('-');
 }
 
+// Packs a sequence with the nucleobase codes of the accelerator
+uint64_t PackSequence(char * seq, uint32_t length)
+{
+  uint64_t packed = 0;
+
+  for (uint32_t ii = 0; ii < length; ++ ii) {
+    uint8_t code = 0;
+    PackedDBNucleobaseCode(seq[ii], code);
+    packed |= uint64_t(code) << (2 * ii);
+  }
+
+  return packed;
+}
+
 bool IsSequenceInList(char * sequences, char * seq, uint32_t numSequences, uint32_t length)
 {
   bool found = false;
@@ -137,8 +152,10 @@ int main(int argc, char ** argv)
   char * sequences = NULL, * newSeq = NULL;
   char * p;
   uint8_t * lengths = NULL, *pLengths;
+  bool packed = (argc == 8) && (strcmp(argv[7], "--packed") == 0);
+  uint64_t * packedSeqs = NULL;
 
-  if ( (argc != 7) || 
+  if ( ((argc != 7) && !packed) || 
        (sscanf(argv[1], "%u", &numSpecimens) != 1) ||
        (sscanf(argv[2], "%u", &seqsPerSpecimen) != 1) || 
        (sscanf(argv[3], "%u", &maxMutations) != 1) || 
@@ -146,8 +163,9 @@ int main(int argc, char ** argv)
        (sscanf(argv[5], "%s", databaseTitle) != 1) ||
        (sscanf(argv[6], "%s", specimenTitle) != 1) )
   {
-    fprintf(stderr, "\nUsage: genSequenceFiles numSpecimens seqsPerSpecimen maxMutations maxSeqLength databaseFile specimenFile\n\n");
-    fprintf(stderr, "Generates variable-length sequences for all the specimenes. Then, it generates another file with mutations for all the sequences of the last specimen.\n\n");
+    fprintf(stderr, "\nUsage: genSequenceFiles numSpecimens seqsPerSpecimen maxMutations maxSeqLength databaseFile specimenFile [--packed]\n\n");
+    fprintf(stderr, "Generates variable-length sequences for all the specimenes. Then, it generates another file with mutations for all the sequences of the last specimen.\n");
+    fprintf(stderr, "With --packed, both files are written as packed DBs (see packedDB.hpp) instead of text.\n\n");
     return -1;
   }
   fprintf(stderr, "Generating %u specimens with %u sequences each of length up to %u. MaxMutations in specimen: %u\n",
@@ -158,12 +176,16 @@ int main(int argc, char ** argv)
     fprintf(stderr, "Maximum sequence length cannot be larger than 255.\n");
     FreeResourcesAndExit(NULL, NULL, NULL, NULL, NULL, -1);
   }
+  if (packed && (maxSeqLength > PACKED_DB_MAX_LENGTH)) {
+    fprintf(stderr, "Maximum sequence length of packed DBs is %u.\n", PACKED_DB_MAX_LENGTH);
+    FreeResourcesAndExit(NULL, NULL, NULL, NULL, NULL, -1);
+  }
 
-  if ( (databaseFile = fopen(databaseTitle, "wt")) == NULL ) {
+  if ( !packed && ((databaseFile = fopen(databaseTitle, "wt")) == NULL) ) {
     fprintf(stderr, "Impossible to open file [%s]\n", databaseTitle);
     FreeResourcesAndExit(sequences, newSeq, lengths, databaseFile, specimenFile, -1);
   }
-  if ( (specimenFile = fopen(specimenTitle, "wt")) == NULL ) {
+  if ( !packed && ((specimenFile = fopen(specimenTitle, "wt")) == NULL) ) {
     fprintf(stderr, "Impossible to open file [%s]\n", specimenTitle);
     FreeResourcesAndExit(sequences, newSeq, lengths, databaseFile, specimenFile, -1);
   }
@@ -194,15 +216,29 @@ int main(int argc, char ** argv)
 
   
   fprintf(stderr, "Dumping sequences...\n");
+  if (packed) {
+    packedSeqs = (uint64_t *)malloc(numSpecimens * seqsPerSpecimen * sizeof(uint64_t));
+    if (packedSeqs == NULL) {
+      printf("Error allocating memory\n");
+      FreeResourcesAndExit(sequences, newSeq, lengths, databaseFile, specimenFile, -1);
+    }
+  }
   p = sequences;
   pLengths = lengths;
   for (uint32_t iSpecimen = 0; iSpecimen < numSpecimens; ++ iSpecimen) {
     for (uint32_t iSeq = 0; iSeq < seqsPerSpecimen; ++ iSeq) {
-      PrintSequence(p, *pLengths, databaseFile);
+      if (packed)
+        packedSeqs[iSpecimen * seqsPerSpecimen + iSeq] = PackSequence(p, *pLengths);
+      else
+        PrintSequence(p, *pLengths, databaseFile);
       p += *pLengths;
       ++ pLengths;
     }
   }
+  if (packed && !WritePackedDB(databaseTitle, packedSeqs, NULL, lengths, numSpecimens * seqsPerSpecimen)) {
+    free(packedSeqs);
+    FreeResourcesAndExit(sequences, newSeq, lengths, databaseFile, specimenFile, -1);
+  }
   fprintf(stderr, "Dumped %u sequences.\n", numSpecimens * seqsPerSpecimen);
   
 
@@ -217,10 +253,19 @@ int main(int argc, char ** argv)
   }
   for (uint32_t iSeq = 0; iSeq < seqsPerSpecimen; ++ iSeq) {
     MutateSeq(p, newSeq, *pLengths, maxMutations);
-    PrintSequence(newSeq, *pLengths, specimenFile);
+    if (packed)
+      packedSeqs[iSeq] = PackSequence(newSeq, *pLengths);
+    else
+      PrintSequence(newSeq, *pLengths, specimenFile);
     p += *pLengths;
     ++ pLengths;
   }
+  if (packed) {
+    bool written = WritePackedDB(specimenTitle, packedSeqs, NULL, pLengths - seqsPerSpecimen, seqsPerSpecimen);
+    free(packedSeqs);
+    if (!written)
+      FreeResourcesAndExit(sequences, newSeq, lengths, databaseFile, specimenFile, -1);
+  }
 
 
   FreeResourcesAndExit(sequences, newSeq, lengths, databaseFile, specimenFile, -1);
@@ -0,0 +1,121 @@
+#ifndef AP_INT_H
+#define AP_INT_H
+
+// Native (g++) replacement of the Vitis HLS arbitrary precision integers, for the native build of the kernel
+// (make hls_native). Only widths up to 64 bits are supported, which covers every type of the kernel. The values
+// are kept in a 64-bit integer, truncated (ap_uint) or sign-extended (ap_int) to W bits on every assignment, and
+// they convert implicitly to it, so the arithmetic happens at 64 bits and is wrapped when it is stored back, as
+// with the Vitis types.
+
+#include <stdint.h>
+#include <iostream>
+#include <locale.h>
+
+template<int W> class ap_uint;
+template<int W> class ap_int;
+
+namespace ap_native {
+
+template<int W> inline uint64_t Truncate(uint64_t x)
+{
+	return (W >= 64) ? x : (x & ((1ULL << (W % 64)) - 1));
+}
+
+template<int W> inline int64_t SignExtend(uint64_t x)
+{
+	if (W >= 64)
+		return (int64_t)x;
+	uint64_t sign = 1ULL << ((W - 1) % 64);
+	x = Truncate<W>(x);
+	return (int64_t)((x ^ sign) - sign);
+}
+
+// Reference to one bit of an integer, returned by operator[]
+template<typename TInt> class bit_ref {
+	TInt & value;
+	int bit;
+
+public:
+	bit_ref(TInt & Value, int Bit) : value(Value), bit(Bit) {}
+	operator bool() const { return (((uint64_t)value) >> bit) & 1; }
+	bit_ref & operator=(bool b) {
+		uint64_t x = (uint64_t)value;
+		value = b ? (x | (1ULL << bit)) : (x & ~(1ULL << bit));
+		return *this;
+	}
+	bit_ref & operator=(const bit_ref & other) { return *this = (bool)other; }
+};
+
+} // namespace ap_native
+
+// Compound assignments, shared by ap_uint and ap_int
+#define AP_NATIVE_ASSIGN_OPS(TYPE, STORAGE) \
+	template<typename T> TYPE & operator+=(T x) { return *this = (STORAGE)v + x; } \
+	template<typename T> TYPE & operator-=(T x) { return *this = (STORAGE)v - x; } \
+	template<typename T> TYPE & operator*=(T x) { return *this = (STORAGE)v * x; } \
+	template<typename T> TYPE & operator/=(T x) { return *this = (STORAGE)v / x; } \
+	template<typename T> TYPE & operator&=(T x) { return *this = (STORAGE)v & x; } \
+	template<typename T> TYPE & operator|=(T x) { return *this = (STORAGE)v | x; } \
+	template<typename T> TYPE & operator^=(T x) { return *this = (STORAGE)v ^ x; } \
+	TYPE & operator<<=(int n) { return *this = (STORAGE)v << n; } \
+	TYPE & operator>>=(int n) { return *this = (STORAGE)v >> n; } \
+	TYPE & operator++() { return *this = (STORAGE)v + 1; } \
+	TYPE & operator--() { return *this = (STORAGE)v - 1; } \
+	TYPE operator++(int) { TYPE old = *this; ++ *this; return old; } \
+	TYPE operator--(int) { TYPE old = *this; -- *this; return old; }
+
+template<int W> class ap_uint {
+	static_assert((W > 0) && (W <= 64), "The native ap_uint supports 1 to 64 bits");
+	uint64_t v;
+
+public:
+	ap_uint() : v(0) {}
+	template<typename T> ap_uint(T x) : v(ap_native::Truncate<W>((uint64_t)x)) {}
+
+	operator uint64_t() const { return v; }
+
+	// Bits hi..lo, as an unsigned value
+	ap_uint<64> range(int hi, int lo) const {
+		uint64_t x = v >> lo;
+		int n = hi - lo + 1;
+		return ap_uint<64>((n >= 64) ? x : (x & ((1ULL << n) - 1)));
+	}
+	ap_uint<64> operator()(int hi, int lo) const { return range(hi, lo); }
+
+	bool operator[](int bit) const { return (v >> bit) & 1; }
+	ap_native::bit_ref<ap_uint> operator[](int bit) { return ap_native::bit_ref<ap_uint>(*this, bit); }
+
+	uint64_t to_uint64() const { return v; }
+	unsigned to_uint() const { return (unsigned)v; }
+	int to_int() const { return (int)v; }
+	int length() const { return W; }
+
+	AP_NATIVE_ASSIGN_OPS(ap_uint, uint64_t)
+};
+
+template<int W> class ap_int {
+	static_assert((W > 0) && (W <= 64), "The native ap_int supports 1 to 64 bits");
+	int64_t v;
+
+public:
+	ap_int() : v(0) {}
+	template<typename T> ap_int(T x) : v(ap_native::SignExtend<W>((uint64_t)(int64_t)x)) {}
+
+	operator int64_t() const { return v; }
+
+	ap_uint<64> range(int hi, int lo) const { return ap_uint<64>((uint64_t)v).range(hi, lo); }
+	ap_uint<64> operator()(int hi, int lo) const { return range(hi, lo); }
+
+	bool operator[](int bit) const { return ((uint64_t)v >> bit) & 1; }
+	ap_native::bit_ref<ap_int> operator[](int bit) { return ap_native::bit_ref<ap_int>(*this, bit); }
+
+	int64_t to_int64() const { return v; }
+	int to_int() const { return (int)v; }
+	int length() const { return W; }
+
+	AP_NATIVE_ASSIGN_OPS(ap_int, int64_t)
+};
+
+#undef AP_NATIVE_ASSIGN_OPS
+
+#endif // AP_INT_H
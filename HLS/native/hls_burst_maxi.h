@@ -0,0 +1,28 @@
+#ifndef HLS_BURST_MAXI_H
+#define HLS_BURST_MAXI_H
+
+// Native (g++) replacement of hls::burst_maxi for the native build of the kernel (make hls_native). A burst
+// request sets the position of the following reads or writes in the buffer; the responses do nothing.
+
+#include <stddef.h>
+
+namespace hls {
+
+template<typename T> class burst_maxi {
+	T * base;
+	T * current;
+
+public:
+	burst_maxi(T * Base) : base(Base), current(Base) {}
+
+	void read_request(size_t offset, size_t length) { current = base + offset; }
+	T read() { return *current++; }
+
+	void write_request(size_t offset, size_t length) { current = base + offset; }
+	void write(const T & value) { *current++ = value; }
+	void write_response() {}
+};
+
+} // namespace hls
+
+#endif // HLS_BURST_MAXI_H
@@ -0,0 +1,100 @@
+#ifndef HLS_STREAM_H
+#define HLS_STREAM_H
+
+// Native (g++) replacement of hls::stream for the native build of the kernel (make hls_native), where every
+// dataflow process runs on its own thread. A stream is a bounded FIFO with a single producer and a single consumer,
+// as in the hardware: write() blocks while it is full and read() blocks while it is empty. The depth is the one
+// given to hls::stream<T, DEPTH>, or HLS_NATIVE_STREAM_DEPTH for hls::stream<T>.
+//  The FIFO is a lock-free ring buffer. Each side caches the position of the other one and only reloads it when
+// the FIFO looks full (or empty), so the threads only exchange cache lines when they are about to block.
+
+#include <stddef.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#ifndef HLS_NATIVE_STREAM_DEPTH
+#define HLS_NATIVE_STREAM_DEPTH 1024
+#endif
+
+// Busy-wait iterations before yielding the core to the other processes
+#define HLS_NATIVE_STREAM_SPIN 64
+
+namespace hls {
+
+template<typename T, int DEPTH = 0> class stream;
+
+template<typename T> class stream<T, 0> {
+protected:
+	std::vector<T> buffer;                  // One slot more than the depth, to tell full from empty
+	alignas(64) std::atomic<size_t> head;   // Next slot to read, written by the consumer
+	size_t cachedTail;
+	alignas(64) std::atomic<size_t> tail;   // Next slot to write, written by the producer
+	size_t cachedHead;
+
+	size_t Next(size_t slot) const { return (slot + 1 == buffer.size()) ? 0 : slot + 1; }
+
+	static void Backoff(unsigned & spins) {
+		if (++spins >= HLS_NATIVE_STREAM_SPIN) {
+			spins = 0;
+			std::this_thread::yield();
+		}
+	}
+
+public:
+	stream(size_t depth = HLS_NATIVE_STREAM_DEPTH)
+		: buffer(depth + 1), head(0), cachedTail(0), tail(0), cachedHead(0) {}
+	stream(const char * name) : stream() {}
+	stream(const stream &) = delete;
+	stream & operator=(const stream &) = delete;
+
+	bool empty() { return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire); }
+	bool full() { return Next(tail.load(std::memory_order_relaxed)) == head.load(std::memory_order_acquire); }
+
+	bool read_nb(T & value) {
+		size_t slot = head.load(std::memory_order_relaxed);
+		if ((slot == cachedTail) && (slot == (cachedTail = tail.load(std::memory_order_acquire))))
+			return false;
+		value = buffer[slot];
+		head.store(Next(slot), std::memory_order_release);
+		return true;
+	}
+
+	bool write_nb(const T & value) {
+		size_t slot = tail.load(std::memory_order_relaxed);
+		size_t next = Next(slot);
+		if ((next == cachedHead) && (next == (cachedHead = head.load(std::memory_order_acquire))))
+			return false;
+		buffer[slot] = value;
+		tail.store(next, std::memory_order_release);
+		return true;
+	}
+
+	void read(T & value) {
+		for (unsigned spins = 0; !read_nb(value); )
+			Backoff(spins);
+	}
+	T read() {
+		T value;
+		read(value);
+		return value;
+	}
+	void write(const T & value) {
+		for (unsigned spins = 0; !write_nb(value); )
+			Backoff(spins);
+	}
+
+	void operator>>(T & value) { read(value); }
+	void operator<<(const T & value) { write(value); }
+};
+
+// Streams with an explicit depth have the same layout, so that they can be passed as hls::stream<T>
+template<typename T, int DEPTH> class stream : public stream<T, 0> {
+public:
+	stream() : stream<T, 0>(DEPTH) {}
+	stream(const char * name) : stream() {}
+};
+
+} // namespace hls
+
+#endif // HLS_STREAM_H
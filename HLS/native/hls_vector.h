@@ -0,0 +1,31 @@
+#ifndef HLS_VECTOR_H
+#define HLS_VECTOR_H
+
+// Native (g++) replacement of hls::vector for the native build of the kernel (make hls_native): a fixed-size
+// array of N elements with element access and comparison.
+
+#include <stddef.h>
+
+namespace hls {
+
+template<typename T, size_t N> class vector {
+	T data[N];
+
+public:
+	vector() : data() {}
+
+	T & operator[](size_t i) { return data[i]; }
+	const T & operator[](size_t i) const { return data[i]; }
+
+	bool operator==(const vector & other) const {
+		for (size_t i = 0; i < N; ++i)
+			if (!(data[i] == other.data[i]))
+				return false;
+		return true;
+	}
+	bool operator!=(const vector & other) const { return !(*this == other); }
+};
+
+} // namespace hls
+
+#endif // HLS_VECTOR_H
@@ -6,8 +6,15 @@
 #include <assert.h>
 #include <hls_vector.h>
 #include <hls_stream.h>
+#ifdef HLS_NATIVE
+#include <thread>
+#include <vector>
+#endif
 
+// Banded arrays use far fewer PEs, so more of them fit in the fabric. Override it together with BAND_WIDTH.
+#ifndef NUM_SYSTOLIC_ARRAYS
 #define NUM_SYSTOLIC_ARRAYS 20
+#endif
 
 #define DUPLICATION_FACTOR_SPECIMEN_CACHE ((NUM_SYSTOLIC_ARRAYS + 1) / 2)
 #define INPUT_AXI_STREAM_BUFFER_SIZE NUM_SYSTOLIC_ARRAYS
@@ -83,7 +90,20 @@ inline uint8_t maxLength(uint8_t a, uint8_t b) {
 	return a > b ? a : b;
 }
 
-int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB) {
+// Saturating subtraction used by the gap penalties
+inline score_t subSat(score_t a, uint8_t b) {
+	return a > b ? score_t(a - b) : score_t(0);
+}
+
+#ifndef PROTEIN_MODE
+
+// Whether two nucleobases match. Pairs involving an ambiguous nucleobase are scored according to ambiguousMode.
+inline bool isMatch(nbase_t a, bool ambiguousA, nbase_t b, bool ambiguousB, uint8_t ambiguousMode) {
+	return (ambiguousA || ambiguousB) ? (ambiguousMode == AMBIGUOUS_WILDCARD) : (a == b);
+}
+
+int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode) {
 
   // Max score that a given cell in the systolic array has seen until this moment. We will then only compute the final
   // global maximum at the end of the algorithm to prevent data dependencies.
@@ -93,11 +113,17 @@ int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uin
 	nbase_t seq_b_SR[2*MAX_SEQ_LENGTH];
 	#pragma HLS ARRAY_PARTITION variable=seq_b_SR type=complete
 
+	// Ambiguity flags of seqB, shifted together with seq_b_SR
+	bool mask_b_SR[2*MAX_SEQ_LENGTH];
+	#pragma HLS ARRAY_PARTITION variable=mask_b_SR type=complete
+
 	// Load the shift register with the first nucleobases of seqB
 	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
 		#pragma HLS UNROLL
 		seq_b_SR[i] = 0;
 		seq_b_SR[MAX_SEQ_LENGTH + i] = seqB[i];
+		mask_b_SR[i] = false;
+		mask_b_SR[MAX_SEQ_LENGTH + i] = maskB[i];
 	}
 
   score_t scores[MAX_SEQ_LENGTH];
@@ -139,7 +165,7 @@ int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uin
 
 		  if (idxSeqA < lengthA && idxSeqB >= 0 && idxSeqB < lengthB) {
 			  score_t lhs = oldScores[j-1];
-			  hit = ((seqA[idxSeqA] == seq_b_SR[32-j]) ? score_t(lhs+score_t(1)) : ( lhs == 0 ? lhs : score_t(lhs-score_t(1))));
+			  hit = (isMatch(seqA[idxSeqA], maskA[idxSeqA], seq_b_SR[32-j], mask_b_SR[32-j], ambiguousMode) ? score_t(lhs+score_t(1)) : ( lhs == 0 ? lhs : score_t(lhs-score_t(1))));
 		  }
 
 		  score_t newScore = max3(top, left, hit);
@@ -158,7 +184,7 @@ int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uin
 	  score_t top_lhs = ((0 == iDiag) ? score_t(0) : scores[0]);
 	  score_t top = top_lhs == 0 ? top_lhs : score_t(top_lhs - score_t(1));
 
-	  score_t hit = ((seqA[0] == seq_b_SR[32]) ? score_t(1) : score_t(0));
+	  score_t hit = (isMatch(seqA[0], maskA[0], seq_b_SR[32], mask_b_SR[32], ambiguousMode) ? score_t(1) : score_t(0));
 
 	  score_t newScore = max(top, hit);
 
@@ -174,35 +200,368 @@ int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uin
 	  for(int i = 0; i < 2*MAX_SEQ_LENGTH - 1; ++i) {
 		  #pragma HLS UNROLL
 		  seq_b_SR[i] = seq_b_SR[i+1];
+		  mask_b_SR[i] = mask_b_SR[i+1];
 	  }
   }
 
   return maxReduce(maxScores);
 }
 
+// Banded version of the systolic array. Instead of sweeping anti-diagonals, the band is swept row by row (one
+// nucleobase of seqA per iteration). PE o evaluates the cell (i, i + o - BAND_WIDTH), so the diagonal and vertical
+// dependencies come from the same and the next PE of the previous row. The horizontal dependency inside a row is
+// resolved with a log-depth prefix maximum of the gap-decayed scores, so every iteration still fits in one cycle.
+int8_t CalcScoreBandedSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode) {
+
+	score_t maxScores[BAND_NUM_PES];
+	#pragma HLS ARRAY_PARTITION variable=maxScores type=complete
+
+	// Scores of the previous row of the band
+	score_t rowScores[BAND_NUM_PES];
+	#pragma HLS ARRAY_PARTITION variable=rowScores type=complete
+
+	nbase_t seq_a_SR[MAX_SEQ_LENGTH];
+	bool mask_a_SR[MAX_SEQ_LENGTH];
+	#pragma HLS ARRAY_PARTITION variable=seq_a_SR type=complete
+	#pragma HLS ARRAY_PARTITION variable=mask_a_SR type=complete
+
+	// seqB padded with BAND_WIDTH nucleobases on the left, so that PE o always reads position o
+	nbase_t seq_b_SR[MAX_SEQ_LENGTH + 2*BAND_WIDTH];
+	bool mask_b_SR[MAX_SEQ_LENGTH + 2*BAND_WIDTH];
+	#pragma HLS ARRAY_PARTITION variable=seq_b_SR type=complete
+	#pragma HLS ARRAY_PARTITION variable=mask_b_SR type=complete
+
+	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+		#pragma HLS UNROLL
+		seq_a_SR[i] = seqA[i];
+		mask_a_SR[i] = maskA[i];
+	}
+
+	for(int i = 0; i < MAX_SEQ_LENGTH + 2*BAND_WIDTH; ++i) {
+		#pragma HLS UNROLL
+		bool inSeqB = (i >= BAND_WIDTH && i < BAND_WIDTH + MAX_SEQ_LENGTH);
+		seq_b_SR[i] = inSeqB ? seqB[i - BAND_WIDTH] : nbase_t(0);
+		mask_b_SR[i] = inSeqB ? bool(maskB[i - BAND_WIDTH]) : false;
+	}
+
+	for(int o = 0; o < BAND_NUM_PES; ++o) {
+		#pragma HLS UNROLL
+		rowScores[o] = score_t(0);
+		maxScores[o] = score_t(0);
+	}
+
+	rowLoop: for(uint8_t iRow = 0; iRow < lengthA; ++iRow) {
+	#pragma HLS PIPELINE
+	#pragma HLS LOOP_TRIPCOUNT min=16 max=32
+
+		score_t newScores[BAND_NUM_PES];
+		#pragma HLS ARRAY_PARTITION variable=newScores type=complete
+
+		// Diagonal and vertical contributions. Cells outside seqB (or outside the band) score 0, which is the
+		// Smith-Waterman floor and therefore never adds a spurious path.
+		for(int o = 0; o < BAND_NUM_PES; ++o) {
+			#pragma HLS UNROLL
+			int8_t idxSeqB = iRow + o - BAND_WIDTH;
+
+			score_t diag = rowScores[o];
+			score_t top = (o + 1 < BAND_NUM_PES) ? subSat(rowScores[o + 1], 1) : score_t(0);
+			score_t hit = isMatch(seq_a_SR[0], mask_a_SR[0], seq_b_SR[o], mask_b_SR[o], ambiguousMode) ?
+					score_t(diag + score_t(1)) : subSat(diag, 1);
+
+			newScores[o] = (idxSeqB >= 0 && idxSeqB < lengthB) ? max(top, hit) : score_t(0);
+		}
+
+		// Horizontal contributions: prefix maximum of score - distance (Hillis-Steele scan)
+		for(int s = 1; s < BAND_NUM_PES; s <<= 1) {
+			#pragma HLS UNROLL
+			score_t shifted[BAND_NUM_PES];
+			#pragma HLS ARRAY_PARTITION variable=shifted type=complete
+
+			for(int o = 0; o < BAND_NUM_PES; ++o) {
+				#pragma HLS UNROLL
+				shifted[o] = (o >= s) ? subSat(newScores[o - s], s) : score_t(0);
+			}
+
+			for(int o = 0; o < BAND_NUM_PES; ++o) {
+				#pragma HLS UNROLL
+				newScores[o] = max(newScores[o], shifted[o]);
+			}
+		}
+
+		for(int o = 0; o < BAND_NUM_PES; ++o) {
+			#pragma HLS UNROLL
+			int8_t idxSeqB = iRow + o - BAND_WIDTH;
+			score_t newScore = (idxSeqB >= 0 && idxSeqB < lengthB) ? newScores[o] : score_t(0);
+
+			rowScores[o] = newScore;
+			maxScores[o] = max(maxScores[o], newScore);
+		}
+
+		// Shift both sequences to the left
+		for(int i = 0; i < MAX_SEQ_LENGTH - 1; ++i) {
+			#pragma HLS UNROLL
+			seq_a_SR[i] = seq_a_SR[i+1];
+			mask_a_SR[i] = mask_a_SR[i+1];
+		}
+
+		for(int i = 0; i < MAX_SEQ_LENGTH + 2*BAND_WIDTH - 1; ++i) {
+			#pragma HLS UNROLL
+			seq_b_SR[i] = seq_b_SR[i+1];
+			mask_b_SR[i] = mask_b_SR[i+1];
+		}
+	}
+
+	score_t maxScore = 0;
+	for(int o = 0; o < BAND_NUM_PES; ++o) {
+		#pragma HLS UNROLL
+		maxScore = max(maxScore, maxScores[o]);
+	}
+
+	return maxScore;
+}
+
+// Edit distance between seqA (text) and seqB (pattern) with the bit-parallel algorithm of Myers/Hyyro.
+// Pv/Mv hold the vertical deltations (+1/-1) of the current DP column, one bit per nucleobase of seqB, and the
+// distance in the last row is tracked incrementally. The top row is D[0][j] = j (global distance), which is why a 1
+// is shifted into the horizontal positive deltas.
+int8_t CalcEditDistanceBitParallel(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode) {
+
+	if (lengthB == 0) {
+		return lengthA;
+	}
+
+	// Match masks of every nucleobase in seqB (Peq). Ambiguous positions match everything as wildcards and nothing
+	// as mismatches.
+	mask_t peq[4];
+	#pragma HLS ARRAY_PARTITION variable=peq type=complete
+
+	mask_t lengthMask = (lengthB == MAX_SEQ_LENGTH) ? mask_t(~mask_t(0)) : mask_t((mask_t(1) << lengthB) - 1);
+
+	for(int c = 0; c < 4; ++c) {
+		#pragma HLS UNROLL
+		mask_t eq = 0;
+
+		for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+			#pragma HLS UNROLL
+			eq[i] = isMatch(nbase_t(c), false, seqB[i], maskB[i], ambiguousMode);
+		}
+
+		peq[c] = eq & lengthMask;
+	}
+
+	mask_t wildcardEq = (ambiguousMode == AMBIGUOUS_WILDCARD) ? lengthMask : mask_t(0);
+	mask_t lastRowBit = mask_t(1) << (lengthB - 1);
+
+	mask_t pv = lengthMask;
+	mask_t mv = 0;
+	uint8_t distance = lengthB;
+
+	nbase_t seq_a_SR[MAX_SEQ_LENGTH];
+	bool mask_a_SR[MAX_SEQ_LENGTH];
+	#pragma HLS ARRAY_PARTITION variable=seq_a_SR type=complete
+	#pragma HLS ARRAY_PARTITION variable=mask_a_SR type=complete
+
+	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+		#pragma HLS UNROLL
+		seq_a_SR[i] = seqA[i];
+		mask_a_SR[i] = maskA[i];
+	}
+
+	columnLoop: for(uint8_t iCol = 0; iCol < lengthA; ++iCol) {
+	#pragma HLS PIPELINE
+	#pragma HLS LOOP_TRIPCOUNT min=16 max=32
+
+		mask_t eq = mask_a_SR[0] ? wildcardEq : peq[seq_a_SR[0]];
+
+		mask_t xv = eq | mv;
+		mask_t xh = mask_t(((eq & pv) + pv) ^ pv) | eq;
+		mask_t ph = mv | mask_t(~(xh | pv));
+		mask_t mh = pv & xh;
+
+		if ((ph & lastRowBit) != 0) {
+			distance++;
+		} else if ((mh & lastRowBit) != 0) {
+			distance--;
+		}
+
+		ph = mask_t(ph << 1) | mask_t(1);
+		mh = mask_t(mh << 1);
+		pv = mh | mask_t(~(xv | ph));
+		mv = ph & xv;
+
+		// Shift seqA to the left
+		for(int i = 0; i < MAX_SEQ_LENGTH - 1; ++i) {
+			#pragma HLS UNROLL
+			seq_a_SR[i] = seq_a_SR[i+1];
+			mask_a_SR[i] = mask_a_SR[i+1];
+		}
+	}
+
+	return distance;
+}
+
+// Scoring engine used by the workers, selected at synthesis time
+inline int8_t CalcScore(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode) {
+#if BAND_WIDTH > 0
+	return CalcScoreBandedSystolicArray(seqA, lengthA, seqB, lengthB, maskA, maskB, ambiguousMode);
+#else
+	return CalcScoreLinearSystolicArray(seqA, lengthA, seqB, lengthB, maskA, maskB, ambiguousMode);
+#endif
+}
+
+// Whether two full-length sequences match at every position. The systolic arrays cannot represent a score of
+// MAX_SEQ_LENGTH in a score_t, so the workers bypass them in that case.
+inline bool isFullMatch(seq_t seqA, mask_t maskA, seq_t seqB, mask_t maskB, uint8_t ambiguousMode) {
+	bool fullMatch = true;
+
+	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+		#pragma HLS UNROLL
+		fullMatch = fullMatch && isMatch(seqA[i], maskA[i], seqB[i], maskB[i], ambiguousMode);
+	}
+
+	return fullMatch;
+}
+
+#else
+
+// Load, for every PE, the row of BLOSUM62 of the residue of seqA that it processes. Each PE then looks up its own
+// small LUTROM with the residue of seqB, instead of all of them contending for a single table. The rows only change
+// with the DB entry, so loading them is amortized over all the specimens.
+inline void loadSubstitutionRows(seq_t seqA, subst_t substRows[MAX_SEQ_LENGTH][NUM_RESIDUE_CODES]) {
+substRowsLoop: for(int j = 0; j < MAX_SEQ_LENGTH; ++j) {
+		for(int b = 0; b < NUM_RESIDUE_CODES; ++b) {
+		#pragma HLS PIPELINE
+			residue_t a = seqA[j];
+			// Codes outside the alphabet score like the stop codon '*'
+			substRows[j][b] = (a < NUM_RESIDUES && b < NUM_RESIDUES) ? subst_t(BLOSUM62[a][b]) : subst_t(-4);
+		}
+	}
+}
+
+// Adds a (possibly negative) substitution score, flooring the result at 0
+inline score_t addSat(score_t a, subst_t b) {
+	ap_int<SCORE_NUM_BITS + 2> sum = ap_int<SCORE_NUM_BITS + 2>(a) + b;
+	return sum < 0 ? score_t(0) : score_t(sum);
+}
+
+// Protein version of CalcScoreLinearSystolicArray. PE j processes residue j of seqA for the whole comparison, so
+// seqA is only needed through the substitution rows of each PE.
+int8_t CalcScoreProteinSystolicArray(subst_t substRows[MAX_SEQ_LENGTH][NUM_RESIDUE_CODES], uint8_t lengthA,
+		seq_t seqB, uint8_t lengthB) {
+
+	score_t maxScores[MAX_SEQ_LENGTH];
+	#pragma HLS ARRAY_PARTITION variable=maxScores type=complete
+
+	residue_t seq_b_SR[2*MAX_SEQ_LENGTH];
+	#pragma HLS ARRAY_PARTITION variable=seq_b_SR type=complete
+
+	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+		#pragma HLS UNROLL
+		seq_b_SR[i] = 0;
+		seq_b_SR[MAX_SEQ_LENGTH + i] = seqB[i];
+	}
+
+	score_t scores[MAX_SEQ_LENGTH];
+	score_t oldScores[MAX_SEQ_LENGTH];
+	#pragma HLS ARRAY_PARTITION variable=scores type=complete
+	#pragma HLS ARRAY_PARTITION variable=oldScores type=complete
+
+	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+		#pragma HLS UNROLL
+		scores[i] = score_t(0);
+		oldScores[i] = score_t(0);
+		maxScores[i] = score_t(0);
+	}
+
+	uint8_t totalDiagNumber = lengthB + lengthA - 1;
+
+	proteinDiagLoop: for(uint8_t iDiag = 0; iDiag < totalDiagNumber; ++iDiag) {
+	#pragma HLS PIPELINE
+	#pragma HLS LOOP_TRIPCOUNT min=16 max=32
+
+		for(int j = MAX_SEQ_LENGTH - 1; j >= 0; j--) {
+			#pragma HLS UNROLL
+			int8_t idxSeqB = iDiag - j;
+
+			score_t top = subSat((j == iDiag) ? score_t(0) : scores[j], PROTEIN_GAP_PENALTY);
+			score_t left = (j > 0) ? subSat(scores[j-1], PROTEIN_GAP_PENALTY) : score_t(0);
+
+			score_t hit = 0;
+			if (j < lengthA && idxSeqB >= 0 && idxSeqB < lengthB) {
+				score_t lhs = (j > 0) ? oldScores[j-1] : score_t(0);
+				hit = addSat(lhs, substRows[j][seq_b_SR[MAX_SEQ_LENGTH - j]]);
+			}
+
+			score_t newScore = max3(top, left, hit);
+
+			oldScores[j] = scores[j];
+			scores[j] = newScore;
+			maxScores[j] = max(maxScores[j], newScore);
+		}
+
+		// Shift seqB to the left
+		for(int i = 0; i < 2*MAX_SEQ_LENGTH - 1; ++i) {
+			#pragma HLS UNROLL
+			seq_b_SR[i] = seq_b_SR[i+1];
+		}
+	}
+
+	score_t maxScore = maxReduce(maxScores);
+	return maxScore > 127 ? 127 : int8_t(maxScore);
+}
+
+#endif // PROTEIN_MODE
+
+// Read sequence idx of a packed DRAM array (PACKED_SEQ_WORDS words per sequence)
+inline packed_seq_t readPackedSeq(uint64_t* seqs, uint32_t idx) {
+#ifdef PROTEIN_MODE
+	packed_seq_t res;
+
+	for(int w = 0; w < PACKED_SEQ_WORDS; ++w) {
+		#pragma HLS UNROLL
+		res[w] = seqs[idx * PACKED_SEQ_WORDS + w];
+	}
+
+	return res;
+#else
+	return seqs[idx];
+#endif
+}
+
 // Load all specimens into the cache. For now, assume that all specimens fit into the BRAM cache.
 inline void loadSpecimenCache(
-		uint64_t* seqsSpecimen,																	// Pointer to DRAM seqs specimen (already compressed: one nucleobase=2bits)
+		uint64_t* seqsSpecimen,																	// Pointer to DRAM seqs specimen (already compressed: one nucleobase=2bits, one residue=5bits)
 		uint8_t* lengthsSpecimen,																// Pointer to DRAM array containing the lengths of each specimen.
+		uint32_t* masksSpecimen,																// Pointer to DRAM array containing the ambiguity masks of each specimen.
 		uint8_t cachedSpecimenLengths[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],	// Output array with all the cached specimen lengths
-		uint64_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],		// Output array storing all the cached specimens
-		uint32_t numSeqsSpecimen																// Number of specimens the program wants to use
+		packed_seq_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],	// Output array storing all the cached specimens
+		uint32_t cachedSpecimenMasks[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],	// Output array storing all the cached ambiguity masks
+		uint32_t numSeqsSpecimen,																// Number of specimens the program wants to use
+		uint32_t ambiguousMode																	// Masks are only read if ambiguous nucleobases are enabled
 ) {
 	uint32_t max_specimens_to_cache = numSeqsSpecimen > MAX_CACHED_SPECIMENS ? MAX_CACHED_SPECIMENS : numSeqsSpecimen;
 
 specCacheLoop:	for(int iSpecimen = 0; iSpecimen < max_specimens_to_cache; ++iSpecimen) {
 #pragma HLS PIPELINE
+		 packed_seq_t seq = readPackedSeq(seqsSpecimen, iSpecimen);
+		 uint32_t mask = (ambiguousMode != AMBIGUOUS_DISABLED) ? masksSpecimen[iSpecimen] : 0;
+
 		 for (int i = 0; i < DUPLICATION_FACTOR_SPECIMEN_CACHE; ++i){
 		#pragma HLS UNROLL
-				cachedSpecimens[i][iSpecimen] = seqsSpecimen[iSpecimen];
+				cachedSpecimens[i][iSpecimen] = seq;
 				cachedSpecimenLengths[i][iSpecimen] = lengthsSpecimen[iSpecimen];
+				cachedSpecimenMasks[i][iSpecimen] = mask;
 		}
 	}
 }
 
 struct WorkerInput {
-	ap_uint<64> seqDB;
+	packed_seq_t seqDB;
 	uint8_t lengthDB;
+	uint32_t maskDB;
 };
 
 inline seq_t seqFromUInt64(ap_uint<64> x) {
@@ -244,12 +603,31 @@ inline seq_t seqFromUInt64(ap_uint<64> x) {
 	return res;
 }
 
+// Unpack a sequence read from DRAM into its symbols
+inline seq_t seqFromPacked(packed_seq_t x) {
+#ifdef PROTEIN_MODE
+	seq_t res;
+
+	for(int i = 0; i < MAX_SEQ_LENGTH; ++i) {
+		#pragma HLS UNROLL
+		int bit = 5 * (i % RESIDUES_PER_WORD);
+		res[i] = x[i / RESIDUES_PER_WORD].range(bit + 4, bit);
+	}
+
+	return res;
+#else
+	return seqFromUInt64(x);
+#endif
+}
+
 void SystolicArrayWorker(
 		uint8_t systolicArrayId,
 		hls::stream<WorkerInput>& in,
 		hls::stream<int8_t>& out, uint32_t numSeqsSpecimen, uint32_t numDBEntries,
-		uint64_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
-		uint8_t cachedSpecimenLengths[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS]
+		packed_seq_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
+		uint8_t cachedSpecimenLengths[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
+		uint32_t cachedSpecimenMasks[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
+		uint32_t ambiguousMode
 ) {
 	const uint8_t cacheIndex = systolicArrayId >> 1;
 
@@ -258,14 +636,30 @@ void SystolicArrayWorker(
 	for(int iDB = 0; iDB < numDBEntriesToProcess; ++iDB) {
 		WorkerInput input = in.read();
 
-		seq_t seqA = seqFromUInt64(input.seqDB);
+		seq_t seqA = seqFromPacked(input.seqDB);
 		uint8_t lengthA = input.lengthDB;
+		mask_t maskA = input.maskDB;
+
+#ifdef PROTEIN_MODE
+		subst_t substRows[MAX_SEQ_LENGTH][NUM_RESIDUE_CODES];
+		#pragma HLS ARRAY_PARTITION variable=substRows complete dim=1
+		loadSubstitutionRows(seqA, substRows);
+#endif
 
 		for(uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++iSpec) {
-			seq_t seqB = seqFromUInt64(cachedSpecimens[cacheIndex][iSpec]);
+			seq_t seqB = seqFromPacked(cachedSpecimens[cacheIndex][iSpec]);
 			uint8_t lengthB = cachedSpecimenLengths[cacheIndex][iSpec];
-
-			int8_t res = (lengthA == 32 && lengthB == 32 && seqA == seqB) ? 32 : CalcScoreLinearSystolicArray(seqA, lengthA, seqB, lengthB);
+			mask_t maskB = cachedSpecimenMasks[cacheIndex][iSpec];
+
+#if defined(PROTEIN_MODE)
+			// Protein scores fit in score_t, so there is no need to bypass full matches
+			int8_t res = CalcScoreProteinSystolicArray(substRows, lengthA, seqB, lengthB);
+#elif defined(EDIT_DISTANCE_ENGINE)
+			int8_t res = CalcEditDistanceBitParallel(seqA, lengthA, seqB, lengthB, maskA, maskB, ambiguousMode);
+#else
+			int8_t res = (lengthA == 32 && lengthB == 32 && isFullMatch(seqA, maskA, seqB, maskB, ambiguousMode)) ?
+					32 : CalcScore(seqA, lengthA, seqB, lengthB, maskA, maskB, ambiguousMode);
+#endif
 			out.write(res);
 		}
 	}
@@ -275,7 +669,9 @@ void SystolicArrayWorker(
 void ReadSystolicArrayInputs(
 		uint64_t* seqsDB,
 		uint8_t* lengthsDB,
+		uint32_t* masksDB,
 		uint32_t numDBEntries,
+		uint32_t ambiguousMode,
 		hls::stream<WorkerInput> out[NUM_SYSTOLIC_ARRAYS]
 ) {
 
@@ -284,12 +680,14 @@ void ReadSystolicArrayInputs(
 readDbLoop: for (uint32_t iDB = 0; iDB < numDBEntries; ++iDB) {
 #pragma HLS LOOP_TRIPCOUNT min=40000 max=40000
 #pragma HLS PIPELINE
-		uint64_t seqDB = seqsDB[iDB];
+		packed_seq_t seqDB = readPackedSeq(seqsDB, iDB);
 		uint8_t dbLength = lengthsDB[iDB];
+		uint32_t dbMask = (ambiguousMode != AMBIGUOUS_DISABLED) ? masksDB[iDB] : 0;
 
 		  WorkerInput input = {
 			seqDB,
 			dbLength,
+			dbMask,
 		  };
 
 		  out[streamIdx].write(input);
@@ -333,8 +731,11 @@ void SeqMatchMultipleSystolicArrays(
 		uint32_t numSeqsSpecimen,
 		uint64_t* seqsDB,
 		uint8_t* lengthsDB,
-		uint64_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
+		uint32_t* masksDB,
+		packed_seq_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
 		uint8_t cachedSpecimenLengths[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
+		uint32_t cachedSpecimenMasks[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS],
+		uint32_t ambiguousMode,
 		hls::burst_maxi<int8_t> scores
 ) {
 
@@ -343,14 +744,36 @@ void SeqMatchMultipleSystolicArrays(
 
 #pragma HLS DATAFLOW
 
-    ReadSystolicArrayInputs(seqsDB, lengthsDB, numDBEntries, inputStreams);
+#ifdef HLS_NATIVE
+    // Native build (HLS/native): the processes run concurrently on threads, connected by the blocking FIFOs of the
+    // native hls::stream, as in the hardware. The C simulation of Vitis runs them one after the other instead.
+    std::vector<std::thread> processes;
+
+    processes.emplace_back([&]() {
+    	ReadSystolicArrayInputs(seqsDB, lengthsDB, masksDB, numDBEntries, ambiguousMode, inputStreams);
+    });
+    for (int i=0; i<NUM_SYSTOLIC_ARRAYS; ++i) {
+    	processes.emplace_back([&, i]() {
+    		SystolicArrayWorker(i, inputStreams[i], outputStreams[i], numSeqsSpecimen, numDBEntries,
+    				cachedSpecimens, cachedSpecimenLengths, cachedSpecimenMasks, ambiguousMode);
+    	});
+    }
+
+    WriteSystolicArrayResults(scores, numDBEntries, numSeqsSpecimen, outputStreams);
+
+    for (std::thread & process : processes)
+    	process.join();
+#else
+    ReadSystolicArrayInputs(seqsDB, lengthsDB, masksDB, numDBEntries, ambiguousMode, inputStreams);
 
     for (int i=0; i<NUM_SYSTOLIC_ARRAYS; ++i) {
 #pragma HLS unroll
-    	SystolicArrayWorker(i, inputStreams[i], outputStreams[i], numSeqsSpecimen, numDBEntries, cachedSpecimens, cachedSpecimenLengths);
+    	SystolicArrayWorker(i, inputStreams[i], outputStreams[i], numSeqsSpecimen, numDBEntries,
+    			cachedSpecimens, cachedSpecimenLengths, cachedSpecimenMasks, ambiguousMode);
     }
 
     WriteSystolicArrayResults(scores, numDBEntries, numSeqsSpecimen, outputStreams);
+#endif
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -362,11 +785,14 @@ uint32_t SeqMatcher_HW(
 	uint64_t* seqsDB,
 	uint64_t* seqsSpecimen,
 	uint8_t* lengthsDB, uint8_t* lengthsSpecimen,
-	hls::burst_maxi<int8_t> scores
+	hls::burst_maxi<int8_t> scores,
+	uint32_t* masksDB, uint32_t* masksSpecimen,
+	uint32_t ambiguousMode
 ) {
 
 #pragma HLS INTERFACE mode=s_axilite port=numDBEntries
 #pragma HLS INTERFACE mode=s_axilite port=numSeqsSpecimen
+#pragma HLS INTERFACE mode=s_axilite port=ambiguousMode
 #pragma HLS INTERFACE mode=s_axilite port=return
 
 #pragma HLS INTERFACE mode=m_axi port=seqsDB bundle=seqs num_read_outstanding=2 max_read_burst_length=256 latency=30
@@ -374,15 +800,21 @@ uint32_t SeqMatcher_HW(
 #pragma HLS INTERFACE mode=m_axi port=lengthsDB bundle=lengths num_read_outstanding=2 max_read_burst_length=256 latency=30
 #pragma HLS INTERFACE mode=m_axi port=lengthsSpecimen bundle=lengths num_read_outstanding=2 max_read_burst_length=256 latency=30
 #pragma HLS INTERFACE mode=m_axi port=scores bundle=scores num_write_outstanding=2 max_write_burst_length=256 latency=30
+#pragma HLS INTERFACE mode=m_axi port=masksDB bundle=lengths num_read_outstanding=2 max_read_burst_length=256 latency=30
+#pragma HLS INTERFACE mode=m_axi port=masksSpecimen bundle=lengths num_read_outstanding=2 max_read_burst_length=256 latency=30
 
   // Specimen caches
   uint8_t cachedSpecimenLengths[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS];
 #pragma HLS ARRAY_PARTITION variable=cachedSpecimenLengths complete dim=1
 
-  uint64_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS];
+  packed_seq_t cachedSpecimens[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS];
 #pragma HLS ARRAY_PARTITION variable=cachedSpecimens complete dim=1
 
-  loadSpecimenCache(seqsSpecimen, lengthsSpecimen, cachedSpecimenLengths, cachedSpecimens, numSeqsSpecimen);
+  uint32_t cachedSpecimenMasks[DUPLICATION_FACTOR_SPECIMEN_CACHE][MAX_CACHED_SPECIMENS];
+#pragma HLS ARRAY_PARTITION variable=cachedSpecimenMasks complete dim=1
+
+  loadSpecimenCache(seqsSpecimen, lengthsSpecimen, masksSpecimen, cachedSpecimenLengths, cachedSpecimens, cachedSpecimenMasks,
+		  numSeqsSpecimen, ambiguousMode);
 
   assert(numSeqsSpecimen <= MAX_CACHED_SPECIMENS);
 
@@ -396,8 +828,11 @@ uint32_t SeqMatcher_HW(
 		numSeqsSpecimen,
 		seqsDB,
 		lengthsDB,
+		masksDB,
 		cachedSpecimens,
 		cachedSpecimenLengths,
+		cachedSpecimenMasks,
+		ambiguousMode,
 		scores
 	);
 
@@ -7,6 +7,28 @@
 
 #define MAX_SEQ_LENGTH 32
 
+// Half-width w of the band used by the banded Smith-Waterman engine. When non-zero, the workers only evaluate the
+// cells (i, j) with |i - j| <= w, using 2w+1 PEs that advance one DB nucleobase per cycle instead of the full
+// MAX_SEQ_LENGTH-PE diagonal array. Scores only match full Smith-Waterman when the best path stays inside the band
+// (e.g., specimens that only contain substitutions). 0 selects the full systolic array.
+#ifndef BAND_WIDTH
+#define BAND_WIDTH 0
+#endif
+
+#define BAND_NUM_PES (2*BAND_WIDTH + 1)
+
+#if defined(PROTEIN_MODE) && BAND_WIDTH > 0
+#error "The banded engine only supports DNA sequences"
+#endif
+
+// When EDIT_DISTANCE_ENGINE is defined, the workers output the (global, unit-cost) edit distance between the
+// sequences instead of their Smith-Waterman score. It is computed with the bit-parallel algorithm of Myers, as
+// formulated by Hyyro: the whole specimen fits in one MAX_SEQ_LENGTH-bit word, so every cycle processes a full DP
+// column of a DB nucleobase with a handful of logic operations and one addition, instead of a 32-PE array.
+#if defined(EDIT_DISTANCE_ENGINE) && (defined(PROTEIN_MODE) || BAND_WIDTH > 0)
+#error "The edit distance engine cannot be combined with PROTEIN_MODE or BAND_WIDTH"
+#endif
+
 using nbase_t = ap_uint<2>;
 
 const nbase_t NB_A = 0;
@@ -14,11 +36,81 @@ const nbase_t NB_T = 1;
 const nbase_t NB_G = 2;
 const nbase_t NB_C = 3;
 
+#ifdef PROTEIN_MODE
+
+// Protein mode: amino acids use a 5-bit alphabet and are scored with the BLOSUM62 substitution matrix.
+// The DMA layout is the same as for DNA, but every sequence takes PACKED_SEQ_WORDS 64-bit words.
+using residue_t = ap_uint<5>;
+
+// Residues are encoded as their index in this alphabet (which is also the order of BLOSUM62)
+#define RESIDUE_ALPHABET "ARNDCQEGHILKMFPSTWYVBZX*"
+#define NUM_RESIDUES 24
+#define NUM_RESIDUE_CODES 32
+
+// 12 residues per word (60 bits), so that no residue straddles two words
+#define RESIDUES_PER_WORD 12
+#define PACKED_SEQ_WORDS 3
+
+// 32 residues scored with BLOSUM62 (at most +11 per pair) need 9 bits. Scores are saturated to 127 on output.
+#define SCORE_NUM_BITS 9
+
+// Linear gap penalty of the protein engine
+#define PROTEIN_GAP_PENALTY 4
+
+using subst_t = ap_int<5>;
+
+const int8_t BLOSUM62[NUM_RESIDUES][NUM_RESIDUES] = {
+	{ 4, -1, -2, -2,  0, -1, -1,  0, -2, -1, -1, -1, -1, -2, -1,  1,  0, -3, -2,  0, -2, -1,  0, -4},  // A
+	{-1,  5,  0, -2, -3,  1,  0, -2,  0, -3, -2,  2, -1, -3, -2, -1, -1, -3, -2, -3, -1,  0, -1, -4},  // R
+	{-2,  0,  6,  1, -3,  0,  0,  0,  1, -3, -3,  0, -2, -3, -2,  1,  0, -4, -2, -3,  3,  0, -1, -4},  // N
+	{-2, -2,  1,  6, -3,  0,  2, -1, -1, -3, -4, -1, -3, -3, -1,  0, -1, -4, -3, -3,  4,  1, -1, -4},  // D
+	{ 0, -3, -3, -3,  9, -3, -4, -3, -3, -1, -1, -3, -1, -2, -3, -1, -1, -2, -2, -1, -3, -3, -2, -4},  // C
+	{-1,  1,  0,  0, -3,  5,  2, -2,  0, -3, -2,  1,  0, -3, -1,  0, -1, -2, -1, -2,  0,  3, -1, -4},  // Q
+	{-1,  0,  0,  2, -4,  2,  5, -2,  0, -3, -3,  1, -2, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},  // E
+	{ 0, -2,  0, -1, -3, -2, -2,  6, -2, -4, -4, -2, -3, -3, -2,  0, -2, -2, -3, -3, -1, -2, -1, -4},  // G
+	{-2,  0,  1, -1, -3,  0,  0, -2,  8, -3, -3, -1, -2, -1, -2, -1, -2, -2,  2, -3,  0,  0, -1, -4},  // H
+	{-1, -3, -3, -3, -1, -3, -3, -4, -3,  4,  2, -3,  1,  0, -3, -2, -1, -3, -1,  3, -3, -3, -1, -4},  // I
+	{-1, -2, -3, -4, -1, -2, -3, -4, -3,  2,  4, -2,  2,  0, -3, -2, -1, -2, -1,  1, -4, -3, -1, -4},  // L
+	{-1,  2,  0, -1, -3,  1,  1, -2, -1, -3, -2,  5, -1, -3, -1,  0, -1, -3, -2, -2,  0,  1, -1, -4},  // K
+	{-1, -1, -2, -3, -1,  0, -2, -3, -2,  1,  2, -1,  5,  0, -2, -1, -1, -1, -1,  1, -3, -1, -1, -4},  // M
+	{-2, -3, -3, -3, -2, -3, -3, -3, -1,  0,  0, -3,  0,  6, -4, -2, -2,  1,  3, -1, -3, -3, -1, -4},  // F
+	{-1, -2, -2, -1, -3, -1, -1, -2, -2, -3, -3, -1, -2, -4,  7, -1, -1, -4, -3, -2, -2, -1, -2, -4},  // P
+	{ 1, -1,  1,  0, -1,  0,  0,  0, -1, -2, -2,  0, -1, -2, -1,  4,  1, -3, -2, -2,  0,  0,  0, -4},  // S
+	{ 0, -1,  0, -1, -1, -1, -1, -2, -2, -1, -1, -1, -1, -2, -1,  1,  5, -2, -2,  0, -1, -1,  0, -4},  // T
+	{-3, -3, -4, -4, -2, -2, -3, -2, -2, -3, -2, -3, -1,  1, -4, -3, -2, 11,  2, -3, -4, -3, -2, -4},  // W
+	{-2, -2, -2, -3, -2, -1, -2, -3,  2, -1, -1, -2, -1,  3, -3, -2, -2,  2,  7, -1, -3, -2, -1, -4},  // Y
+	{ 0, -3, -3, -3, -1, -2, -2, -3, -3,  3,  1, -2,  1, -1, -2, -2,  0, -3, -1,  4, -3, -2, -1, -4},  // V
+	{-2, -1,  3,  4, -3,  0,  1, -1,  0, -3, -4,  0, -3, -3, -2,  0, -1, -4, -3, -3,  4,  1, -1, -4},  // B
+	{-1,  0,  0,  1, -3,  3,  4, -2,  0, -3, -3,  1, -1, -3, -1,  0, -1, -3, -2, -2,  1,  4, -1, -4},  // Z
+	{ 0, -1, -1, -1, -2, -1, -1, -1, -1, -1, -1, -1, -1, -1, -2,  0,  0, -2, -1, -1, -1, -1, -1, -4},  // X
+	{-4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4,  1},  // *
+};
+
+using seq_t = hls::vector<residue_t, MAX_SEQ_LENGTH>;
+using packed_seq_t = hls::vector<ap_uint<64>, PACKED_SEQ_WORDS>;
+
+#else
+
+#define PACKED_SEQ_WORDS 1
+
 #define SCORE_NUM_BITS 5
 
+using seq_t = hls::vector<nbase_t, MAX_SEQ_LENGTH>;
+using packed_seq_t = ap_uint<64>;
+
+#endif // PROTEIN_MODE
+
 using score_t = ap_uint<SCORE_NUM_BITS>;
 
-using seq_t = hls::vector<nbase_t, MAX_SEQ_LENGTH>;
+// Per-sequence mask flagging the ambiguous nucleobases (N and the other IUPAC codes). Bit i is set when nucleobase
+// i is ambiguous, in which case its 2-bit code is meaningless (the host stores NB_A).
+using mask_t = ap_uint<MAX_SEQ_LENGTH>;
+
+// How the PEs score a pair of nucleobases where at least one of them is ambiguous.
+// AMBIGUOUS_DISABLED does not even read the masks, so all nucleobases are taken as unambiguous.
+#define AMBIGUOUS_DISABLED 0
+#define AMBIGUOUS_MISMATCH 1
+#define AMBIGUOUS_WILDCARD 2
 
 ////////////////////////////////
 
@@ -27,11 +119,25 @@ uint32_t SeqMatcher_HW(
 	uint64_t* seqsDB,
 	uint64_t* seqsSpecimen,
 	uint8_t* lengthsDB, uint8_t* lengthsSpecimen,
-	hls::burst_maxi<int8_t> scores
+	hls::burst_maxi<int8_t> scores,
+	uint32_t* masksDB, uint32_t* masksSpecimen,
+	uint32_t ambiguousMode
 );
 
 
-int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB);
+#ifdef PROTEIN_MODE
+int8_t CalcScoreProteinSystolicArray(subst_t substRows[MAX_SEQ_LENGTH][NUM_RESIDUE_CODES], uint8_t lengthA,
+		seq_t seqB, uint8_t lengthB);
+#else
+int8_t CalcScoreLinearSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode);
+
+int8_t CalcScoreBandedSystolicArray(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode);
+
+int8_t CalcEditDistanceBitParallel(seq_t seqA, uint8_t lengthA, seq_t seqB, uint8_t lengthB,
+		mask_t maskA, mask_t maskB, uint8_t ambiguousMode);
+#endif
 
 #endif // SEQMATCHER_H
 
@@ -1,12 +1,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <time.h>
 #include <math.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <ap_int.h>
 #include <string>
+#include <algorithm>
 #include <assert.h>
 
 #include "seqMatcher.h"
@@ -15,23 +17,142 @@
 #define NUM_DATABASE_ENTRIES_TO_CHECK 4
 #define NUM_TIMES_TO_TEST 1
 
-uint8_t compressNucleoBase(char c) {
-	if (c == 'A') {
-		return NB_A;
-	} else if (c == 'T') {
-		return NB_T;
-	} else if (c == 'G') {
-		return NB_G;
-	} else if (c == 'C') {
-		return NB_C;
+// Directory of database.txt, specimen.txt and the gold scores.bin, relative to the directory where Vitis runs the
+// C simulation. The native build (make hls_native_sim) passes its own directory, number of DB entries and gold
+// scores file (generated by the CPU engine of seqMatcher) on the command line:
+// testbench [testdataDir [numDBEntries [goldScoresFile]]].
+#define DEFAULT_TESTDATA_DIR "../../../../../testdata"
+
+#define NUM_PROTEIN_DB_ENTRIES 100
+#define NUM_PROTEIN_SPECIMENS 100
+
+// Compresses a nucleobase into its 2-bit code. Ambiguous IUPAC codes (N, R, Y, ...) are stored as NB_A and flagged
+// through 'ambiguous', so that the accelerator can score them as a mismatch or as a wildcard.
+// Returns false if the character is not a nucleobase.
+bool compressNucleoBase(char c, uint8_t & nbase, bool & ambiguous) {
+	ambiguous = false;
+
+	switch (toupper(c)) {
+	case 'A': nbase = NB_A; return true;
+	case 'T': nbase = NB_T; return true;
+	case 'G': nbase = NB_G; return true;
+	case 'C': nbase = NB_C; return true;
+	case 'N': case 'R': case 'Y': case 'S': case 'W': case 'K':
+	case 'M': case 'B': case 'D': case 'H': case 'V':
+		nbase = NB_A;
+		ambiguous = true;
+		return true;
 	}
 
-	// Shouldn't find any other letter
-	assert(false);
+	return false;
 }
 
+#if BAND_WIDTH > 0 || defined(EDIT_DISTANCE_ENGINE)
+typedef int8_t (*TReferenceFunc)(uint64_t seqA, uint8_t lengthA, uint64_t seqB, uint8_t lengthB);
+
+bool CheckScoresWithReference(TReferenceFunc reference, uint64_t* seqsDB, uint8_t* lengthsDB, uint32_t numDBEntries,
+    uint64_t* seqsSpecimen, uint8_t* lengthsSpecimen, uint32_t numSeqsSpecimen, int8_t* scores)
+{
+  for (uint32_t iDB = 0; iDB < numDBEntries; ++ iDB) {
+    for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec) {
+      int8_t expected = reference(seqsDB[iDB], lengthsDB[iDB], seqsSpecimen[iSpec], lengthsSpecimen[iSpec]);
+      int8_t actual = scores[iDB * numSeqsSpecimen + iSpec];
+      if (actual != expected) {
+        printf("Mismatch at DB entry %u, specimen %u: expected %d, got %d\n", iDB, iSpec, expected, actual);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+#endif
+
+#ifdef EDIT_DISTANCE_ENGINE
+///////////////////////////////////////////////////////////////////////////////
+// Plain Levenshtein DP, used to validate the bit-parallel edit distance engine.
+int8_t CalcEditDistanceReference(uint64_t seqA, uint8_t lengthA, uint64_t seqB, uint8_t lengthB)
+{
+  int D[MAX_SEQ_LENGTH+1][MAX_SEQ_LENGTH+1];
+
+  for (int i = 0; i <= lengthA; ++ i)
+    D[i][0] = i;
+  for (int j = 0; j <= lengthB; ++ j)
+    D[0][j] = j;
+
+  for (int i = 1; i <= lengthA; ++ i) {
+    for (int j = 1; j <= lengthB; ++ j) {
+      bool match = ((seqA >> (2 * (i-1))) & 0b11) == ((seqB >> (2 * (j-1))) & 0b11);
+      int distance = D[i-1][j-1] + (match ? 0 : 1);
+      distance = std::min(distance, D[i-1][j] + 1);
+      D[i][j] = std::min(distance, D[i][j-1] + 1);
+    }
+  }
+
+  return D[lengthA][lengthB];
+}
+#endif
+
+#if BAND_WIDTH > 0
 ///////////////////////////////////////////////////////////////////////////////
-uint32_t ReadLines(uint64_t* dest, uint8_t* lengths, const char * fileName, uint32_t numLines)
+// Plain Smith-Waterman restricted to the band |i - j| <= BAND_WIDTH. The banded engine only matches the golden
+// output when the best path stays inside the band, so it is validated against this reference instead.
+int8_t CalcScoreBandedReference(uint64_t seqA, uint8_t lengthA, uint64_t seqB, uint8_t lengthB)
+{
+  int H[MAX_SEQ_LENGTH+1][MAX_SEQ_LENGTH+1] = {};
+  int maxScore = 0;
+
+  for (int i = 1; i <= lengthA; ++ i) {
+    for (int j = 1; j <= lengthB; ++ j) {
+      if (abs(i - j) > BAND_WIDTH)
+        continue;  // Cells outside the band stay at 0
+
+      bool match = ((seqA >> (2 * (i-1))) & 0b11) == ((seqB >> (2 * (j-1))) & 0b11);
+      int score = H[i-1][j-1] + (match ? 1 : -1);
+      score = std::max(score, H[i-1][j] - 1);
+      score = std::max(score, H[i][j-1] - 1);
+      H[i][j] = std::max(score, 0);
+      maxScore = std::max(maxScore, H[i][j]);
+    }
+  }
+
+  return maxScore;
+}
+#endif
+
+#ifdef PROTEIN_MODE
+///////////////////////////////////////////////////////////////////////////////
+// Plain Smith-Waterman with BLOSUM62 and a linear gap penalty, saturated like the accelerator output.
+int8_t CalcScoreProteinReference(const uint8_t* seqA, uint8_t lengthA, const uint8_t* seqB, uint8_t lengthB)
+{
+  int H[MAX_SEQ_LENGTH+1][MAX_SEQ_LENGTH+1] = {};
+  int maxScore = 0;
+
+  for (int i = 1; i <= lengthA; ++ i) {
+    for (int j = 1; j <= lengthB; ++ j) {
+      int score = H[i-1][j-1] + BLOSUM62[seqA[i-1]][seqB[j-1]];
+      score = std::max(score, H[i-1][j] - PROTEIN_GAP_PENALTY);
+      score = std::max(score, H[i][j-1] - PROTEIN_GAP_PENALTY);
+      H[i][j] = std::max(score, 0);
+      maxScore = std::max(maxScore, H[i][j]);
+    }
+  }
+
+  return std::min(maxScore, 127);
+}
+
+// Packs residues RESIDUES_PER_WORD per 64-bit word, as the host does
+void PackProtein(const uint8_t* residues, uint8_t length, uint64_t* dest)
+{
+  for (int w = 0; w < PACKED_SEQ_WORDS; ++ w)
+    dest[w] = 0;
+
+  for (int i = 0; i < length; ++ i)
+    dest[i / RESIDUES_PER_WORD] |= uint64_t(residues[i]) << (5 * (i % RESIDUES_PER_WORD));
+}
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+uint32_t ReadLines(uint64_t* dest, uint32_t* masks, uint8_t* lengths, const char * fileName, uint32_t numLines)
 {
   FILE * input;
   uint32_t readLines = 0;
@@ -50,18 +171,28 @@ uint32_t ReadLines(uint64_t* dest, uint8_t* lengths, const char * fileName, uint
 
     uint8_t length = 0;
     uint64_t seq = 0;
+    uint32_t mask = 0;
 
     for (iChar = 0; (iChar < lineSize) && (iChar < MAX_SEQ_LENGTH); ++ iChar) {
-      if (line[iChar] != '\n') {  // New lines are included in the string by fgets
+      if ((line[iChar] != '\n') && (line[iChar] != '\r')) {  // New lines are included in the string by fgets
+        uint8_t nbase;
+        bool ambiguous;
 
-    	uint8_t nbase = compressNucleoBase(line[iChar]) & 0b11;
-    	seq |= uint64_t(nbase) << (2 * iChar);
+        if (!compressNucleoBase(line[iChar], nbase, ambiguous)) {
+          printf("Invalid nucleobase '%c' in line %u of [%s]\n", line[iChar], readLines + 1, fileName);
+          fclose(input);
+          return readLines;
+        }
+
+    	seq |= uint64_t(nbase & 0b11) << (2 * iChar);
+    	mask |= uint32_t(ambiguous) << iChar;
 
         ++length;
       }
     }
 
     *dest++ = seq;
+    *masks++ = mask;
     *lengths++ = length;
   }
 
@@ -93,21 +224,25 @@ bool DumpScores(int8_t * scores, uint32_t numScores, const char * fileName)
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-int run_test(uint32_t numDBEntries) {
+int run_test(uint32_t numDBEntries, const std::string & testdataDir, const std::string & goldScoresFile) {
   printf("---------------------------------\n");
   printf(" TESTING %d DB entries... \n", numDBEntries);
   printf("---------------------------------\n");
 
   uint32_t numSeqsSpecimen = 1000;
 
-  char databaseTitle[] = "../../../../../testdata/database.txt";
-  char specimenTitle[] = "../../../../../testdata/specimen.txt";
-  char scoresTitle[] = "../../../../../testdata/generated_scores_hls.bin";
-  const char* goldScoresTitle = "../../../../../testdata/scores.bin";
+  std::string databaseFile = testdataDir + "/database.txt";
+  std::string specimenFile = testdataDir + "/specimen.txt";
+  std::string scoresFile = testdataDir + "/generated_scores_hls.bin";
+  const char* databaseTitle = databaseFile.c_str();
+  const char* specimenTitle = specimenFile.c_str();
+  const char* scoresTitle = scoresFile.c_str();
+  const char* goldScoresTitle = goldScoresFile.c_str();
 
 
   uint64_t* seqsDB, *seqsSpecimen;
   uint8_t* lengthsDB, *lengthsSpecimen;
+  uint32_t* masksDB, *masksSpecimen;
   int8_t* scores;
   bool res = true;
 
@@ -123,13 +258,16 @@ int run_test(uint32_t numDBEntries) {
   // Allocate memory for all the data arrays
   seqsDB = (uint64_t*)malloc(numDBEntries*sizeof(uint64_t));
   lengthsDB = (uint8_t *)malloc(numDBEntries*sizeof(uint8_t));
+  masksDB = (uint32_t *)malloc(numDBEntries*sizeof(uint32_t));
 
   seqsSpecimen = (uint64_t*)malloc(numSeqsSpecimen*sizeof(uint64_t));
   lengthsSpecimen = (uint8_t*)malloc(numSeqsSpecimen*sizeof(uint8_t));
+  masksSpecimen = (uint32_t*)malloc(numSeqsSpecimen*sizeof(uint32_t));
 
   scores = (int8_t *)malloc(numDBEntries*numSeqsSpecimen*sizeof(int8_t));
 
-  if ( (seqsDB == NULL) || (seqsSpecimen == NULL) || (lengthsDB == NULL) || (lengthsSpecimen == NULL) || (scores == NULL) ) {
+  if ( (seqsDB == NULL) || (seqsSpecimen == NULL) || (lengthsDB == NULL) || (lengthsSpecimen == NULL) || (scores == NULL) ||
+	   (masksDB == NULL) || (masksSpecimen == NULL) ) {
 	printf("Error allocating memory\n");
 	res = false;
   }
@@ -139,7 +277,7 @@ int run_test(uint32_t numDBEntries) {
 	printf("Reading database file [%s]...\n", databaseTitle);
 	fflush(stdout);
 	uint32_t readLines;
-	readLines = ReadLines(seqsDB, lengthsDB, databaseTitle, numDBEntries);
+	readLines = ReadLines(seqsDB, masksDB, lengthsDB, databaseTitle, numDBEntries);
 	if (readLines != numDBEntries) {
 	  printf("Error reading database: Read %'u lines instead of %'u\n", readLines, numDBEntries);
 	  res = false;
@@ -154,7 +292,7 @@ int run_test(uint32_t numDBEntries) {
 	printf("Reading specimen file [%s]...\n", specimenTitle);
 	fflush(stdout);
 	uint32_t readLines;
-	readLines = ReadLines(seqsSpecimen, lengthsSpecimen, specimenTitle, numSeqsSpecimen);
+	readLines = ReadLines(seqsSpecimen, masksSpecimen, lengthsSpecimen, specimenTitle, numSeqsSpecimen);
 	if (readLines != numSeqsSpecimen) {
 	  printf("Error reading specimen: Read %'u lines instead of %'u\n", readLines, numSeqsSpecimen);
 	  res = false;
@@ -168,7 +306,8 @@ int run_test(uint32_t numDBEntries) {
   // Compute the scores
   if (res) {
 	printf("Calculating scores. Num comparisons: %'u * %'u = %'u\n", numDBEntries, numSeqsSpecimen, numDBEntries*numSeqsSpecimen);
-	uint32_t comparisons = SeqMatcher_HW(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen, scores);
+	uint32_t comparisons = SeqMatcher_HW(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen, scores,
+			masksDB, masksSpecimen, AMBIGUOUS_MISMATCH);
 
 	assert(comparisons == numDBEntries * numSeqsSpecimen);
 	printf("Calculated %'u scores\n", comparisons);
@@ -178,6 +317,29 @@ int run_test(uint32_t numDBEntries) {
 	printf("Scores dumped.\n");
   }
 
+#if defined(EDIT_DISTANCE_ENGINE)
+  // Compare the edit distances with the Levenshtein reference
+  if (res) {
+	  printf("Comparing edit distances to the reference...\n\n");
+
+	  res = CheckScoresWithReference(CalcEditDistanceReference, seqsDB, lengthsDB, numDBEntries, seqsSpecimen, lengthsSpecimen, numSeqsSpecimen, scores);
+	  if (res)
+		  std::cout << std::endl << "SUCCESS!: Output matches the edit distance reference" << std::endl << std::endl;
+	  else
+		  std::cout << std::endl << "ERROR!: Output does not match the edit distance reference" << std::endl << std::endl;
+  }
+#elif BAND_WIDTH > 0
+  // Compare the scores with the banded reference
+  if (res) {
+	  printf("Comparing scores to the banded reference (BAND_WIDTH = %d)...\n\n", BAND_WIDTH);
+
+	  res = CheckScoresWithReference(CalcScoreBandedReference, seqsDB, lengthsDB, numDBEntries, seqsSpecimen, lengthsSpecimen, numSeqsSpecimen, scores);
+	  if (res)
+		  std::cout << std::endl << "SUCCESS!: Output matches the banded reference" << std::endl << std::endl;
+	  else
+		  std::cout << std::endl << "ERROR!: Output does not match the banded reference" << std::endl << std::endl;
+  }
+#else
   // Compare the scores with the golden output
   if (res) {
 	  printf("Comparing scores to gold...\n\n");
@@ -194,6 +356,7 @@ int run_test(uint32_t numDBEntries) {
 		  res = false;
 	  }
   }
+#endif
 
   // Free array memory.
   if (seqsDB != NULL)
@@ -202,6 +365,10 @@ int run_test(uint32_t numDBEntries) {
 	free(seqsSpecimen);
   if (lengthsDB != NULL)
 	free(lengthsDB);
+  if (masksDB != NULL)
+	free(masksDB);
+  if (masksSpecimen != NULL)
+	free(masksSpecimen);
   if (lengthsSpecimen != NULL)
 	free(lengthsSpecimen);
   if (scores != NULL)
@@ -211,16 +378,158 @@ int run_test(uint32_t numDBEntries) {
 }
 
 
+// Scores a sequence containing an ambiguous nucleobase against its unambiguous version, in both ambiguity modes.
+int run_ambiguity_test() {
+  printf("---------------------------------\n");
+  printf(" TESTING ambiguous nucleobases... \n");
+  printf("---------------------------------\n");
+
+  const char* seqText = "ACGTACGTACGTACGTACGT";
+  const char* ambiguousSeqText = "ACGTACGTACNTACGTACGT";
+  uint64_t seqs[2] = {0, 0};
+  uint32_t masks[2] = {0, 0};
+  uint8_t lengths[2] = {20, 20};
+  int8_t scores[1];
+
+  for (uint32_t iChar = 0; iChar < 20; ++ iChar) {
+	uint8_t nbase;
+	bool ambiguous;
+
+	compressNucleoBase(seqText[iChar], nbase, ambiguous);
+	seqs[0] |= uint64_t(nbase) << (2 * iChar);
+	compressNucleoBase(ambiguousSeqText[iChar], nbase, ambiguous);
+	seqs[1] |= uint64_t(nbase) << (2 * iChar);
+	masks[1] |= uint32_t(ambiguous) << iChar;
+  }
+
+#ifdef EDIT_DISTANCE_ENGINE
+  // As a mismatch, the sequences are one substitution apart
+  const int8_t expectedMismatch = 1, expectedWildcard = 0;
+#else
+  // As a mismatch, the best local alignment is 10 matches, 1 mismatch and 9 matches
+  const int8_t expectedMismatch = 18, expectedWildcard = 20;
+#endif
+
+  SeqMatcher_HW(1, 1, &seqs[0], &seqs[1], &lengths[0], &lengths[1], scores, &masks[0], &masks[1], AMBIGUOUS_MISMATCH);
+  if (scores[0] != expectedMismatch) {
+	printf("ERROR!: Ambiguous nucleobase as mismatch scored %d instead of %d\n", scores[0], expectedMismatch);
+	return -1;
+  }
+
+  SeqMatcher_HW(1, 1, &seqs[0], &seqs[1], &lengths[0], &lengths[1], scores, &masks[0], &masks[1], AMBIGUOUS_WILDCARD);
+  if (scores[0] != expectedWildcard) {
+	printf("ERROR!: Ambiguous nucleobase as wildcard scored %d instead of %d\n", scores[0], expectedWildcard);
+	return -1;
+  }
+
+  printf("SUCCESS!: Ambiguous nucleobases scored correctly\n\n");
+  return 0;
+}
+
+
+#ifdef PROTEIN_MODE
+// Matches random proteins (and mutated copies of them) against the plain Smith-Waterman reference.
+int run_protein_test(uint32_t numDBEntries, uint32_t numSeqsSpecimen) {
+  printf("---------------------------------\n");
+  printf(" TESTING %d x %d proteins... \n", numDBEntries, numSeqsSpecimen);
+  printf("---------------------------------\n");
+
+  uint8_t residuesDB[NUM_PROTEIN_DB_ENTRIES][MAX_SEQ_LENGTH];
+  uint8_t residuesSpecimen[NUM_PROTEIN_SPECIMENS][MAX_SEQ_LENGTH];
+  uint64_t seqsDB[NUM_PROTEIN_DB_ENTRIES * PACKED_SEQ_WORDS], seqsSpecimen[NUM_PROTEIN_SPECIMENS * PACKED_SEQ_WORDS];
+  uint8_t lengthsDB[NUM_PROTEIN_DB_ENTRIES], lengthsSpecimen[NUM_PROTEIN_SPECIMENS];
+  uint32_t masksDB[NUM_PROTEIN_DB_ENTRIES] = {}, masksSpecimen[NUM_PROTEIN_SPECIMENS] = {};
+  static int8_t scores[NUM_PROTEIN_DB_ENTRIES * NUM_PROTEIN_SPECIMENS];
+
+  srand(1234);
+
+  for (uint32_t iDB = 0; iDB < numDBEntries; ++ iDB) {
+	lengthsDB[iDB] = 16 + rand() % (MAX_SEQ_LENGTH - 15);
+	for (int i = 0; i < MAX_SEQ_LENGTH; ++ i)
+	  residuesDB[iDB][i] = rand() % NUM_RESIDUES;
+  }
+
+  // Half of the specimens are copies of DB entries with a few substitutions, so that high scores are exercised
+  for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec) {
+	if (iSpec % 2 == 0) {
+	  uint32_t iDB = iSpec % numDBEntries;
+	  lengthsSpecimen[iSpec] = lengthsDB[iDB];
+	  memcpy(residuesSpecimen[iSpec], residuesDB[iDB], MAX_SEQ_LENGTH);
+	  for (int iMutation = 0; iMutation < 3; ++ iMutation)
+		residuesSpecimen[iSpec][rand() % lengthsSpecimen[iSpec]] = rand() % NUM_RESIDUES;
+	} else {
+	  lengthsSpecimen[iSpec] = 16 + rand() % (MAX_SEQ_LENGTH - 15);
+	  for (int i = 0; i < MAX_SEQ_LENGTH; ++ i)
+		residuesSpecimen[iSpec][i] = rand() % NUM_RESIDUES;
+	}
+  }
+
+  // A pair of poly-tryptophans scores 32 * 11, which has to saturate to 127
+  lengthsDB[0] = lengthsSpecimen[0] = MAX_SEQ_LENGTH;
+  memset(residuesDB[0], strchr(RESIDUE_ALPHABET, 'W') - RESIDUE_ALPHABET, MAX_SEQ_LENGTH);
+  memset(residuesSpecimen[0], strchr(RESIDUE_ALPHABET, 'W') - RESIDUE_ALPHABET, MAX_SEQ_LENGTH);
+
+  for (uint32_t iDB = 0; iDB < numDBEntries; ++ iDB)
+	PackProtein(residuesDB[iDB], lengthsDB[iDB], &seqsDB[iDB * PACKED_SEQ_WORDS]);
+  for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec)
+	PackProtein(residuesSpecimen[iSpec], lengthsSpecimen[iSpec], &seqsSpecimen[iSpec * PACKED_SEQ_WORDS]);
+
+  uint32_t comparisons = SeqMatcher_HW(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+		  scores, masksDB, masksSpecimen, AMBIGUOUS_DISABLED);
+  assert(comparisons == numDBEntries * numSeqsSpecimen);
+
+  for (uint32_t iDB = 0; iDB < numDBEntries; ++ iDB) {
+	for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec) {
+	  int8_t expected = CalcScoreProteinReference(residuesDB[iDB], lengthsDB[iDB], residuesSpecimen[iSpec], lengthsSpecimen[iSpec]);
+	  int8_t actual = scores[iDB * numSeqsSpecimen + iSpec];
+	  if (actual != expected) {
+		printf("ERROR!: Mismatch at DB entry %u, specimen %u: expected %d, got %d\n", iDB, iSpec, expected, actual);
+		return -1;
+	  }
+	}
+  }
+
+  printf("SUCCESS!: Output matches the protein reference\n\n");
+  return 0;
+}
+#endif
+
+
 int main(int argc, char ** argv)
 {
+  std::string testdataDir = (argc > 1) ? argv[1] : DEFAULT_TESTDATA_DIR;
+  uint32_t numDBEntries = NUM_DATABASE_ENTRIES_TO_CHECK;
+  std::string goldScoresFile = (argc > 3) ? argv[3] : testdataDir + "/scores.bin";
+
+  if ((argc > 2) && (sscanf(argv[2], "%u", &numDBEntries) != 1)) {
+	  printf("Usage: testbench [testdataDir [numDBEntries [goldScoresFile]]]\n");
+	  return -1;
+  }
+
+#ifdef PROTEIN_MODE
+  if (run_protein_test(NUM_PROTEIN_DB_ENTRIES, NUM_PROTEIN_SPECIMENS) != 0) {
+	  printf("---------------------------------\n");
+	  printf(" SOME TEST FAILED \n");
+	  printf("---------------------------------\n");
+	  return -1;
+  }
+#else
+  if (run_ambiguity_test() != 0) {
+	  printf("---------------------------------\n");
+	  printf(" SOME TEST FAILED \n");
+	  printf("---------------------------------\n");
+	  return -1;
+  }
+
   for(int i = 0; i < NUM_TIMES_TO_TEST; ++i) {
-	  if(run_test(NUM_DATABASE_ENTRIES_TO_CHECK) != 0) {
+	  if(run_test(numDBEntries, testdataDir, goldScoresFile) != 0) {
 		  printf("---------------------------------\n");
 		  printf(" SOME TEST FAILED \n");
 		  printf("---------------------------------\n");
 		  return -1;
 	  }
   }
+#endif
 
   printf("---------------------------------\n");
   printf(" ALL TESTS PASSED \n");
@@ -228,4 +537,3 @@ int main(int argc, char ** argv)
 
   return 0;
 }
-
@@ -16,6 +16,20 @@
 #include <asm/uaccess.h>         /* copy_to copy_from _user */
 #include <linux/uaccess.h>
 #include <linux/io.h>
+#include <linux/ioctl.h>
+#include <linux/poll.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/mutex.h>
+#include <linux/mm.h>
+#include <linux/device.h>
+#include <linux/dma-mapping.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+#include <linux/delay.h>
+#include <linux/overflow.h> /* array_size, check_add_overflow */
+#include <linux/math64.h>        /* div_u64 */
 
 #define DRIVER_NAME "seq_matcher_driver"
 #define SEQ_MATCHER_IRQ 48  // Hard-coded value of IRQ vector (GIC: 61).
@@ -42,14 +56,16 @@ struct TRegs {
     uint32_t padding6; // 0x44
     uint32_t scores; // 0x48
     uint32_t padding7; // 0x4C
+    uint32_t masksDB; // 0x50
+    uint32_t padding8; // 0x54
+    uint32_t masksSpecimen; // 0x58
+    uint32_t padding9; // 0x5C
+    uint32_t ambiguousMode; // 0x60
+    uint32_t padding10; // 0x64
 };
 
-// SeqMatcher_HW(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
-    // void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen,
-    // void * scores, uint32_t &numComparisons)
-
-// Structure used to pass commands between user-space and kernel-space.
-struct user_message {
+// Values of the argument registers of a job, with the physical addresses of the buffers.
+struct job_registers {
     uint32_t numDBEntries;
     uint32_t numSeqsSpecimen;
     uint32_t seqsDB;
@@ -57,18 +73,182 @@ struct user_message {
     uint32_t lengthsDB;
     uint32_t lengthsSpecimen;
     uint32_t scores;
+    uint32_t masksDB;
+    uint32_t masksSpecimen;
+    uint32_t ambiguousMode;
+};
+
+// Structures used to pass commands between user-space and kernel-space (ioctl).
+// The DMA buffers are allocated by the driver and mapped into the process with mmap(). The user refers to them by
+// their handle, so it never handles physical addresses.
+
+// A position in a DMA buffer: its handle and an offset inside it.
+struct buffer_ref {
+    uint32_t handle;
+    uint32_t offset;
+};
 
-    uint32_t numComparisonsPtr;
+// SEQ_MATCHER_IOC_ALLOC: allocates a buffer of size bytes. The driver returns its handle, and the offset to pass
+// to mmap() to map it.
+struct alloc_message {
+    uint32_t size;
+    uint32_t cacheable;
+    uint32_t handle;
+    uint32_t mmapOffset;
 };
 
+// SEQ_MATCHER_IOC_SUBMIT: queues a job. The masks are only used when ambiguousMode != 0 (their handles can be 0
+// otherwise). The job is collected with read() of a uint32_t, which returns its number of comparisons.
+struct job_message {
+    uint32_t numDBEntries;
+    uint32_t numSeqsSpecimen;
+    struct buffer_ref seqsDB;
+    struct buffer_ref seqsSpecimen;
+    struct buffer_ref lengthsDB;
+    struct buffer_ref lengthsSpecimen;
+    struct buffer_ref scores;
+    struct buffer_ref masksDB;
+    struct buffer_ref masksSpecimen;
+    uint32_t ambiguousMode;
+    uint32_t timeoutMs;           /* Time limit of the job once started. 0: default of the module */
+};
+
+// Cache maintenance of a range of a cacheable DMA buffer, given by its position in the buffer.
+struct cache_message {
+    uint32_t handle;
+    uint32_t offset;
+    uint32_t size;
+};
+
+#define SEQ_MATCHER_IOC_MAGIC 'q'
+// Write back (and invalidate) the lines of a buffer written by the CPU, before the accelerator reads it.
+#define SEQ_MATCHER_IOC_FLUSH _IOW(SEQ_MATCHER_IOC_MAGIC, 1, struct cache_message)
+// Discard the lines of a buffer written by the accelerator, before the CPU reads it.
+#define SEQ_MATCHER_IOC_INVALIDATE _IOW(SEQ_MATCHER_IOC_MAGIC, 2, struct cache_message)
+#define SEQ_MATCHER_IOC_ALLOC _IOWR(SEQ_MATCHER_IOC_MAGIC, 3, struct alloc_message)
+// Frees the buffer with the given handle. It fails if it is still mapped, or if a job of the file is in flight.
+#define SEQ_MATCHER_IOC_FREE _IOW(SEQ_MATCHER_IOC_MAGIC, 4, uint32_t)
+#define SEQ_MATCHER_IOC_SUBMIT _IOW(SEQ_MATCHER_IOC_MAGIC, 5, struct job_message)
+// Cancels the job of the file, whether it is queued or running. A running job is stopped by resetting the
+// accelerator. The job still has to be collected: read() returns -ECANCELED.
+#define SEQ_MATCHER_IOC_CANCEL _IO(SEQ_MATCHER_IOC_MAGIC, 7)
+// Sets the busy-poll window of the file, in microseconds. read() polls the accelerator for up to this time before
+// sleeping until the interrupt, which saves the interrupt round trip on small jobs. 0 disables it.
+#define SEQ_MATCHER_IOC_SET_POLL_WINDOW _IOW(SEQ_MATCHER_IOC_MAGIC, 6, uint32_t)
+
+// Bits of the control register
+#define AP_START 0x1
+#define AP_IDLE 0x4
+
+// The accelerator is reset with the reset of the PL (FCLK_RESET0_N), in the System Level Control Registers
+#define SLCR_BASE 0xF8000000
+#define SLCR_LOCK 0x004
+#define SLCR_UNLOCK 0x008
+#define SLCR_FPGA_RST_CTRL 0x240
+#define SLCR_LOCK_KEY 0x767B
+#define SLCR_UNLOCK_KEY 0xDF0D
+#define FPGA0_OUT_RST 0x1
+
+// Handles are mmap() offsets in pages, which must fit in a 32-bit offset.
+#define MAX_BUFFER_HANDLE ((1UL << (32 - PAGE_SHIFT)) - 1)
+
+// Sizes of the elements of the arrays read and written by the accelerator. A sequence is one 64-bit word of
+// nucleobases, or PROTEIN_WORDS_PER_SEQ words with the PROTEIN_MODE bitstream.
+#define SEQ_WORD_SIZE 8
+#define PROTEIN_WORDS_PER_SEQ 3
+#define LENGTH_SIZE 1
+#define MASK_SIZE 4
+#define SCORE_SIZE 1
+
 int seq_matcher_major = 0;
 int seq_matcher_minor = 0;
 module_param(seq_matcher_major,int,S_IRUGO);
 module_param(seq_matcher_minor,int,S_IRUGO);
+// Default busy-poll window of new files (see SEQ_MATCHER_IOC_SET_POLL_WINDOW). 0 disables it.
+uint poll_window_us = 0;
+module_param(poll_window_us,uint,S_IRUGO | S_IWUSR);
+// Default time limit of a job, once started: job_timeout_ms plus 1 ms per job_timeout_cmp_per_ms comparisons, so
+// that large jobs get the time they need. A job that exceeds it is failed (read() returns -ETIMEDOUT) and the
+// accelerator is reset. job_timeout_ms = 0 disables it. The default rate is a tenth of the nominal throughput.
+uint job_timeout_ms = 10000;
+module_param(job_timeout_ms,uint,S_IRUGO | S_IWUSR);
+uint job_timeout_cmp_per_ms = 6000;
+module_param(job_timeout_cmp_per_ms,uint,S_IRUGO | S_IWUSR);
+// Set when the PROTEIN_MODE bitstream is loaded: its sequences are larger, which the jobs must fit in their buffers.
+bool protein_mode = false;
+module_param(protein_mode,bool,S_IRUGO | S_IWUSR);
+
+// A DMA buffer allocated by a file. Non-cacheable buffers are coherent memory. Cacheable buffers are contiguous
+// pages reserved from CMA without a non-cacheable kernel mapping, so that the kernel and the user only map them
+// cached. The accelerator accesses them through a streaming DMA mapping, which the user synchronizes with
+// SEQ_MATCHER_IOC_FLUSH and SEQ_MATCHER_IOC_INVALIDATE.
+struct seq_matcher_buffer {
+  struct list_head node;
+  uint32_t handle;
+  size_t size;                   /* Page aligned */
+  int cacheable;
+  void * kernelAddr;             /* Coherent mapping, or cookie of the reservation of a cacheable buffer */
+  dma_addr_t allocAddr;          /* DMA address of the allocation */
+  struct page * pages;           /* First page of a cacheable buffer */
+  dma_addr_t dmaAddr;            /* Address of the buffer for the accelerator */
+  atomic_t mapCount;             /* Mappings in user space. The buffer cannot be freed while mapped. */
+};
+
+// A job of the accelerator, in the queue of the device or running.
+struct seq_matcher_job {
+  struct list_head node;
+  struct job_registers regs;
+  uint32_t numComparisons;
+  int done;                      /* Set when the accelerator has finished it */
+  int status;                    /* 0, or the error returned by read() (-ETIMEDOUT, -ECANCELED) */
+  uint32_t timeoutMs;
+  ktime_t startTime;             /* When the accelerator started it */
+  ktime_t irqTime;               /* Interrupt that completed it, or 0 if it was completed by polling */
+};
+
+// Context of an open file of the device. Each file has at most one job in flight, so that the FIFO of jobs
+// serves the files in turn (round robin) when several processes share the accelerator.
+struct seq_matcher_file {
+  struct seq_matcher_job job;
+  int submitted;                 /* Set while the job has not been collected with read() */
+  wait_queue_head_t wq;          /* Woken when the job finishes */
+  struct list_head buffers;      /* DMA buffers of the file */
+  uint32_t nextHandle;
+  uint32_t pollWindowUs;         /* Busy-poll window of read() */
+  struct mutex buffersLock;      /* Protects the list of buffers, and the submission of jobs that use them */
+};
 
-// We declare a wait queue that will allow us to wait on a condition.
-wait_queue_head_t wq;
-int flag = 0;
+// Jobs waiting for the accelerator, in submission order, and the job running on it. Protected by queueLock.
+static LIST_HEAD(jobQueue);
+static struct seq_matcher_job * runningJob = NULL;
+static DEFINE_SPINLOCK(queueLock);
+
+// Statistics of the device, exported in /sys/class/seq_matcher/seq_matcher0/. Protected by queueLock.
+// Bucket i of the latency histogram counts the wake-ups [2^(i-1), 2^i) us after the interrupt (bucket 0: < 1 us).
+#define IRQ_LATENCY_BUCKETS 16
+struct seq_matcher_stats {
+  u64 jobsSubmitted;
+  u64 jobsCompleted;
+  u64 jobsFailed;                /* Timed out, cancelled or dropped by release() */
+  u64 busyTimeNs;                /* Time the accelerator has been running jobs */
+  u64 lastBusyTimeNs;
+  u64 comparisons;               /* Sum of the returnValue of the completed jobs */
+  u64 queueDepth;                /* Jobs waiting for the accelerator (not counting the running one) */
+  u64 maxQueueDepth;
+  u64 irqLatency[IRQ_LATENCY_BUCKETS];
+};
+static struct seq_matcher_stats stats;
+// Time of the last interrupt, in ns, not yet consumed by seq_matcher_job_done()
+static atomic64_t irqTimestamp = ATOMIC64_INIT(0);
+
+// The interrupt handler defers the completion of a job, and the start of the next one, to this work.
+static void seq_matcher_job_done(struct work_struct *work);
+static DECLARE_WORK(jobDoneWork, seq_matcher_job_done);
+
+// Fails the running job when it exceeds its time limit. It is armed when each job starts.
+static void seq_matcher_job_timeout(struct work_struct *work);
+static DECLARE_DELAYED_WORK(jobTimeoutWork, seq_matcher_job_timeout);
+static unsigned long runningDeadline;
 
 // This structure contains the device information.
 struct seq_matcher_info {
@@ -76,15 +256,24 @@ struct seq_matcher_info {
   unsigned long memStart;
   unsigned long memEnd;
   void __iomem  *baseAddr;
+  void __iomem  *slcrAddr;
   struct cdev   cdev;            /* Char device structure               */
+  struct class  *class;
+  struct device *device;         /* Owner of the DMA buffers            */
 };
 
 static struct seq_matcher_info seq_matcher_mem = {SEQ_MATCHER_IRQ, 0x40000000, 0x4000FFFF};
 
+static void seq_matcher_abort(int status);
+static void seq_matcher_free_buffer(struct seq_matcher_buffer * buffer);
+
 // Declare here the user-accessible functions that the driver implements.
 int seq_matcher_open(struct inode *inode, struct file *filp);
 int seq_matcher_release(struct inode *inode, struct file *filed_mem);
 ssize_t seq_matcher_read(struct file *filed_mem, char __user *buf, size_t count, loff_t *f_pos);
+int seq_matcher_mmap(struct file *filp, struct vm_area_struct *vma);
+unsigned int seq_matcher_poll(struct file *filp, poll_table *wait);
+long seq_matcher_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
 
 // IRQ handler function.
 static irq_handler_t  seq_matcherIRQHandler(unsigned int irq, void *dev_id, struct pt_regs *regs);
@@ -93,6 +282,9 @@ static irq_handler_t  seq_matcherIRQHandler(unsigned int irq, void *dev_id, stru
 struct file_operations seq_matcher_fops = {
   .owner =    THIS_MODULE,
   .read =     seq_matcher_read,
+  .mmap =     seq_matcher_mmap,
+  .poll =     seq_matcher_poll,
+  .unlocked_ioctl = seq_matcher_ioctl,
   .open =     seq_matcher_open,
   .release =  seq_matcher_release,
 };
@@ -102,7 +294,20 @@ struct file_operations seq_matcher_fops = {
 // Initialize the device and enable the interrups here.
 int seq_matcher_open(struct inode *inode, struct file *filp)
 {
+  struct seq_matcher_file * context;
+
   pr_info("SEQ_MATCHER_DRIVER: Performing 'open' operation\n");
+
+  context = kzalloc(sizeof(struct seq_matcher_file), GFP_KERNEL);
+  if (!context)
+    return -ENOMEM;
+  init_waitqueue_head(&context->wq);
+  INIT_LIST_HEAD(&context->buffers);
+  context->nextHandle = 1;
+  context->pollWindowUs = poll_window_us;
+  mutex_init(&context->buffersLock);
+  filp->private_data = context;
+
   return 0;         
 }
 
@@ -112,7 +317,31 @@ int seq_matcher_open(struct inode *inode, struct file *filp)
 // Stop the interrupts and disable the device.
 int seq_matcher_release(struct inode *inode, struct file *filed_mem)
 {
+  struct seq_matcher_file * context = filed_mem->private_data;
+  struct seq_matcher_buffer * buffer, * next;
+
   pr_info("SEQ_MATCHER_DRIVER: Performing 'release' operation\n");
+
+  // A queued job is dropped. A running job is stopped by resetting the accelerator, so that it does not write to
+  // the buffers once they are freed, and so that a hung accelerator (or a job without time limit) cannot block
+  // the release.
+  if (context->submitted) {
+    spin_lock(&queueLock);
+    if (runningJob == &context->job)
+      seq_matcher_abort(-ECANCELED);
+    else if (!context->job.done) {
+      list_del(&context->job.node);
+      -- stats.queueDepth;
+      ++ stats.jobsFailed;
+    }
+    spin_unlock(&queueLock);
+  }
+
+  // The file is released after the last mapping of its buffers is gone.
+  list_for_each_entry_safe(buffer, next, &context->buffers, node)
+    seq_matcher_free_buffer(buffer);
+
+  kfree(context);
   return 0;
 }
 
@@ -125,42 +354,38 @@ void seq_matcher_cleanup_module(void)
   dev_t devno = MKDEV(seq_matcher_major, seq_matcher_minor);
   disable_irq(seq_matcher_mem.irq);
   free_irq(seq_matcher_mem.irq,&seq_matcher_mem);
+  cancel_work_sync(&jobDoneWork);
+  cancel_delayed_work_sync(&jobTimeoutWork);
+  if (seq_matcher_mem.device)
+    device_destroy(seq_matcher_mem.class, devno);
+  if (seq_matcher_mem.class)
+    class_destroy(seq_matcher_mem.class);
   iounmap(seq_matcher_mem.baseAddr);
+  if (seq_matcher_mem.slcrAddr)
+    iounmap(seq_matcher_mem.slcrAddr);
   release_mem_region(seq_matcher_mem.memStart, seq_matcher_mem.memEnd - seq_matcher_mem.memStart + 1);
   cdev_del(&seq_matcher_mem.cdev);
   unregister_chrdev_region(devno, 1);        /* unregistering device */
   pr_info("SEQ_MATCHER_DRIVER: Cdev deleted, seq_matcher device unmapped, chdev unregistered\n");
 }
 
-// Function that implements system call read() for our driver.
-// Returns 1 uint32_t with the number of times the interrupt has been detected.
-ssize_t seq_matcher_read(struct file *filed_mem, char __user *buf, size_t count, loff_t *f_pos)
+// Programs the peripheral registers with a job and starts the accelerator.
+static void seq_matcher_start(struct seq_matcher_job * job)
 {
+  struct job_registers * message = &job->regs;
   volatile struct TRegs * slave_regs = (struct TRegs*)seq_matcher_mem.baseAddr;
-  struct user_message message;
   uint32_t status;
 
-  if (count < sizeof(struct user_message)) {
-    pr_err("SEQ_MATCHER_DRIVER: USer buffer too small (> %d bytes).\n", sizeof(struct user_message));
-    return -1;
-  }
-
-  // Copy the information from user-space to the kernel-space buffer.
-  if(raw_copy_from_user(&message, buf, sizeof(struct user_message)))
-  {
-    pr_err("SEQ_MATCHER_DRIVER: Raw copy from user buffer failed.\n");
-    return -1;
-  }
-
-  // Program the peripheral registers.
-
-  iowrite32(message.numDBEntries, (volatile void*)(&slave_regs->numDBEntries));
-  iowrite32(message.numSeqsSpecimen, (volatile void*)(&slave_regs->numSeqsSpecimen));
-  iowrite32(message.seqsDB, (volatile void*)(&slave_regs->seqsDB));
-  iowrite32(message.seqsSpecimen, (volatile void*)(&slave_regs->seqsSpecimen));
-  iowrite32(message.lengthsDB, (volatile void*)(&slave_regs->lengthsDB));
-  iowrite32(message.lengthsSpecimen, (volatile void*)(&slave_regs->lengthsSpecimen));
-  iowrite32(message.scores, (volatile void*)(&slave_regs->scores));
+  iowrite32(message->numDBEntries, (volatile void*)(&slave_regs->numDBEntries));
+  iowrite32(message->numSeqsSpecimen, (volatile void*)(&slave_regs->numSeqsSpecimen));
+  iowrite32(message->seqsDB, (volatile void*)(&slave_regs->seqsDB));
+  iowrite32(message->seqsSpecimen, (volatile void*)(&slave_regs->seqsSpecimen));
+  iowrite32(message->lengthsDB, (volatile void*)(&slave_regs->lengthsDB));
+  iowrite32(message->lengthsSpecimen, (volatile void*)(&slave_regs->lengthsSpecimen));
+  iowrite32(message->scores, (volatile void*)(&slave_regs->scores));
+  iowrite32(message->masksDB, (volatile void*)(&slave_regs->masksDB));
+  iowrite32(message->masksSpecimen, (volatile void*)(&slave_regs->masksSpecimen));
+  iowrite32(message->ambiguousMode, (volatile void*)(&slave_regs->ambiguousMode));
   
   // Enable interrupts (global and spacific to done).
   iowrite32(1, (volatile void*)(&slave_regs->gier));
@@ -170,43 +395,638 @@ ssize_t seq_matcher_read(struct file *filed_mem, char __user *buf, size_t count,
   
   // Tell the peripheral to start (start bit = 1)
   status = ioread32((volatile void*)(&slave_regs->control));
-  status |= 1; 
+  status |= AP_START; 
   iowrite32(status, (volatile void*)(&slave_regs->control));
   mb();
+  job->startTime = ktime_get();
+  job->irqTime = 0;
 
-  // blocking read (PS user application goes to sleep)
-  // Sleep the thread until the peripheral generates an interrupt
-  // wait_event_interruptible may exit when a signal is received, so
-  // we check our flag to ensure that it was our own interrupt handler
-  // waking up us after the interrupt is received, and not an 
-  // spurious signal.
-  // When we go to sleep, the processor is free for other tasks.
-  flag = 0;
-  while(wait_event_interruptible(wq, flag !=0)) {
-    printk(KERN_ALERT "SEQ_MATCHER_DRIVER: AWOKEN BY ANOTHER SIGNAL\n");
+  // Arm the time limit of the job
+  if (job->timeoutMs > 0) {
+    runningDeadline = jiffies + msecs_to_jiffies(job->timeoutMs);
+    mod_delayed_work(system_wq, &jobTimeoutWork, msecs_to_jiffies(job->timeoutMs));
   }
-  pr_info("SEQ_MATCHER_DRIVER: AWOKEN FROM INTERRUPT\n");
+}
 
-  uint32_t numComparisons = ioread32((volatile void*)(&slave_regs->returnValue));
+// Resets the PL, which stops the accelerator and clears its registers. A job in the middle of its AXI bursts is
+// cut short, so this is only used to recover from a hung or cancelled job.
+static void seq_matcher_reset(void)
+{
+  void __iomem * slcr = seq_matcher_mem.slcrAddr;
+
+  pr_warn("SEQ_MATCHER_DRIVER: Resetting the accelerator.\n");
+  iowrite32(SLCR_UNLOCK_KEY, slcr + SLCR_UNLOCK);
+  iowrite32(ioread32(slcr + SLCR_FPGA_RST_CTRL) | FPGA0_OUT_RST, slcr + SLCR_FPGA_RST_CTRL);
+  mb();
+  udelay(1);
+  iowrite32(ioread32(slcr + SLCR_FPGA_RST_CTRL) & ~FPGA0_OUT_RST, slcr + SLCR_FPGA_RST_CTRL);
+  iowrite32(SLCR_LOCK_KEY, slcr + SLCR_LOCK);
   mb();
+}
 
-  // Copy the result to user
-  if(raw_copy_to_user((void*)message.numComparisonsPtr, &numComparisons, sizeof(uint32_t)))
-  {
-    pr_err("SEQ_MATCHER_DRIVER: Raw copy to user buffer failed.\n");
-    return -1;
-  }
+// Reads the result of a finished job and disables the interrupts.
+static uint32_t seq_matcher_finish(void)
+{
+  volatile struct TRegs * slave_regs = (struct TRegs*)seq_matcher_mem.baseAddr;
+  uint32_t numComparisons = ioread32((volatile void*)(&slave_regs->returnValue));
+  mb();
 
   // Disable interrupts.
   iowrite32(0, (volatile void*)&slave_regs->gier);
   iowrite32(0, (volatile void*)&slave_regs->ier);
   mb();
 
-  pr_info("SEQ_MATCHER_DRIVER: Performed READ operation successfully\n");
+  return numComparisons;
+}
+
+// Queues the job of a file, and starts it if the accelerator is idle. Returns -EBUSY if the file already has a
+// job in flight.
+static int seq_matcher_submit(struct seq_matcher_file * context, struct job_registers * message, uint32_t timeoutMs)
+{
+  spin_lock(&queueLock);
+  if (context->submitted) {
+    spin_unlock(&queueLock);
+    return -EBUSY;
+  }
+
+  context->submitted = 1;
+  context->job.regs = *message;
+  context->job.done = 0;
+  context->job.status = 0;
+  context->job.timeoutMs = timeoutMs;
+  ++ stats.jobsSubmitted;
+
+  if (runningJob == NULL) {
+    runningJob = &context->job;
+    seq_matcher_start(&context->job);
+  }
+  else {
+    list_add_tail(&context->job.node, &jobQueue);
+    if (++ stats.queueDepth > stats.maxQueueDepth)
+      stats.maxQueueDepth = stats.queueDepth;
+  }
+  spin_unlock(&queueLock);
+
   return 0;
 }
 
+// Marks the running job as done with the given status, wakes its owner and starts the next job of the queue.
+// Called with queueLock held.
+static void seq_matcher_next(int status)
+{
+  struct seq_matcher_job * job = runningJob;
+  struct seq_matcher_file * context = container_of(job, struct seq_matcher_file, job);
+
+  cancel_delayed_work(&jobTimeoutWork);
+  job->status = status;
+  job->done = 1;
+
+  stats.lastBusyTimeNs = ktime_to_ns(ktime_sub(ktime_get(), job->startTime));
+  stats.busyTimeNs += stats.lastBusyTimeNs;
+  if (status == 0) {
+    ++ stats.jobsCompleted;
+    stats.comparisons += job->numComparisons;
+  }
+  else
+    ++ stats.jobsFailed;
+
+  runningJob = list_first_entry_or_null(&jobQueue, struct seq_matcher_job, node);
+  if (runningJob != NULL) {
+    list_del(&runningJob->node);
+    -- stats.queueDepth;
+    seq_matcher_start(runningJob);
+  }
+
+  // Wake the owner of the finished job. It is done with the lock held, so that release() cannot free the
+  // context in between.
+  wake_up(&context->wq);
+}
+
+// Stops the running job by resetting the accelerator, and fails it with the given status.
+// Called with queueLock held.
+static void seq_matcher_abort(int status)
+{
+  seq_matcher_reset();
+  runningJob->numComparisons = 0;
+  seq_matcher_next(status);
+}
+
+// Completes the running job and starts the next one of the queue, so that the accelerator runs the jobs of
+// all the files back to back. Called with queueLock held, after the interrupt or by a busy-polling read().
+// A job can be completed by polling before its interrupt is handled, so the running job is only completed if the
+// accelerator is idle: the late interrupt then finds the next job still running (or none), and does nothing.
+// irqTime is the time of the interrupt, or 0 when polling.
+static void seq_matcher_complete(ktime_t irqTime)
+{
+  volatile struct TRegs * slave_regs = (struct TRegs*)seq_matcher_mem.baseAddr;
+  struct seq_matcher_job * job = runningJob;
+
+  if ((job == NULL) || !(ioread32((volatile void*)(&slave_regs->control)) & AP_IDLE))
+    return;
+
+  // An interrupt older than the job is the late interrupt of a polled job
+  job->irqTime = ktime_after(irqTime, job->startTime) ? irqTime : 0;
+  job->numComparisons = seq_matcher_finish();
+  seq_matcher_next(0);
+}
+
+// Runs in process context, scheduled by the interrupt handler.
+static void seq_matcher_job_done(struct work_struct *work)
+{
+  ktime_t irqTime = ns_to_ktime(atomic64_xchg(&irqTimestamp, 0));
+
+  spin_lock(&queueLock);
+  seq_matcher_complete(irqTime);
+  spin_unlock(&queueLock);
+}
+
+static void seq_matcher_job_timeout(struct work_struct *work)
+{
+  spin_lock(&queueLock);
+  // The job may have finished (and another one started) while this work was pending
+  if ((runningJob != NULL) && (runningJob->timeoutMs > 0) && time_after_eq(jiffies, runningDeadline)) {
+    pr_err("SEQ_MATCHER_DRIVER: Job timed out after %u ms.\n", runningJob->timeoutMs);
+    seq_matcher_abort(-ETIMEDOUT);
+  }
+  spin_unlock(&queueLock);
+}
+
+// Cancels the job of a file. A queued job is removed from the queue, and a running one is aborted.
+static long seq_matcher_cancel(struct seq_matcher_file * context)
+{
+  long result = 0;
+
+  spin_lock(&queueLock);
+  if (!context->submitted || context->job.done)
+    result = -EINVAL;
+  else if (runningJob == &context->job)
+    seq_matcher_abort(-ECANCELED);
+  else {
+    list_del(&context->job.node);
+    -- stats.queueDepth;
+    ++ stats.jobsFailed;
+    context->job.numComparisons = 0;
+    context->job.status = -ECANCELED;
+    context->job.done = 1;
+    wake_up(&context->wq);
+  }
+  spin_unlock(&queueLock);
+
+  return result;
+}
+
+// Polls the idle bit of the accelerator while the job of the file runs, for up to the busy-poll window of the
+// file. If the job finishes in the window, it is completed at once, without waiting for the interrupt.
+static void seq_matcher_busy_poll(struct seq_matcher_file * context)
+{
+  volatile struct TRegs * slave_regs = (struct TRegs*)seq_matcher_mem.baseAddr;
+  ktime_t deadline = ktime_add_us(ktime_get(), context->pollWindowUs);
+
+  while (!READ_ONCE(context->job.done) && ktime_before(ktime_get(), deadline)) {
+    if ((READ_ONCE(runningJob) == &context->job) && (ioread32((volatile void*)(&slave_regs->control)) & AP_IDLE)) {
+      spin_lock(&queueLock);
+      seq_matcher_complete(0);
+      spin_unlock(&queueLock);
+      break;
+    }
+    cpu_relax();
+  }
+}
+
+// Adds the time from the interrupt of a job until its owner collects it to the latency histogram.
+static void seq_matcher_record_latency(ktime_t latency)
+{
+  int bucket = fls64(ktime_to_us(latency));
+
+  if (bucket >= IRQ_LATENCY_BUCKETS)
+    bucket = IRQ_LATENCY_BUCKETS - 1;
+  spin_lock(&queueLock);
+  ++ stats.irqLatency[bucket];
+  spin_unlock(&queueLock);
+}
+
+// Function that implements system call read() for our driver: collects the job submitted with
+// SEQ_MATCHER_IOC_SUBMIT. It sleeps until the job finishes (or returns -EAGAIN at once if the file is
+// non-blocking) and returns its number of comparisons (one uint32_t).
+ssize_t seq_matcher_read(struct file *filed_mem, char __user *buf, size_t count, loff_t *f_pos)
+{
+  struct seq_matcher_file * context = filed_mem->private_data;
+  uint32_t numComparisons;
+
+  if (count != sizeof(uint32_t))
+    return -EINVAL;
+  if (!context->submitted)
+    return -EINVAL;
+  if (!context->job.done && (filed_mem->f_flags & O_NONBLOCK))
+    return -EAGAIN;
+  if (!context->job.done && (context->pollWindowUs > 0))
+    seq_matcher_busy_poll(context);
+
+  // wait_event_interruptible may exit when a signal is received, so we return and let the user retry.
+  // When we go to sleep, the processor is free for other tasks.
+  if (wait_event_interruptible(context->wq, context->job.done))
+    return -ERESTARTSYS;
+
+  numComparisons = context->job.numComparisons;
+  context->submitted = 0;
+  if (context->job.irqTime != 0)
+    seq_matcher_record_latency(ktime_sub(ktime_get(), context->job.irqTime));
+
+  // Failed jobs (timed out or cancelled) return their error
+  if (context->job.status != 0)
+    return context->job.status;
+
+  if (copy_to_user(buf, &numComparisons, sizeof(uint32_t)))
+    return -EFAULT;
+  return sizeof(uint32_t);
+}
+
+// Function that implements system call poll() for our driver: readable when the job of the file has finished,
+// writable when the file can submit a new job.
+unsigned int seq_matcher_poll(struct file *filp, poll_table *wait)
+{
+  struct seq_matcher_file * context = filp->private_data;
+  unsigned int mask = 0;
+
+  poll_wait(filp, &context->wq, wait);
+  if (context->submitted && context->job.done)
+    mask |= POLLIN | POLLRDNORM;
+  if (!context->submitted)
+    mask |= POLLOUT | POLLWRNORM;
+
+  return mask;
+}
+
+// Buffer of a file with the given handle, or NULL. Called with buffersLock held.
+static struct seq_matcher_buffer * seq_matcher_find_buffer(struct seq_matcher_file * context, uint32_t handle)
+{
+  struct seq_matcher_buffer * buffer;
+
+  list_for_each_entry(buffer, &context->buffers, node)
+    if (buffer->handle == handle)
+      return buffer;
+
+  return NULL;
+}
+
+// Translates a position in a buffer of the file to a physical address, checking that the size bytes that the
+// accelerator accesses from it are inside the buffer. Returns 0 if they are not.
+static uint32_t seq_matcher_translate(struct seq_matcher_file * context, struct buffer_ref * ref, size_t size)
+{
+  struct seq_matcher_buffer * buffer = seq_matcher_find_buffer(context, ref->handle);
+  size_t end;
+
+  if ((buffer == NULL) || (ref->offset >= buffer->size) || check_add_overflow((size_t)ref->offset, size, &end) ||
+      (end > buffer->size))
+    return 0;
+
+  return (uint32_t)buffer->dmaAddr + ref->offset;
+}
+
+// Cache maintenance of a range of a cacheable buffer. It does nothing on a non-cacheable (coherent) buffer.
+static long seq_matcher_ioctl_cache(struct seq_matcher_file * context, unsigned int cmd, unsigned long arg)
+{
+  struct cache_message message;
+  struct seq_matcher_buffer * buffer;
+
+  if (copy_from_user(&message, (void __user *)arg, sizeof(struct cache_message))) {
+    pr_err("SEQ_MATCHER_DRIVER: Copy of the cache message from user failed.\n");
+    return -EFAULT;
+  }
+
+  mutex_lock(&context->buffersLock);
+  buffer = seq_matcher_find_buffer(context, message.handle);
+  if ((buffer == NULL) || (message.size == 0) || (message.offset > buffer->size) ||
+      (message.size > buffer->size - message.offset)) {
+    mutex_unlock(&context->buffersLock);
+    return -EINVAL;
+  }
+
+  // The buffer cannot be freed while it is synchronized
+  if (buffer->cacheable && (cmd == SEQ_MATCHER_IOC_FLUSH))
+    dma_sync_single_for_device(seq_matcher_mem.device, buffer->dmaAddr + message.offset, message.size,
+                               DMA_TO_DEVICE);
+  else if (buffer->cacheable)
+    dma_sync_single_for_cpu(seq_matcher_mem.device, buffer->dmaAddr + message.offset, message.size,
+                            DMA_FROM_DEVICE);
+  mutex_unlock(&context->buffersLock);
+
+  return 0;
+}
+
+// Allocates the memory of a buffer. A cacheable buffer needs contiguous pages larger than the page allocator gives,
+// so they are reserved from CMA with DMA_ATTR_NO_KERNEL_MAPPING, which leaves their kernel (linear) mapping
+// cached, and mapped for streaming DMA.
+static int seq_matcher_alloc_buffer(struct seq_matcher_buffer * buffer)
+{
+  struct device * device = seq_matcher_mem.device;
+
+  if (!buffer->cacheable) {
+    buffer->kernelAddr = dma_alloc_coherent(device, buffer->size, &buffer->allocAddr, GFP_KERNEL);
+    buffer->dmaAddr = buffer->allocAddr;
+    return buffer->kernelAddr ? 0 : -ENOMEM;
+  }
+
+  buffer->kernelAddr = dma_alloc_attrs(device, buffer->size, &buffer->allocAddr, GFP_KERNEL,
+                                       DMA_ATTR_NO_KERNEL_MAPPING);
+  if (!buffer->kernelAddr)
+    return -ENOMEM;
+  buffer->pages = pfn_to_page(dma_to_pfn(device, buffer->allocAddr));
+  buffer->dmaAddr = dma_map_page(device, buffer->pages, 0, buffer->size, DMA_BIDIRECTIONAL);
+  if (dma_mapping_error(device, buffer->dmaAddr)) {
+    dma_free_attrs(device, buffer->size, buffer->kernelAddr, buffer->allocAddr, DMA_ATTR_NO_KERNEL_MAPPING);
+    return -ENOMEM;
+  }
+
+  return 0;
+}
+
+// Frees a buffer that is no longer in the list of its file, nor mapped.
+static void seq_matcher_free_buffer(struct seq_matcher_buffer * buffer)
+{
+  struct device * device = seq_matcher_mem.device;
+
+  if (buffer->cacheable) {
+    dma_unmap_page(device, buffer->dmaAddr, buffer->size, DMA_BIDIRECTIONAL);
+    dma_free_attrs(device, buffer->size, buffer->kernelAddr, buffer->allocAddr, DMA_ATTR_NO_KERNEL_MAPPING);
+  }
+  else
+    dma_free_coherent(device, buffer->size, buffer->kernelAddr, buffer->allocAddr);
+  kfree(buffer);
+}
+
+// Allocates a physically contiguous DMA buffer (from CMA) for the file.
+static long seq_matcher_ioctl_alloc(struct seq_matcher_file * context, unsigned long arg)
+{
+  struct alloc_message message;
+  struct seq_matcher_buffer * buffer;
+
+  if (copy_from_user(&message, (void __user *)arg, sizeof(struct alloc_message)))
+    return -EFAULT;
+  if (message.size == 0)
+    return -EINVAL;
+
+  buffer = kzalloc(sizeof(struct seq_matcher_buffer), GFP_KERNEL);
+  if (!buffer)
+    return -ENOMEM;
+
+  buffer->size = PAGE_ALIGN(message.size);
+  buffer->cacheable = (message.cacheable != 0);
+  atomic_set(&buffer->mapCount, 0);
+  if (seq_matcher_alloc_buffer(buffer) != 0) {
+    pr_err("SEQ_MATCHER_DRIVER: Allocation of a DMA buffer of %u bytes failed.\n", message.size);
+    kfree(buffer);
+    return -ENOMEM;
+  }
+
+  mutex_lock(&context->buffersLock);
+  if (context->nextHandle > MAX_BUFFER_HANDLE) {
+    mutex_unlock(&context->buffersLock);
+    seq_matcher_free_buffer(buffer);
+    return -ENOSPC;
+  }
+  buffer->handle = context->nextHandle ++;
+  list_add_tail(&buffer->node, &context->buffers);
+  mutex_unlock(&context->buffersLock);
+
+  message.handle = buffer->handle;
+  message.mmapOffset = buffer->handle << PAGE_SHIFT;
+  if (copy_to_user((void __user *)arg, &message, sizeof(struct alloc_message)))
+    return -EFAULT;   // The buffer is freed with the file
+
+  return 0;
+}
+
+static long seq_matcher_ioctl_free(struct seq_matcher_file * context, unsigned long arg)
+{
+  struct seq_matcher_buffer * buffer;
+  uint32_t handle;
+
+  if (copy_from_user(&handle, (void __user *)arg, sizeof(uint32_t)))
+    return -EFAULT;
+
+  mutex_lock(&context->buffersLock);
+  buffer = seq_matcher_find_buffer(context, handle);
+  if (buffer == NULL) {
+    mutex_unlock(&context->buffersLock);
+    return -EINVAL;
+  }
+  // The accelerator or the process may still access it
+  if (context->submitted || (atomic_read(&buffer->mapCount) > 0)) {
+    mutex_unlock(&context->buffersLock);
+    return -EBUSY;
+  }
+  list_del(&buffer->node);
+  mutex_unlock(&context->buffersLock);
+
+  seq_matcher_free_buffer(buffer);
+  return 0;
+}
+
+// Default time limit of a job of numComparisons comparisons (see job_timeout_ms).
+static uint32_t seq_matcher_default_timeout(uint64_t numComparisons)
+{
+  uint64_t timeoutMs = job_timeout_ms;
+
+  if (timeoutMs == 0)
+    return 0;
+  if (job_timeout_cmp_per_ms > 0)
+    timeoutMs += div_u64(numComparisons, job_timeout_cmp_per_ms);
+
+  return (uint32_t)min_t(uint64_t, timeoutMs, UINT_MAX);
+}
+
+// Translates the buffers of a job to physical addresses and queues it. The job fails with -EINVAL unless every array
+// it reads or writes fits in its buffer.
+static long seq_matcher_ioctl_submit(struct seq_matcher_file * context, unsigned long arg)
+{
+  struct job_message message;
+  struct job_registers regs;
+  size_t seqSize;
+  long result;
+
+  if (copy_from_user(&message, (void __user *)arg, sizeof(struct job_message))) {
+    pr_err("SEQ_MATCHER_DRIVER: Copy of the job from user failed.\n");
+    return -EFAULT;
+  }
+
+  // Extent of every array of the job. array_size() saturates on overflow, so that a job too large for the address
+  // space fails the checks of seq_matcher_translate().
+  seqSize = SEQ_WORD_SIZE * (protein_mode ? PROTEIN_WORDS_PER_SEQ : 1);
+
+  mutex_lock(&context->buffersLock);
+  regs.numDBEntries = message.numDBEntries;
+  regs.numSeqsSpecimen = message.numSeqsSpecimen;
+  regs.seqsDB = seq_matcher_translate(context, &message.seqsDB, array_size(message.numDBEntries, seqSize));
+  regs.seqsSpecimen = seq_matcher_translate(context, &message.seqsSpecimen,
+                                            array_size(message.numSeqsSpecimen, seqSize));
+  regs.lengthsDB = seq_matcher_translate(context, &message.lengthsDB, array_size(message.numDBEntries, LENGTH_SIZE));
+  regs.lengthsSpecimen = seq_matcher_translate(context, &message.lengthsSpecimen,
+                                               array_size(message.numSeqsSpecimen, LENGTH_SIZE));
+  regs.scores = seq_matcher_translate(context, &message.scores,
+                                      array3_size(message.numDBEntries, message.numSeqsSpecimen, SCORE_SIZE));
+  regs.masksDB = (message.ambiguousMode != 0) ?
+    seq_matcher_translate(context, &message.masksDB, array_size(message.numDBEntries, MASK_SIZE)) : 0;
+  regs.masksSpecimen = (message.ambiguousMode != 0) ?
+    seq_matcher_translate(context, &message.masksSpecimen, array_size(message.numSeqsSpecimen, MASK_SIZE)) : 0;
+  regs.ambiguousMode = message.ambiguousMode;
+
+  if ((regs.seqsDB == 0) || (regs.seqsSpecimen == 0) || (regs.lengthsDB == 0) || (regs.lengthsSpecimen == 0) ||
+      (regs.scores == 0) || ((message.ambiguousMode != 0) && ((regs.masksDB == 0) || (regs.masksSpecimen == 0))))
+    result = -EINVAL;
+  else
+    result = seq_matcher_submit(context, &regs, (message.timeoutMs > 0) ? message.timeoutMs :
+      seq_matcher_default_timeout((uint64_t)message.numDBEntries * message.numSeqsSpecimen));
+  mutex_unlock(&context->buffersLock);
+
+  return result;
+}
+
+// Function that implements system call ioctl() for our driver: management of the DMA buffers, cache maintenance
+// and submission of jobs.
+long seq_matcher_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+  struct seq_matcher_file * context = filp->private_data;
+
+  switch (cmd) {
+    case SEQ_MATCHER_IOC_FLUSH:
+    case SEQ_MATCHER_IOC_INVALIDATE:
+      return seq_matcher_ioctl_cache(context, cmd, arg);
+    case SEQ_MATCHER_IOC_ALLOC:
+      return seq_matcher_ioctl_alloc(context, arg);
+    case SEQ_MATCHER_IOC_FREE:
+      return seq_matcher_ioctl_free(context, arg);
+    case SEQ_MATCHER_IOC_SUBMIT:
+      return seq_matcher_ioctl_submit(context, arg);
+    case SEQ_MATCHER_IOC_CANCEL:
+      return seq_matcher_cancel(context);
+    case SEQ_MATCHER_IOC_SET_POLL_WINDOW:
+      return get_user(context->pollWindowUs, (uint32_t __user *)arg);
+    default:
+      return -ENOTTY;
+  }
+}
+
+// The mappings of a buffer are counted, so that it is not freed while the process can access it.
+static void seq_matcher_vma_open(struct vm_area_struct *vma)
+{
+  struct seq_matcher_buffer * buffer = vma->vm_private_data;
+  atomic_inc(&buffer->mapCount);
+}
+
+static void seq_matcher_vma_close(struct vm_area_struct *vma)
+{
+  struct seq_matcher_buffer * buffer = vma->vm_private_data;
+  atomic_dec(&buffer->mapCount);
+}
+
+static const struct vm_operations_struct seq_matcher_vm_ops = {
+  .open =     seq_matcher_vma_open,
+  .close =    seq_matcher_vma_close,
+};
+
+// Function that implements system call mmap() for our driver: maps a whole DMA buffer of the file. The offset
+// selects the buffer (alloc_message.mmapOffset).
+int seq_matcher_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+  struct seq_matcher_file * context = filp->private_data;
+  struct seq_matcher_buffer * buffer;
+  unsigned long size = vma->vm_end - vma->vm_start;
+  int result;
+
+  mutex_lock(&context->buffersLock);
+  buffer = seq_matcher_find_buffer(context, vma->vm_pgoff);
+  if ((buffer == NULL) || (size > buffer->size)) {
+    mutex_unlock(&context->buffersLock);
+    return -EINVAL;
+  }
+
+  // The offset only selects the buffer, which is mapped from its start. The pages of a cacheable buffer are mapped
+  // cached, like their kernel mapping.
+  vma->vm_pgoff = 0;
+  if (buffer->cacheable)
+    result = remap_pfn_range(vma, vma->vm_start, page_to_pfn(buffer->pages), size, vma->vm_page_prot);
+  else
+    result = dma_mmap_coherent(seq_matcher_mem.device, vma, buffer->kernelAddr, buffer->allocAddr, buffer->size);
+
+  if (result == 0) {
+    vma->vm_private_data = buffer;
+    vma->vm_ops = &seq_matcher_vm_ops;
+    atomic_inc(&buffer->mapCount);
+  }
+  mutex_unlock(&context->buffersLock);
+
+  return result;
+}
+
 // Set up the char_dev structure for this device.
+// Attributes of the device in sysfs, with the statistics of the accelerator.
+#define SEQ_MATCHER_STAT_ATTR(name, field) \
+static ssize_t name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+{ \
+  u64 value; \
+  spin_lock(&queueLock); \
+  value = stats.field; \
+  spin_unlock(&queueLock); \
+  return sprintf(buf, "%llu\n", value); \
+} \
+static DEVICE_ATTR_RO(name)
+
+SEQ_MATCHER_STAT_ATTR(jobs_submitted, jobsSubmitted);
+SEQ_MATCHER_STAT_ATTR(jobs_completed, jobsCompleted);
+SEQ_MATCHER_STAT_ATTR(jobs_failed, jobsFailed);
+SEQ_MATCHER_STAT_ATTR(busy_time_ns, busyTimeNs);
+SEQ_MATCHER_STAT_ATTR(last_busy_time_ns, lastBusyTimeNs);
+SEQ_MATCHER_STAT_ATTR(comparisons, comparisons);
+SEQ_MATCHER_STAT_ATTR(queue_depth, queueDepth);
+SEQ_MATCHER_STAT_ATTR(max_queue_depth, maxQueueDepth);
+
+// One line per bucket: the upper bound of the bucket in us, and its count
+static ssize_t irq_latency_histogram_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+  u64 counts[IRQ_LATENCY_BUCKETS];
+  ssize_t length = 0;
+  int iBucket;
+
+  spin_lock(&queueLock);
+  memcpy(counts, stats.irqLatency, sizeof(counts));
+  spin_unlock(&queueLock);
+
+  for (iBucket = 0; iBucket < IRQ_LATENCY_BUCKETS - 1; ++ iBucket)
+    length += scnprintf(buf + length, PAGE_SIZE - length, "<%u %llu\n", 1U << iBucket, counts[iBucket]);
+  length += scnprintf(buf + length, PAGE_SIZE - length, ">=%u %llu\n", 1U << (IRQ_LATENCY_BUCKETS - 2),
+                      counts[IRQ_LATENCY_BUCKETS - 1]);
+  return length;
+}
+static DEVICE_ATTR_RO(irq_latency_histogram);
+
+// Writing anything clears the counters. The depth of the queue is kept, since it counts the jobs still queued.
+static ssize_t stats_reset_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  spin_lock(&queueLock);
+  memset(&stats, 0, offsetof(struct seq_matcher_stats, queueDepth));
+  stats.maxQueueDepth = stats.queueDepth;
+  memset(stats.irqLatency, 0, sizeof(stats.irqLatency));
+  spin_unlock(&queueLock);
+  return count;
+}
+static DEVICE_ATTR_WO(stats_reset);
+
+static struct attribute *seq_matcher_attrs[] = {
+  &dev_attr_jobs_submitted.attr,
+  &dev_attr_jobs_completed.attr,
+  &dev_attr_jobs_failed.attr,
+  &dev_attr_busy_time_ns.attr,
+  &dev_attr_last_busy_time_ns.attr,
+  &dev_attr_comparisons.attr,
+  &dev_attr_queue_depth.attr,
+  &dev_attr_max_queue_depth.attr,
+  &dev_attr_irq_latency_histogram.attr,
+  &dev_attr_stats_reset.attr,
+  NULL,
+};
+ATTRIBUTE_GROUPS(seq_matcher);
+
 static void seq_matcher_setup_cdev(struct seq_matcher_info *_seq_matcher_mem)
 {
 	int err, devno = MKDEV(seq_matcher_major, seq_matcher_minor);
@@ -257,13 +1077,22 @@ static int seq_matcher_init(void)
     return -1;
   }
 
-  init_waitqueue_head(&wq);
+  // The SLCR is shared with the clock and reset drivers of the kernel, so it is mapped without requesting it.
+  seq_matcher_mem.slcrAddr = ioremap(SLCR_BASE, PAGE_SIZE);
+  if (!seq_matcher_mem.slcrAddr) {
+    pr_err("SEQ_MATCHER_DRIVER: Could not map the SLCR.\n");
+    iounmap(seq_matcher_mem.baseAddr);
+    release_mem_region(seq_matcher_mem.memStart, seq_matcher_mem.memEnd - seq_matcher_mem.memStart + 1);
+    unregister_chrdev_region(dev, 1);
+    return -1;
+  }
 
   // Request registering our interrupt handler for the IRQ of the peripheral.
   // We configure the interrupt to be detected on the rising edge of the signal.
   result = request_irq(seq_matcher_mem.irq, (irq_handler_t)seq_matcherIRQHandler, IRQF_TRIGGER_RISING, DRIVER_NAME, &seq_matcher_mem);
   if(result) {
     printk(KERN_ALERT "SEQ_MATCHER_DRIVER: Failed to register interrupt handler (error=%d)\n", result);     
+    iounmap(seq_matcher_mem.slcrAddr);
     iounmap(seq_matcher_mem.baseAddr);
     release_mem_region(seq_matcher_mem.memStart, seq_matcher_mem.memEnd - seq_matcher_mem.memStart + 1);
     cdev_del(&seq_matcher_mem.cdev);
@@ -279,6 +1108,27 @@ static int seq_matcher_init(void)
     (uint32_t)seq_matcher_mem.memStart, (uint32_t)seq_matcher_mem.baseAddr); 
   seq_matcher_setup_cdev(&seq_matcher_mem);
 
+  // The device owns the DMA buffers of the users. It also creates /dev/seq_matcher0 with udev, and exports the
+  // statistics in sysfs.
+  seq_matcher_mem.class = class_create(THIS_MODULE, "seq_matcher");
+  if (IS_ERR(seq_matcher_mem.class)) {
+    pr_err("SEQ_MATCHER_DRIVER: Could not create the device class.\n");
+    result = PTR_ERR(seq_matcher_mem.class);
+    seq_matcher_mem.class = NULL;
+    seq_matcher_cleanup_module();
+    return result;
+  }
+  seq_matcher_mem.device = device_create_with_groups(seq_matcher_mem.class, NULL, dev, NULL, seq_matcher_groups,
+                                                    "seq_matcher0");
+  if (IS_ERR(seq_matcher_mem.device)) {
+    pr_err("SEQ_MATCHER_DRIVER: Could not create the device.\n");
+    result = PTR_ERR(seq_matcher_mem.device);
+    seq_matcher_mem.device = NULL;
+    seq_matcher_cleanup_module();
+    return result;
+  }
+  dma_coerce_mask_and_coherent(seq_matcher_mem.device, DMA_BIT_MASK(32));
+
   return 0;
 }
 
@@ -311,11 +1161,10 @@ static irq_handler_t seq_matcherIRQHandler(unsigned int irq, void *dev_id, struc
   // 'done' bit to toggle it, so that it becomes 0 and the interrupt is disarmed.
   iowrite32(1, (volatile void*)&slave_regs->isr);
   mb();
+  atomic64_set(&irqTimestamp, ktime_to_ns(ktime_get()));
 
-  // Signal that it is us waking the main thread.
-	flag = 1;
-  // Wake the main thread.
-	wake_up_interruptible(&wq);
+  // Complete the job, and start the next one, out of the interrupt context.
+  schedule_work(&jobDoneWork);
 	return (irq_handler_t) IRQ_HANDLED;      // Announce that the IRQ has been handled correctly
   // In case of error, or if it was not our device which generated the IRQ, return IRQ_NONE.
 }
@@ -2,12 +2,34 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <map>
+#include <iterator>
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
 #include "CAccelDriver.hpp"
-extern "C" {
-#include <libxlnk_cma.h>  // Required for memory-mapping functions from Xilinx
-}
+#include "trace.hpp"
+
+// Buffer management and cache maintenance requests of the kernel module (see seq_matcher.c)
+struct alloc_message {
+  uint32_t size;
+  uint32_t cacheable;
+  uint32_t handle;
+  uint32_t mmapOffset;
+};
+
+struct cache_message {
+  uint32_t handle;
+  uint32_t offset;
+  uint32_t size;
+};
+
+#define SEQ_MATCHER_IOC_MAGIC 'q'
+#define SEQ_MATCHER_IOC_FLUSH _IOW(SEQ_MATCHER_IOC_MAGIC, 1, struct cache_message)
+#define SEQ_MATCHER_IOC_INVALIDATE _IOW(SEQ_MATCHER_IOC_MAGIC, 2, struct cache_message)
+#define SEQ_MATCHER_IOC_ALLOC _IOWR(SEQ_MATCHER_IOC_MAGIC, 3, struct alloc_message)
+#define SEQ_MATCHER_IOC_FREE _IOW(SEQ_MATCHER_IOC_MAGIC, 4, uint32_t)
 
 ///////////////////////////////////////////////////////////////////////////////
 //////////////////////////// CAccelDriver() ///////////////////////////////////
@@ -30,15 +52,32 @@ CAccelDriver::~CAccelDriver()
   if (logging)
     printf("CAccelDriver::~CAccelDriver()\n");
 
+  InternalRelease();
+
   if (driver != 0) {
-    // Unmap the physical address of the peripheral registers
     close(driver);
   }
   driver = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// InternalRelease() /////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+void CAccelDriver::InternalRelease()
+{
+  if (arena != NULL) {
+    if (!arenaAllocs.empty())
+      printf("%u BLOCKS OF THE DMA ARENA WERE NOT FREED. PLEASE, FIX THIS ISSUE.\n", (uint32_t)arenaAllocs.size());
+    arenaAllocs.clear();
+    DestroyDMAArena();
+  }
 
   // DMA memory is a system-wide resource. If the user forgets to free the allocated
   // blocks, the memory is lost and the system will eventually require a reboot. To 
   // prevent this, let's ensure all the DMA allocations have been freed.
+  // The buffers belong to the open device, so this is done before closing it.
   InternalEmptyDMAAllocs();
 }
 
@@ -49,6 +88,8 @@ CAccelDriver::~CAccelDriver()
 
 uint32_t CAccelDriver::Open(const char * driver_name, volatile void ** AccelRegsPointer)
 {
+  TRACE_SCOPE("Open device");
+
   if (logging)
     printf("CAccelDriver::Open(driver_name = %s)\n", driver_name);
 
@@ -72,37 +113,79 @@ uint32_t CAccelDriver::Open(const char * driver_name, volatile void ** AccelRegs
 
 void * CAccelDriver::AllocDMACompatible(uint32_t Size, uint32_t Cacheable)
 {
+  TRACE_SCOPE("Allocate DMA buffer");
   void * virtualAddr = NULL;
-  uint32_t physicalAddr = 0;
 
   if (logging)
     printf("CAccelDriver::AllocDMACompatible(Size = %u, Cacheable = %u)\n", Size, Cacheable);
 
-  virtualAddr = cma_alloc(Size, Cacheable);
-  if ( (int32_t)virtualAddr == -1) {
+  // When the arena is full, the block is allocated on its own.
+  if ((arena != NULL) && (Cacheable == arenaCacheable)) {
+    virtualAddr = InternalArenaAlloc(Size);
+    if (virtualAddr != NULL)
+      return virtualAddr;
     if (logging)
-      printf("Error allocating DMA memory for %u bytes.\n", Size);
-    return NULL;
+      printf("Not enough free space in the DMA arena for %u bytes.\n", Size);
   }
 
-  physicalAddr = cma_get_phy_addr(virtualAddr);
-  if (physicalAddr == 0) {
+  if (driver == 0) {
     if (logging)
-      printf("Error obtaining physical addr for virtual address 0x%08X (%u).\n", (uint32_t)virtualAddr, (uint32_t)virtualAddr);
-    cma_free(virtualAddr);
+      printf("Error: Allocating DMA memory on a non-initialized accelerator.\n");
     return NULL;
   }
 
-  dmaMappings[(uint32_t)virtualAddr] = physicalAddr;
+  TDMAMapping mapping;
+  if ( (virtualAddr = InternalMapBuffer(Size, Cacheable, mapping)) == NULL )
+    return NULL;
+
+  dmaMappings[(uintptr_t)virtualAddr] = mapping;
 
   if (logging)
-    printf("DMA memory allocated - Virtual addr: 0x%08X (%u) // Physical addr: 0x%08X (%u)\n",
-            (uint32_t)virtualAddr, (uint32_t)virtualAddr, physicalAddr, physicalAddr);
+    printf("DMA memory allocated - Virtual addr: %p // Buffer handle: %u\n", virtualAddr, mapping.handle);
 
   return virtualAddr;
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// InternalMapBuffer() ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+void * CAccelDriver::InternalMapBuffer(uint32_t Size, uint32_t Cacheable, TDMAMapping & Mapping)
+{
+  // The kernel module allocates the buffer, and it is mapped into our address space
+  struct alloc_message message = {Size, Cacheable, 0, 0};
+  if (ioctl(driver, SEQ_MATCHER_IOC_ALLOC, &message) != 0) {
+    if (logging)
+      printf("Error allocating DMA memory for %u bytes.\n", Size);
+    return NULL;
+  }
+
+  void * virtualAddr = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, driver, message.mmapOffset);
+  if (virtualAddr == MAP_FAILED) {
+    if (logging)
+      printf("Error mapping DMA buffer %u (%u bytes).\n", message.handle, Size);
+    ioctl(driver, SEQ_MATCHER_IOC_FREE, &message.handle);
+    return NULL;
+  }
+
+  Mapping = {message.handle, Size, Cacheable};
+  return virtualAddr;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// InternalUnmapBuffer() ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CAccelDriver::InternalUnmapBuffer(void * VirtAddr, const TDMAMapping & Mapping)
+{
+  // The kernel module refuses to free a buffer that is still mapped
+  uint32_t handle = Mapping.handle;
+  return (munmap(VirtAddr, Mapping.size) == 0) && (ioctl(driver, SEQ_MATCHER_IOC_FREE, &handle) == 0);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 ////////////////////////// FreeDMACompatible() ////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
@@ -110,36 +193,216 @@ void * CAccelDriver::AllocDMACompatible(uint32_t Size, uint32_t Cacheable)
 bool CAccelDriver::FreeDMACompatible(void * VirtAddr)
 {
   if (logging)
-    printf("CAccelDriver::FreeDMACompatible(Addr = 0x%08X)\n", (uint32_t)VirtAddr);
+    printf("CAccelDriver::FreeDMACompatible(Addr = %p)\n", VirtAddr);
+
+  if ( (arena != NULL) && ((uint8_t *)VirtAddr >= arena) && ((uint8_t *)VirtAddr < arena + arenaSize) ) {
+    uint32_t offset = (uint8_t *)VirtAddr - arena;
+    if (arenaAllocs.count(offset) == 0) {
+      if (logging)
+        printf("No block of the DMA arena starts at address %p.\n", VirtAddr);
+      return false;
+    }
+    InternalArenaFree(offset);
+    return true;
+  }
 
-  if (logging) {
-    if (dmaMappings.count((uint32_t)VirtAddr) == 0)
-      printf("No virtual address 0x%08X present in the dictionary of mappings.\n", (uint32_t)VirtAddr);
+  auto it = dmaMappings.find((uintptr_t)VirtAddr);
+  if (it == dmaMappings.end()) {
+    if (logging)
+      printf("No virtual address %p present in the dictionary of mappings.\n", VirtAddr);
+    return false;
   }
 
-  dmaMappings.erase((uint32_t)VirtAddr);
-  cma_free(VirtAddr);
+  uint32_t handle = it->second.handle;
+  bool freed = InternalUnmapBuffer(VirtAddr, it->second);
+  dmaMappings.erase(it);
 
-  return true;
+  if (!freed && logging)
+    printf("Error freeing DMA buffer %u.\n", handle);
+
+  return freed;
 }
 
 
 ///////////////////////////////////////////////////////////////////////////////
-////////////////////////// GetDMAPhysicalAddr() ///////////////////////////////
+/////////////////////////// GetDMABufferRef() /////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 
-uint32_t CAccelDriver::GetDMAPhysicalAddr(void * VirtAddr)
+bool CAccelDriver::GetDMABufferRef(void * VirtAddr, uint32_t & Handle, uint32_t & Offset)
 {
   if (logging)
-    printf("CAccelDriver::GetDMAPhysicalAddr(Addr = 0x%08X)\n", (uint32_t)VirtAddr);
+    printf("CAccelDriver::GetDMABufferRef(Addr = %p)\n", VirtAddr);
 
-  if (dmaMappings.count((uint32_t)VirtAddr) == 0) {
+  uintptr_t mappingVirtAddr;
+  const TDMAMapping * mapping = InternalFindMapping(VirtAddr, mappingVirtAddr);
+  if (mapping == NULL) {
     if (logging)
-      printf("No virtual address 0x%08X present in the dictionary of mappings.\n", (uint32_t)VirtAddr);
-    return 0;
+      printf("No virtual address %p present in the dictionary of mappings.\n", VirtAddr);
+    return false;
   }
   
-  return dmaMappings[(uint32_t)VirtAddr];
+  Handle = mapping->handle;
+  Offset = (uintptr_t)VirtAddr - mappingVirtAddr;
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////////// FlushDMACache() //////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CAccelDriver::FlushDMACache(void * VirtAddr, uint32_t Size)
+{
+  if (logging)
+    printf("CAccelDriver::FlushDMACache(Addr = %p, Size = %u)\n", VirtAddr, Size);
+
+  return InternalCacheOperation(SEQ_MATCHER_IOC_FLUSH, VirtAddr, Size);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// InvalidateDMACache() ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CAccelDriver::InvalidateDMACache(void * VirtAddr, uint32_t Size)
+{
+  if (logging)
+    printf("CAccelDriver::InvalidateDMACache(Addr = %p, Size = %u)\n", VirtAddr, Size);
+
+  return InternalCacheOperation(SEQ_MATCHER_IOC_INVALIDATE, VirtAddr, Size);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// CreateDMAArena() //////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CAccelDriver::CreateDMAArena(uint32_t Size, uint32_t Cacheable)
+{
+  TRACE_SCOPE("Allocate DMA arena");
+
+  if (logging)
+    printf("CAccelDriver::CreateDMAArena(Size = %u, Cacheable = %u)\n", Size, Cacheable);
+
+  if (arena != NULL) {
+    if (logging)
+      printf("The DMA arena already exists.\n");
+    return false;
+  }
+
+  Size = (Size + DMA_ARENA_ALIGNMENT - 1) & ~(DMA_ARENA_ALIGNMENT - 1);
+  if ( (arena = (uint8_t *)AllocDMACompatible(Size, Cacheable)) == NULL )
+    return false;
+
+  arenaSize = Size;
+  arenaCacheable = Cacheable;
+  arenaFreeBlocks.clear();
+  arenaFreeBlocks[0] = Size;
+  arenaAllocs.clear();
+
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// DestroyDMAArena() /////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CAccelDriver::DestroyDMAArena()
+{
+  if (logging)
+    printf("CAccelDriver::DestroyDMAArena()\n");
+
+  if (arena == NULL)
+    return false;
+
+  if (!arenaAllocs.empty()) {
+    if (logging)
+      printf("Error: %u blocks of the DMA arena are still allocated.\n", (uint32_t)arenaAllocs.size());
+    return false;
+  }
+
+  // The arena pointer has to be cleared first, so that it is freed as a regular allocation
+  uint8_t * region = arena;
+  arena = NULL;
+  arenaSize = 0;
+  arenaFreeBlocks.clear();
+
+  return FreeDMACompatible(region);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// GetDMAArenaFreeSize() ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t CAccelDriver::GetDMAArenaFreeSize()
+{
+  uint32_t freeSize = 0;
+
+  for (auto it = arenaFreeBlocks.begin(); it != arenaFreeBlocks.end(); ++ it)
+    freeSize += it->second;
+
+  return freeSize;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// InternalArenaAlloc() ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+// First fit in the free list of the arena. Returns NULL if no free block is large enough.
+void * CAccelDriver::InternalArenaAlloc(uint32_t Size)
+{
+  Size = (Size == 0) ? DMA_ARENA_ALIGNMENT : (Size + DMA_ARENA_ALIGNMENT - 1) & ~(DMA_ARENA_ALIGNMENT - 1);
+
+  for (auto it = arenaFreeBlocks.begin(); it != arenaFreeBlocks.end(); ++ it) {
+    if (it->second < Size)
+      continue;
+
+    uint32_t offset = it->first;
+    uint32_t remaining = it->second - Size;
+    arenaFreeBlocks.erase(it);
+    if (remaining > 0)
+      arenaFreeBlocks[offset + Size] = remaining;
+    arenaAllocs[offset] = Size;
+
+    if (logging)
+      printf("DMA arena block allocated - Virtual addr: %p // Offset: %u // Size: %u\n",
+             (void *)(arena + offset), offset, Size);
+
+    return arena + offset;
+  }
+
+  return NULL;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// InternalArenaFree() ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+// Returns a block to the free list of the arena, merging it with its free neighbours.
+void CAccelDriver::InternalArenaFree(uint32_t Offset)
+{
+  uint32_t size = arenaAllocs[Offset];
+  arenaAllocs.erase(Offset);
+
+  auto next = arenaFreeBlocks.lower_bound(Offset);
+  if ( (next != arenaFreeBlocks.end()) && (next->first == Offset + size) ) {
+    size += next->second;
+    next = arenaFreeBlocks.erase(next);
+  }
+
+  if (next != arenaFreeBlocks.begin()) {
+    auto prev = std::prev(next);
+    if (prev->first + prev->second == Offset) {
+      prev->second += size;
+      return;
+    }
+  }
+
+  arenaFreeBlocks[Offset] = size;
 }
 
 
@@ -159,13 +422,92 @@ void CAccelDriver::InternalEmptyDMAAllocs()
     printf("DMA MEMORY WAS NOT CORRECTLY FREED. PERFORMING EMERGENCY RELEASE OF KERNEL DMA MEMORY IN DESTRUCTOR. PLEASE, FIX THIS ISSUE.\n");
 
   for (auto it = dmaMappings.begin(); it != dmaMappings.end(); ++ it) {
-    uint32_t virtAddr = it->first;
+    void * virtAddr = (void *)it->first;
     if (logging)
-      printf("Releasing DMA (virtual) pointer 0x%08X\n", virtAddr);
-    cma_free((void*)virtAddr);
+      printf("Releasing DMA (virtual) pointer %p\n", virtAddr);
+    InternalUnmapBuffer(virtAddr, it->second);
   }
 
   dmaMappings.clear();
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// InternalFindMapping() ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+const CAccelDriver::TDMAMapping * CAccelDriver::InternalFindMapping(void * VirtAddr, uintptr_t & MappingVirtAddr)
+{
+  // Last allocation starting at or before VirtAddr
+  auto it = dmaMappings.upper_bound((uintptr_t)VirtAddr);
+  if (it == dmaMappings.begin())
+    return NULL;
+  -- it;
+
+  if ((uintptr_t)VirtAddr - it->first >= it->second.size)
+    return NULL;
+
+  MappingVirtAddr = it->first;
+  return &it->second;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////// InternalRemainingSize() //////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t CAccelDriver::InternalRemainingSize(void * VirtAddr, uintptr_t MappingVirtAddr, const TDMAMapping & Mapping)
+{
+  uintptr_t end = MappingVirtAddr + Mapping.size;
+
+  // Inside the arena, the allocation is the block that contains VirtAddr
+  if (MappingVirtAddr == (uintptr_t)arena) {
+    auto it = arenaAllocs.upper_bound((uint8_t *)VirtAddr - arena);
+    if (it != arenaAllocs.begin()) {
+      -- it;
+      if ((uint32_t)((uint8_t *)VirtAddr - arena) < it->first + it->second)
+        end = (uintptr_t)(arena + it->first + it->second);
+    }
+  }
+
+  return end - (uintptr_t)VirtAddr;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////// InternalCacheOperation() /////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CAccelDriver::InternalCacheOperation(uint32_t Operation, void * VirtAddr, uint32_t Size)
+{
+  uintptr_t mappingVirtAddr;
+  const TDMAMapping * mapping = InternalFindMapping(VirtAddr, mappingVirtAddr);
+
+  if (mapping == NULL) {
+    if (logging)
+      printf("No virtual address %p present in the dictionary of mappings.\n", VirtAddr);
+    return false;
+  }
+
+  if (!mapping->cacheable)
+    return true;
+
+  uint32_t remaining = InternalRemainingSize(VirtAddr, mappingVirtAddr, *mapping);
+  if ((Size == 0) || (Size > remaining))
+    Size = remaining;
+
+  struct cache_message message = {
+    mapping->handle,
+    (uint32_t)((uintptr_t)VirtAddr - mappingVirtAddr),
+    Size
+  };
+
+  if (ioctl(driver, Operation, &message) != 0) {
+    if (logging)
+      printf("Error: cache maintenance of %p (%u bytes) failed. Is the kernel module up to date?\n",
+             VirtAddr, Size);
+    return false;
+  }
+
+  return true;
+}
@@ -7,38 +7,91 @@
 // Requires <map>, <stdint.h>
 
 //  This class takes care of the low-level configuration of addresses.
-// The class stores internally the address of the device registers in the application virtual space,
-// and a map of DMA-compatible memory allocations that relates virtual with physical addresses.
+// The DMA-compatible memory is allocated by the kernel module and mapped into the application with mmap(). The
+// class keeps a map of the allocations that relates their virtual addresses with the handles of the buffers in
+// the kernel module, which translates them to physical addresses when a job is submitted.
+//  Optionally, one large DMA region (the arena) can be allocated with CreateDMAArena(). AllocDMACompatible() then
+// sub-allocates aligned blocks of it from a free list, without system calls, and blocks freed with
+// FreeDMACompatible() are reused by the next allocations (e.g. by the next job).
+//  Cacheable DMA memory is much faster for the CPU, but the caches have to be maintained explicitly by the kernel
+// module: FlushDMACache() before the device reads a buffer written by the CPU, and InvalidateDMACache() before the
+// CPU reads a buffer written by the device. Both do nothing on non-cacheable memory.
+//  Derived classes can replace the device (e.g. with an emulation on the CPU) by overriding Open() and the
+// InternalMapBuffer()/InternalUnmapBuffer() hooks. The arena, the map of allocations and the cache maintenance of
+// cacheable mappings are shared.
+
+// Alignment of the blocks of the DMA arena (one cache line, and the accelerator bursts are aligned)
+#define DMA_ARENA_ALIGNMENT 64
 
 class CAccelDriver {
   protected:
     int driver = 0;
     bool logging;
 
-    // Map of virtual addresses to physical addresses
-    std::map<uint32_t, uint32_t> dmaMappings;
+    struct TDMAMapping {
+      uint32_t handle;
+      uint32_t size;
+      uint32_t cacheable;
+    };
+
+    // Map of the virtual addresses of the DMA allocations (including the arena) to their buffers
+    std::map<uintptr_t, TDMAMapping> dmaMappings;
+
+    // DMA arena. Both maps are indexed by the offset in the arena.
+    uint8_t * arena = NULL;
+    uint32_t arenaSize = 0;
+    uint32_t arenaCacheable = 0;
+    std::map<uint32_t, uint32_t> arenaFreeBlocks;   // Offset -> size, adjacent free blocks are always merged
+    std::map<uint32_t, uint32_t> arenaAllocs;       // Offset -> size
 
-    // Called by the destructor to free any dangling DMA allocations.
+    // Called by the destructor to free the arena and any dangling DMA allocations. Derived classes that override
+    // the buffer hooks call it in their own destructor, while their overrides can still be called.
+    void InternalRelease();
     void InternalEmptyDMAAllocs();
+    // Allocates a buffer of the device and maps it into the application (filling Mapping), or returns NULL.
+    virtual void * InternalMapBuffer(uint32_t Size, uint32_t Cacheable, TDMAMapping & Mapping);
+    virtual bool InternalUnmapBuffer(void * VirtAddr, const TDMAMapping & Mapping);
+    void * InternalArenaAlloc(uint32_t Size);
+    void InternalArenaFree(uint32_t Offset);
+    // Mapping that contains VirtAddr, or NULL
+    const TDMAMapping * InternalFindMapping(void * VirtAddr, uintptr_t & MappingVirtAddr);
+    // Bytes from VirtAddr to the end of its allocation (or arena block)
+    uint32_t InternalRemainingSize(void * VirtAddr, uintptr_t MappingVirtAddr, const TDMAMapping & Mapping);
+    bool InternalCacheOperation(uint32_t Operation, void * VirtAddr, uint32_t Size);
 
   public:
     typedef enum {OK = 0, DEVICE_ALREADY_INITIALIZED = 1, DEVICE_NOT_INITIALIZED = 2, ERROR_MAPPING_BASE_ADDR = 3,
-                VIRT_ADDR_NOT_FOUND = 4, DEVICE_CALL_ERROR=5} TErrors;
+                VIRT_ADDR_NOT_FOUND = 4, DEVICE_CALL_ERROR=5, DEVICE_BUSY = 6, INVALID_JOB = 7,
+                JOB_TIMEOUT = 8, JOB_CANCELED = 9} TErrors;
 
   public:
     CAccelDriver(bool Logging = false);
     virtual ~CAccelDriver();
 
     // Maps the address of the peripheral registers in the physical address space into the application virtual address space.
-    uint32_t Open(const char * driver_name, volatile void ** AccelRegsPointer = NULL);
+    virtual uint32_t Open(const char * driver_name, volatile void ** AccelRegsPointer = NULL);
 
     // Allocates a block of DMA-compatible memory and returns the corresponding address in this application virtual address space.
-    // The class keeps an internal map of virtual to physical addresses, so that derived classes can translate the virtual 
-    // addresses supplied by the applications.
+    // The device must be open. The class keeps an internal map of virtual addresses to buffers, so that derived
+    // classes can translate the virtual addresses supplied by the applications.
+    // Blocks come from the arena when there is one with the same Cacheable setting and enough free space.
     void * AllocDMACompatible(uint32_t Size, uint32_t Cacheable = 0);
     bool FreeDMACompatible(void * VirtAddr);
-    // The application should never use the physical address. This is just for debugging purposes.
-    uint32_t GetDMAPhysicalAddr(void * VirtAddr);
+    // Buffer of the kernel module and offset in it of a virtual address. Any address inside an allocation is
+    // translated, so slices of a buffer can be passed to the accelerator.
+    bool GetDMABufferRef(void * VirtAddr, uint32_t & Handle, uint32_t & Offset);
+
+    // Cache maintenance of a cacheable DMA buffer. Size = 0 extends the operation up to the end of the allocation
+    // (or arena block) of VirtAddr. Invalidation discards data written by the CPU, so it must be limited to the
+    // bytes written by the device.
+    bool FlushDMACache(void * VirtAddr, uint32_t Size = 0);
+    bool InvalidateDMACache(void * VirtAddr, uint32_t Size = 0);
+
+    // Allocates the DMA arena with a single DMA allocation. It is freed by DestroyDMAArena() or by the destructor.
+    bool CreateDMAArena(uint32_t Size, uint32_t Cacheable = 0);
+    // Fails if any block of the arena is still allocated.
+    bool DestroyDMAArena();
+    uint32_t GetDMAArenaFreeSize();
 };
 
 
@@ -4,83 +4,237 @@
 #include <map>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <errno.h>
 #include "util.hpp"
 #include "CAccelDriver.hpp"
 #include "CSeqMatcherDriver.hpp"
+#include "trace.hpp"
+
+#define SEQ_MATCHER_IOC_MAGIC 'q'
+#define SEQ_MATCHER_IOC_SUBMIT _IOW(SEQ_MATCHER_IOC_MAGIC, 5, struct CSeqMatcherDriver::job_message)
+#define SEQ_MATCHER_IOC_SET_POLL_WINDOW _IOW(SEQ_MATCHER_IOC_MAGIC, 6, uint32_t)
+#define SEQ_MATCHER_IOC_CANCEL _IO(SEQ_MATCHER_IOC_MAGIC, 7)
 
 uint32_t CSeqMatcherDriver::SeqMatcher_HW(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
     void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen,
-    void * scores, uint32_t &numComparisons)
+    void * scores, uint32_t &numComparisons,
+    void * masksDB, void * masksSpecimen, uint32_t ambiguousMode)
 {
-  uint32_t phySeqsDB, phySeqsSpecimen, phyLengthsDB, phyLengthsSpecimen, phyScores;
-  uint32_t status;
+  TRACE_SCOPE("SeqMatcher_HW");
+  TJobHandle job;
+  uint32_t status = InternalSubmit(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+                                   scores, masksDB, masksSpecimen, ambiguousMode, job);
+  if (status != OK)
+    return status;
+
+  return Wait(job, numComparisons);
+}
+
+
+CSeqMatcherDriver::TJobHandle CSeqMatcherDriver::Submit(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen, void * scores,
+    void * masksDB, void * masksSpecimen, uint32_t ambiguousMode)
+{
+  TJobHandle job;
+
+  if (InternalSubmit(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen, scores,
+                     masksDB, masksSpecimen, ambiguousMode, job) != OK)
+    return INVALID_JOB_HANDLE;
+
+  return job;
+}
 
+
+bool CSeqMatcherDriver::Poll(TJobHandle job)
+{
+  // Jobs already collected are finished
+  if ((job != lastJob) || !jobInFlight)
+    return true;
+
+  struct pollfd request = {driver, POLLIN, 0};
+  return (poll(&request, 1, 0) == 1) && (request.revents & POLLIN);
+}
+
+
+uint32_t CSeqMatcherDriver::Wait(TJobHandle job, uint32_t &numComparisons)
+{
   if (logging)
-    printf("CSeqMatcherDriver::SeqMatcher_HW():\n\tnumDBEnttries=%u\n\tnumSeqsSpecimen=%u\n\tseqsDB=0x%08X\n\tseqsSpecimen=0x%08X\n\t"
-          "lengtsDB=0x%08X\n\tlengthsSpecimen=0x%08X\n\tscores=0x%08X\n\n", 
-          (uint32_t)numDBEntries, (uint32_t)numSeqsSpecimen, (uint32_t)seqsDB, (uint32_t)seqsSpecimen,
-          (uint32_t)lengthsDB, (uint32_t)lengthsSpecimen, (uint32_t)scores);
+    printf("CSeqMatcherDriver::Wait(job=%u)\n", job);
 
-  if (driver == 0) {
+  if ((job != lastJob) || !jobInFlight) {
     if (logging)
-      printf("Error: Calling SeqMatcher_HW() on a non-initialized accelerator.\n");
-    return DEVICE_NOT_INITIALIZED;
+      printf("Error: Job %u is not in flight.\n", job);
+    return INVALID_JOB;
   }
 
-  // We need to obtain the physical addresses corresponding to each of the virtual addresses passed by the application.
-  // The accelerator uses only the physical addresses (and only contiguous memory).
-  phySeqsDB = GetDMAPhysicalAddr(seqsDB);
-  if (phySeqsDB == 0) {
-    if (logging)
-      printf("Error: No physical address found for virtual address 0x%08X\n", (uint32_t)seqsDB);
-    return VIRT_ADDR_NOT_FOUND;
+  uint32_t status;
+  {
+    TRACE_SCOPE("Wait for the accelerator");
+    status = InternalCollectJob(numComparisons);
   }
-  phySeqsSpecimen = GetDMAPhysicalAddr(seqsSpecimen);
-  if (phySeqsSpecimen == 0) {
+  jobInFlight = false;
+
+  if (status != OK) {
     if (logging)
-      printf("Error: No physical address found for virtual address 0x%08X\n", (uint32_t)seqsSpecimen);
-    return VIRT_ADDR_NOT_FOUND;
+      printf("Error: Collecting job %u failed (status %u).\n", job, status);
+    return status;
   }
-  phyLengthsDB = GetDMAPhysicalAddr(lengthsDB);
-  if (phyLengthsDB == 0) {
+
+  // Lines of the scores may have been prefetched during the job
+  TRACE_SCOPE("Invalidate scores cache");
+  if ((jobNumScores > 0) && !InvalidateDMACache(jobScores, jobNumScores)) {
     if (logging)
-      printf("Error: No physical address found for virtual address 0x%08X\n", (uint32_t)lengthsDB);
-    return VIRT_ADDR_NOT_FOUND;
+      printf("Error: Cache invalidation of the scores failed.\n");
+    return DEVICE_CALL_ERROR;
   }
-  phyLengthsSpecimen = GetDMAPhysicalAddr(lengthsSpecimen);
-  if (phyLengthsSpecimen == 0) {
+
+  return OK;
+}
+
+
+uint32_t CSeqMatcherDriver::InternalCollectJob(uint32_t & numComparisons)
+{
+  // Sleeps in the driver until the interrupt of the accelerator
+  int32_t readBytes;
+  do {
+    readBytes = read(driver, (void *)&numComparisons, sizeof(uint32_t));
+  } while ((readBytes == -1) && (errno == EINTR));
+
+  if (readBytes == sizeof(uint32_t))
+    return OK;
+
+  if (logging)
+    printf("Error: read returned %d, errno %d.\n", readBytes, errno);
+  if ((readBytes == -1) && (errno == ETIMEDOUT))
+    return JOB_TIMEOUT;
+  if ((readBytes == -1) && (errno == ECANCELED))
+    return JOB_CANCELED;
+  return DEVICE_CALL_ERROR;
+}
+
+
+bool CSeqMatcherDriver::Cancel(TJobHandle job)
+{
+  if (logging)
+    printf("CSeqMatcherDriver::Cancel(job=%u)\n", job);
+
+  if ((job != lastJob) || !jobInFlight)
+    return false;
+
+  return ioctl(driver, SEQ_MATCHER_IOC_CANCEL) == 0;
+}
+
+
+bool CSeqMatcherDriver::SetPollWindow(uint32_t Microseconds)
+{
+  if (logging)
+    printf("CSeqMatcherDriver::SetPollWindow(Microseconds = %u)\n", Microseconds);
+
+  if (driver == 0)
+    return false;
+
+  return ioctl(driver, SEQ_MATCHER_IOC_SET_POLL_WINDOW, &Microseconds) == 0;
+}
+
+
+uint32_t CSeqMatcherDriver::InternalSubmit(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen, void * scores,
+    void * masksDB, void * masksSpecimen, uint32_t ambiguousMode, TJobHandle & job)
+{
+  TRACE_SCOPE("Submit job");
+  struct job_message message = {numDBEntries, numSeqsSpecimen};
+  message.ambiguousMode = ambiguousMode;
+  message.timeoutMs = jobTimeoutMs;
+
+  job = INVALID_JOB_HANDLE;
+
+  if (logging)
+    printf("CSeqMatcherDriver::Submit():\n\tnumDBEnttries=%u\n\tnumSeqsSpecimen=%u\n\tseqsDB=%p\n\tseqsSpecimen=%p\n\t"
+          "lengtsDB=%p\n\tlengthsSpecimen=%p\n\tscores=%p\n\tmasksDB=%p\n\tmasksSpecimen=%p\n\t"
+          "ambiguousMode=%u\n\n",
+          (uint32_t)numDBEntries, (uint32_t)numSeqsSpecimen, seqsDB, seqsSpecimen,
+          lengthsDB, lengthsSpecimen, scores, masksDB, masksSpecimen, ambiguousMode);
+
+  if (driver == 0) {
     if (logging)
-      printf("Error: No physical address found for virtual address 0x%08X\n", (uint32_t)lengthsSpecimen);
-    return VIRT_ADDR_NOT_FOUND;
+      printf("Error: Calling SeqMatcher_HW() on a non-initialized accelerator.\n");
+    return DEVICE_NOT_INITIALIZED;
   }
-  phyScores = GetDMAPhysicalAddr(scores);
-  if (phyScores == 0) {
+
+  if (jobInFlight) {
     if (logging)
-      printf("Error: No physical address found for virtual address 0x%08X\n", (uint32_t)scores);
-    return VIRT_ADDR_NOT_FOUND;
+      printf("Error: Job %u is still in flight.\n", lastJob);
+    return DEVICE_BUSY;
   }
 
-  struct user_message message = {
-      numDBEntries,
-      numSeqsSpecimen,
-      (uint32_t) phySeqsDB,
-      (uint32_t) phySeqsSpecimen,
-      (uint32_t) phyLengthsDB,
-      (uint32_t) phyLengthsSpecimen,
-      (uint32_t) phyScores,
-
-      (uint32_t)(&numComparisons)
+  // We need to obtain the buffers of the kernel module corresponding to each of the virtual addresses passed by the
+  // application. The kernel module translates them to the physical addresses used by the accelerator.
+  struct { void * virtAddr; buffer_ref * ref; } buffers[] = {
+    {seqsDB, &message.seqsDB}, {seqsSpecimen, &message.seqsSpecimen}, {lengthsDB, &message.lengthsDB},
+    {lengthsSpecimen, &message.lengthsSpecimen}, {scores, &message.scores},
+    {masksDB, &message.masksDB}, {masksSpecimen, &message.masksSpecimen}
   };
+  // The masks are only read by the accelerator when ambiguous nucleobases are enabled.
+  uint32_t numBuffers = (ambiguousMode != AMBIGUOUS_DISABLED) ? 7 : 5;
+
+  for (uint32_t iBuffer = 0; iBuffer < numBuffers; ++ iBuffer) {
+    if (!GetDMABufferRef(buffers[iBuffer].virtAddr, buffers[iBuffer].ref->handle, buffers[iBuffer].ref->offset)) {
+      if (logging)
+        printf("Error: No DMA buffer found for virtual address %p\n", buffers[iBuffer].virtAddr);
+      return VIRT_ADDR_NOT_FOUND;
+    }
+  }
+
+  // Cacheable buffers: write back what the CPU wrote in the inputs, and drop any line of the scores before the
+  // accelerator writes them, so that no dirty line is evicted over them during the job. The inputs are flushed up
+  // to the end of their allocation because their entry size is not known here; the scores are flushed exactly,
+  // because in split mode the CPU is writing the scores that follow them.
+  uint32_t numScores = numDBEntries * numSeqsSpecimen;
+  TRACE_SCOPE("Flush input caches");
+  bool cacheOk = FlushDMACache(seqsDB) && FlushDMACache(seqsSpecimen) && FlushDMACache(lengthsDB) &&
+                 FlushDMACache(lengthsSpecimen) && ((numScores == 0) || FlushDMACache(scores, numScores));
+  if (cacheOk && (ambiguousMode != AMBIGUOUS_DISABLED))
+    cacheOk = FlushDMACache(masksDB) && FlushDMACache(masksSpecimen);
+  if (!cacheOk) {
+    if (logging)
+      printf("Error: Cache maintenance of the buffers failed.\n");
+    return DEVICE_CALL_ERROR;
+  }
 
   if (logging)
     printf("\nStarting accel...\n");
 
-  int32_t readBytes = read(driver, (void *)&message, sizeof(message));
-  if (readBytes != 0)
-    printf("Warning! Read %d bytes instead than %d\n", readBytes, 0);
+  uint32_t status;
+  {
+    TRACE_SCOPE("Start job");
+    status = InternalStartJob(message);
+  }
+  if (status != OK)
+    return status;
+
+  jobInFlight = true;
+  jobScores = scores;
+  jobNumScores = numScores;
+  job = ++ lastJob;
+  if (job == INVALID_JOB_HANDLE)
+    job = ++ lastJob;
 
   return OK;
 }
 
 
+uint32_t CSeqMatcherDriver::InternalStartJob(const job_message & message)
+{
+  // The driver queues the job and returns at once. The number of comparisons is returned by read() when the job
+  // is collected.
+  if (ioctl(driver, SEQ_MATCHER_IOC_SUBMIT, &message) != 0) {
+    if (logging)
+      printf("Error: Submitting the job failed (errno %d).\n", errno);
+    return DEVICE_CALL_ERROR;
+  }
+
+  return OK;
+}
+
@@ -4,28 +4,86 @@
 class CSeqMatcherDriver : public CAccelDriver {
   protected:
 
-  // Structure used to pass commands between user-space and kernel-space.
-  struct user_message {
+  // Structures used to pass commands between user-space and kernel-space (see seq_matcher.c).
+  struct buffer_ref {
+      uint32_t handle;
+      uint32_t offset;
+  };
+
+  struct job_message {
       uint32_t numDBEntries;
       uint32_t numSeqsSpecimen;
-      uint32_t seqsDB;
-      uint32_t seqsSpecimen;
-      uint32_t lengthsDB;
-      uint32_t lengthsSpecimen;
-      uint32_t scores;
-
-      uint32_t numComparisonsPtr;
+      buffer_ref seqsDB;
+      buffer_ref seqsSpecimen;
+      buffer_ref lengthsDB;
+      buffer_ref lengthsSpecimen;
+      buffer_ref scores;
+      buffer_ref masksDB;
+      buffer_ref masksSpecimen;
+      uint32_t ambiguousMode;
+      uint32_t timeoutMs;
   };
+
+  public:
+    // Handle of an asynchronous job. Handles are never reused (until they wrap around).
+    typedef uint32_t TJobHandle;
+    static const TJobHandle INVALID_JOB_HANDLE = 0;
+
+  protected:
+    // Only one job can be in flight
+    TJobHandle lastJob = INVALID_JOB_HANDLE;
+    bool jobInFlight = false;
+    void * jobScores = NULL;
+    uint32_t jobNumScores = 0;
+    uint32_t jobTimeoutMs = 0;
+
+    uint32_t InternalSubmit(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+        void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen, void * scores,
+        void * masksDB, void * masksSpecimen, uint32_t ambiguousMode, TJobHandle & job);
+
+    // Backend of the jobs: starts a validated job (with its buffers translated to buffer refs), and collects it,
+    // blocking until it finishes. A different backend (see CSeqMatcherEmuDriver) overrides them.
+    virtual uint32_t InternalStartJob(const job_message & message);
+    virtual uint32_t InternalCollectJob(uint32_t & numComparisons);
   
+  public:
+    // How the accelerator scores ambiguous nucleobases (N and the other IUPAC codes). With AMBIGUOUS_DISABLED the
+    // mask arrays are not read at all.
+    typedef enum {AMBIGUOUS_DISABLED = 0, AMBIGUOUS_MISMATCH = 1, AMBIGUOUS_WILDCARD = 2} TAmbiguousMode;
+
   public:
     CSeqMatcherDriver(bool Logging = false)
       : CAccelDriver(Logging) {}
 
-    ~CSeqMatcherDriver() {}
+    virtual ~CSeqMatcherDriver() {}
 
+    // Runs a job and waits until it finishes (Submit() followed by Wait()).
     uint32_t SeqMatcher_HW(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
         void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen,
-        void * scores, uint32_t & numComparisons);
+        void * scores, uint32_t & numComparisons,
+        void * masksDB = NULL, void * masksSpecimen = NULL, uint32_t ambiguousMode = AMBIGUOUS_DISABLED);
+
+    // Asynchronous jobs. Submit() starts the accelerator and returns at once (INVALID_JOB_HANDLE on error, or if a
+    // job is still in flight). Poll() tells, without blocking, whether the job has finished. Wait() blocks until it
+    // finishes and collects it: it must be called for every job, also after Poll() has returned true. Fd() is the
+    // device file, which becomes readable (POLLIN) when the job finishes, to multiplex it with other files in an
+    // event loop.
+    TJobHandle Submit(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+        void * seqsDB, void * seqsSpecimen, void * lengthsDB, void * lengthsSpecimen, void * scores,
+        void * masksDB = NULL, void * masksSpecimen = NULL, uint32_t ambiguousMode = AMBIGUOUS_DISABLED);
+    bool Poll(TJobHandle job);
+    uint32_t Wait(TJobHandle job, uint32_t & numComparisons);
+    int Fd() { return driver; }
+
+    // Wait() busy-polls the accelerator for up to Microseconds before sleeping until its interrupt. This saves the
+    // interrupt round trip on small jobs, at the cost of one busy core. 0 (the default) always sleeps.
+    virtual bool SetPollWindow(uint32_t Microseconds);
+
+    // Time limit of the next jobs once started (0, the default, uses the default of the kernel module). A job that
+    // exceeds it is stopped by resetting the accelerator, and Wait() returns JOB_TIMEOUT.
+    void SetJobTimeout(uint32_t Milliseconds) { jobTimeoutMs = Milliseconds; }
+    // Cancels a queued or running job. It still has to be collected with Wait(), which returns JOB_CANCELED.
+    virtual bool Cancel(TJobHandle job);
 };
 
 #endif  // CSEQMATCHERDRIVER_HPP
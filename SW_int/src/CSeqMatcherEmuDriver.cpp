@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <thread>
+#include <unistd.h>
+#include <errno.h>
+#include "CAccelDriver.hpp"
+#include "CSeqMatcherDriver.hpp"
+#include "seqMatcherCPU.hpp"
+#include "CSeqMatcherEmuDriver.hpp"
+
+#define EMU_BUFFER_ALIGNMENT 4096
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// CSeqMatcherEmuDriver() //////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSeqMatcherEmuDriver::CSeqMatcherEmuDriver(TCPUEngine Engine, uint32_t NumThreads, bool Logging)
+  : CSeqMatcherDriver(Logging), engine(Engine), numThreads(NumThreads)
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////// ~CSeqMatcherEmuDriver() //////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CSeqMatcherEmuDriver::~CSeqMatcherEmuDriver()
+{
+  // A job that was never collected still uses the buffers
+  if (worker.joinable())
+    worker.join();
+
+  // The base destructor cannot call our hooks any more
+  InternalRelease();
+
+  for (int iEnd = 0; iEnd < 2; ++ iEnd)
+    if (completionPipe[iEnd] != -1)
+      close(completionPipe[iEnd]);
+  driver = 0;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// Open() ////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t CSeqMatcherEmuDriver::Open(const char * driver_name, volatile void ** AccelRegsPointer)
+{
+  if (logging)
+    printf("CSeqMatcherEmuDriver::Open(engine = %d, threads = %u)\n", engine, numThreads);
+
+  if (driver != 0)
+    return DEVICE_ALREADY_INITIALIZED;
+
+  if ((engine != CPU_ENGINE_SW) && (engine != CPU_ENGINE_EDIT_DISTANCE)) {
+    printf("ERR: engine %d does not emulate a bitstream\n", engine);
+    return DEVICE_CALL_ERROR;
+  }
+
+  // The read end plays the role of the device file for Poll() and Fd()
+  if (pipe(completionPipe) != 0) {
+    printf("ERR: cannot create the completion pipe of the emulator\n");
+    return DEVICE_CALL_ERROR;
+  }
+  driver = completionPipe[0];
+
+  return OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// InternalMapBuffer() ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+void * CSeqMatcherEmuDriver::InternalMapBuffer(uint32_t Size, uint32_t Cacheable, TDMAMapping & Mapping)
+{
+  uint8_t * data;
+
+  // Like the buffers of the kernel module, they are page-aligned and zeroed. The memory is coherent, so the
+  // mapping is not cacheable and the cache maintenance does nothing.
+  if (posix_memalign((void **)&data, EMU_BUFFER_ALIGNMENT, (Size > 0) ? Size : 1) != 0) {
+    if (logging)
+      printf("Error allocating emulated DMA memory for %u bytes.\n", Size);
+    return NULL;
+  }
+  memset(data, 0, Size);
+
+  Mapping = {nextHandle ++, Size, 0};
+  buffers[Mapping.handle] = {data, Size};
+  return data;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// InternalUnmapBuffer() ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CSeqMatcherEmuDriver::InternalUnmapBuffer(void * VirtAddr, const TDMAMapping & Mapping)
+{
+  auto it = buffers.find(Mapping.handle);
+  if ((it == buffers.end()) || (it->second.data != VirtAddr))
+    return false;
+
+  free(it->second.data);
+  buffers.erase(it);
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// InternalResolve() /////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+uint8_t * CSeqMatcherEmuDriver::InternalResolve(const buffer_ref & ref, uint64_t size)
+{
+  // A 32-bit offset plus a product of two 32-bit counts cannot overflow 64 bits
+  auto it = buffers.find(ref.handle);
+  if ((it == buffers.end()) || (ref.offset >= it->second.size) || ((uint64_t)ref.offset + size > it->second.size))
+    return NULL;
+
+  return it->second.data + ref.offset;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// InternalStartJob() ////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t CSeqMatcherEmuDriver::InternalStartJob(const job_message & message)
+{
+  bool useMasks = (message.ambiguousMode != AMBIGUOUS_DISABLED);
+  uint64_t numDBEntries = message.numDBEntries;
+  uint64_t numSeqsSpecimen = message.numSeqsSpecimen;
+  uint64_t * seqsDB = (uint64_t *)InternalResolve(message.seqsDB, numDBEntries * sizeof(uint64_t));
+  uint64_t * seqsSpecimen = (uint64_t *)InternalResolve(message.seqsSpecimen, numSeqsSpecimen * sizeof(uint64_t));
+  uint8_t * lengthsDB = InternalResolve(message.lengthsDB, numDBEntries * sizeof(uint8_t));
+  uint8_t * lengthsSpecimen = InternalResolve(message.lengthsSpecimen, numSeqsSpecimen * sizeof(uint8_t));
+  int8_t * scores = (int8_t *)InternalResolve(message.scores, numDBEntries * numSeqsSpecimen * sizeof(int8_t));
+  uint32_t * masksDB = useMasks ? (uint32_t *)InternalResolve(message.masksDB, numDBEntries * sizeof(uint32_t)) : NULL;
+  uint32_t * masksSpecimen = useMasks ?
+    (uint32_t *)InternalResolve(message.masksSpecimen, numSeqsSpecimen * sizeof(uint32_t)) : NULL;
+
+  // The kernel module rejects the same jobs (seq_matcher_translate())
+  if ( (seqsDB == NULL) || (seqsSpecimen == NULL) || (lengthsDB == NULL) || (lengthsSpecimen == NULL) ||
+       (scores == NULL) || (useMasks && ((masksDB == NULL) || (masksSpecimen == NULL))) ) {
+    if (logging)
+      printf("Error: The job refers to a buffer that does not exist or is too small.\n");
+    return DEVICE_CALL_ERROR;
+  }
+
+  canceled = false;
+  worker = std::thread([=]() {
+    workerComparisons = SeqMatcher_CPU(engine, message.numDBEntries, message.numSeqsSpecimen, seqsDB, seqsSpecimen,
+                                       lengthsDB, lengthsSpecimen, masksDB, masksSpecimen, message.ambiguousMode,
+                                       scores, numThreads);
+    uint8_t done = 1;
+    if (write(completionPipe[1], &done, 1) != 1)
+      printf("Error: The emulator could not signal the end of a job.\n");
+  });
+
+  return OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// InternalCollectJob() ///////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+uint32_t CSeqMatcherEmuDriver::InternalCollectJob(uint32_t & numComparisons)
+{
+  worker.join();
+
+  // Consume the completion, so that Fd() is not readable until the next job finishes
+  uint8_t done;
+  int32_t readBytes;
+  do {
+    readBytes = read(completionPipe[0], &done, 1);
+  } while ((readBytes == -1) && (errno == EINTR));
+  if (readBytes != 1)
+    return DEVICE_CALL_ERROR;
+
+  if (canceled)
+    return JOB_CANCELED;
+
+  numComparisons = workerComparisons;
+  return OK;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// Cancel() //////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CSeqMatcherEmuDriver::Cancel(TJobHandle job)
+{
+  if (logging)
+    printf("CSeqMatcherEmuDriver::Cancel(job=%u)\n", job);
+
+  if ((job != lastJob) || !jobInFlight)
+    return false;
+
+  // The engine cannot be stopped, so the job runs to the end but its scores are discarded
+  canceled = true;
+  return true;
+}
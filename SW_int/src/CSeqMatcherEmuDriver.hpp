@@ -0,0 +1,50 @@
+#ifndef CSEQMATCHEREMUDRIVER_HPP
+#define CSEQMATCHEREMUDRIVER_HPP
+
+#include <stdint.h>
+#include <map>
+#include <thread>
+
+// Requires <stdint.h>, <map>, <thread>, "CAccelDriver.hpp", "CSeqMatcherDriver.hpp", "seqMatcherCPU.hpp"
+
+// Emulation of the accelerator on the CPU, behind the interface of CSeqMatcherDriver, so that the host pipeline can
+// run (and be profiled) without the board. The DMA buffers are ordinary page-aligned memory, and every job runs
+// on a worker thread with a CPU engine that is bit-exact with the bitstream (CPU_ENGINE_SW for the Smith-Waterman
+// accelerator, CPU_ENGINE_EDIT_DISTANCE for EDIT_DISTANCE_ENGINE), split among NumThreads threads. Fd() becomes
+// readable when the job finishes, as with the device. Protein bitstreams are not emulated, and jobs cannot time
+// out; a cancelled job still runs to the end, but Wait() returns JOB_CANCELED.
+
+class CSeqMatcherEmuDriver : public CSeqMatcherDriver {
+  protected:
+    struct TEmuBuffer {
+      uint8_t * data;
+      uint32_t size;
+    };
+
+    TCPUEngine engine;
+    uint32_t numThreads;
+    int completionPipe[2] = {-1, -1};       // The worker writes one byte when the job finishes
+    std::map<uint32_t, TEmuBuffer> buffers;  // Handle -> memory
+    uint32_t nextHandle = 1;
+    std::thread worker;
+    uint32_t workerComparisons = 0;
+    bool canceled = false;
+
+    virtual void * InternalMapBuffer(uint32_t Size, uint32_t Cacheable, TDMAMapping & Mapping);
+    virtual bool InternalUnmapBuffer(void * VirtAddr, const TDMAMapping & Mapping);
+    virtual uint32_t InternalStartJob(const job_message & message);
+    virtual uint32_t InternalCollectJob(uint32_t & numComparisons);
+    // Address of a buffer ref, or NULL if the size bytes from it are not inside a buffer
+    uint8_t * InternalResolve(const buffer_ref & ref, uint64_t size);
+
+  public:
+    CSeqMatcherEmuDriver(TCPUEngine Engine = CPU_ENGINE_SW, uint32_t NumThreads = 0, bool Logging = false);
+    virtual ~CSeqMatcherEmuDriver();
+
+    // There is no device file: driver_name is ignored.
+    virtual uint32_t Open(const char * driver_name, volatile void ** AccelRegsPointer = NULL);
+    virtual bool SetPollWindow(uint32_t Microseconds) { return driver != 0; }
+    virtual bool Cancel(TJobHandle job);
+};
+
+#endif  // CSEQMATCHEREMUDRIVER_HPP
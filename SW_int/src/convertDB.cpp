@@ -0,0 +1,55 @@
+// Converts a sequence file (one sequence per line, FASTA or FASTQ) into a packed DB.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <locale.h>
+#include "seqParser.hpp"
+#include "packedDB.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char ** argv)
+{
+  setlocale(LC_NUMERIC, "en_US.utf8");
+
+  if (argc != 3) {
+    printf("\nUsage: convertDB inputFile outputFile\n\n");
+    printf("Converts a sequence file (one sequence per line, FASTA or FASTQ) into a packed DB for seqMatcher.\n\n");
+    return -1;
+  }
+
+  uint32_t maxSeqs = CountLines(argv[1]);
+  if (maxSeqs == 0) {
+    printf("Error opening file [%s]\n", argv[1]);
+    return -1;
+  }
+
+  uint64_t * seqs = (uint64_t *)malloc(maxSeqs * sizeof(uint64_t));
+  uint32_t * masks = (uint32_t *)malloc(maxSeqs * sizeof(uint32_t));
+  uint8_t * lengths = (uint8_t *)malloc(maxSeqs * sizeof(uint8_t));
+  int res = -1;
+
+  if ((seqs == NULL) || (masks == NULL) || (lengths == NULL))
+    printf("Error allocating memory\n");
+  else {
+    uint32_t numSeqs = ParseSequenceFile(argv[1], seqs, masks, lengths, maxSeqs);
+
+    printf("Read %'u sequences from [%s]\n", numSeqs, argv[1]);
+    if ((numSeqs > 0) && WritePackedDB(argv[2], seqs, masks, lengths, numSeqs)) {
+      TPackedDBHeader header;
+
+      ReadPackedDBHeader(argv[2], header);
+      printf("Written [%s]. Length histogram:\n", argv[2]);
+      for (uint32_t length = 0; length <= PACKED_DB_MAX_LENGTH; ++ length)
+        if (header.lengthHistogram[length] > 0)
+          printf("  %2u: %'u\n", length, header.lengthHistogram[length]);
+      res = 0;
+    }
+  }
+
+  free(seqs);
+  free(masks);
+  free(lengths);
+  return res;
+}
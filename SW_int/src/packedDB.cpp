@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "packedDB.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+// 64-bit FNV-1a over 8-byte words (the payload sections are multiples of 8 bytes except the lengths).
+uint64_t PackedDBChecksum(const void * data, uint64_t size)
+{
+  const uint64_t FNV_PRIME = 0x100000001B3ULL;
+  const uint8_t * bytes = (const uint8_t *)data;
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  uint64_t iByte = 0;
+
+  for (; iByte + 8 <= size; iByte += 8) {
+    uint64_t word;
+    memcpy(&word, bytes + iByte, 8);
+    hash = (hash ^ word) * FNV_PRIME;
+  }
+  for (; iByte < size; ++ iByte)
+    hash = (hash ^ bytes[iByte]) * FNV_PRIME;
+
+  return hash;
+}
+
+static uint64_t PayloadSize(const TPackedDBHeader & header, uint32_t numSeqs)
+{
+  return (uint64_t)numSeqs * header.wordsPerSeq * sizeof(uint64_t) +
+         ((header.flags & PACKED_DB_HAS_MASKS) ? (uint64_t)numSeqs * sizeof(uint32_t) : 0) +
+         (uint64_t)numSeqs * sizeof(uint8_t);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool WritePackedDB(const char * fileName, const uint64_t * seqs, const uint32_t * masks, const uint8_t * lengths,
+    uint32_t numSeqs, uint32_t wordsPerSeq)
+{
+  TPackedDBHeader header;
+  FILE * output;
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PACKED_DB_MAGIC, sizeof(header.magic));
+  header.version = PACKED_DB_VERSION;
+  header.headerSize = sizeof(TPackedDBHeader);
+  header.numSeqs = numSeqs;
+  header.wordsPerSeq = wordsPerSeq;
+
+  // Masks are only stored if there is some ambiguous nucleobase
+  for (uint32_t iSeq = 0; (masks != NULL) && (iSeq < numSeqs); ++ iSeq)
+    if (masks[iSeq] != 0)
+      header.flags |= PACKED_DB_HAS_MASKS;
+
+  for (uint32_t iSeq = 0; iSeq < numSeqs; ++ iSeq)
+    ++ header.lengthHistogram[lengths[iSeq] <= PACKED_DB_MAX_LENGTH ? lengths[iSeq] : PACKED_DB_MAX_LENGTH];
+
+  // The checksum runs over the sections in file order
+  uint64_t seqsSize = (uint64_t)numSeqs * wordsPerSeq * sizeof(uint64_t);
+  uint64_t masksSize = (header.flags & PACKED_DB_HAS_MASKS) ? (uint64_t)numSeqs * sizeof(uint32_t) : 0;
+  uint8_t * payload = (uint8_t *)malloc(PayloadSize(header, numSeqs));
+
+  if (payload == NULL) {
+    printf("Error allocating memory for [%s]\n", fileName);
+    return false;
+  }
+  memcpy(payload, seqs, seqsSize);
+  if (masksSize > 0)
+    memcpy(payload + seqsSize, masks, masksSize);
+  memcpy(payload + seqsSize + masksSize, lengths, numSeqs);
+  header.checksum = PackedDBChecksum(payload, PayloadSize(header, numSeqs));
+
+  bool res = false;
+  if ( (output = fopen(fileName, "wb")) == NULL )
+    printf("Error opening file [%s]\n", fileName);
+  else {
+    res = (fwrite(&header, sizeof(header), 1, output) == 1) &&
+          (fwrite(payload, 1, PayloadSize(header, numSeqs), output) == PayloadSize(header, numSeqs));
+    if (!res)
+      printf("Error writing file [%s]\n", fileName);
+    fclose(output);
+  }
+
+  free(payload);
+  return res;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool ReadPackedDBHeader(const char * fileName, TPackedDBHeader & header)
+{
+  FILE * input = fopen(fileName, "rb");
+  bool res;
+
+  if (input == NULL)
+    return false;
+  res = (fread(&header, sizeof(header), 1, input) == 1) &&
+        (memcmp(header.magic, PACKED_DB_MAGIC, sizeof(header.magic)) == 0);
+  fclose(input);
+
+  return res;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint32_t LoadPackedDB(const char * fileName, uint64_t * seqs, uint32_t * masks, uint8_t * lengths,
+    uint32_t maxSeqs, uint32_t wordsPerSeq)
+{
+  int fd = open(fileName, O_RDONLY);
+  struct stat fileStat;
+
+  if ((fd == -1) || (fstat(fd, &fileStat) != 0) || ((uint64_t)fileStat.st_size < sizeof(TPackedDBHeader))) {
+    printf("Error opening packed DB [%s]\n", fileName);
+    if (fd != -1)
+      close(fd);
+    return 0;
+  }
+
+  const uint8_t * data = (const uint8_t *)mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Error mapping packed DB [%s]\n", fileName);
+    return 0;
+  }
+
+  TPackedDBHeader header;
+  uint32_t numLoaded = 0;
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.magic, PACKED_DB_MAGIC, sizeof(header.magic)) != 0)
+    printf("[%s] is not a packed DB\n", fileName);
+  else if (header.version != PACKED_DB_VERSION)
+    printf("Unsupported packed DB version %u in [%s]\n", header.version, fileName);
+  else if (header.wordsPerSeq != wordsPerSeq)
+    printf("Packed DB [%s] has %u words per sequence instead of %u\n", fileName, header.wordsPerSeq, wordsPerSeq);
+  else if ((uint64_t)fileStat.st_size < header.headerSize + PayloadSize(header, header.numSeqs))
+    printf("Packed DB [%s] is truncated\n", fileName);
+  else if (PackedDBChecksum(data + header.headerSize, PayloadSize(header, header.numSeqs)) != header.checksum)
+    printf("Checksum error in packed DB [%s]\n", fileName);
+  else {
+    const uint8_t * section = data + header.headerSize;
+
+    numLoaded = ((maxSeqs == 0) || (header.numSeqs < maxSeqs)) ? header.numSeqs : maxSeqs;
+
+    memcpy(seqs, section, (uint64_t)numLoaded * wordsPerSeq * sizeof(uint64_t));
+    section += (uint64_t)header.numSeqs * wordsPerSeq * sizeof(uint64_t);
+
+    if (header.flags & PACKED_DB_HAS_MASKS) {
+      if (masks != NULL)
+        memcpy(masks, section, (uint64_t)numLoaded * sizeof(uint32_t));
+      section += (uint64_t)header.numSeqs * sizeof(uint32_t);
+    }
+    else if (masks != NULL)
+      memset(masks, 0, (uint64_t)numLoaded * sizeof(uint32_t));
+
+    memcpy(lengths, section, numLoaded);
+  }
+
+  munmap((void *)data, fileStat.st_size);
+  return numLoaded;
+}
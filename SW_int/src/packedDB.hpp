@@ -0,0 +1,59 @@
+#ifndef PACKEDDB_HPP
+#define PACKEDDB_HPP
+
+// Requires <stdint.h>
+
+// Binary container of pre-packed sequences, laid out like the buffers of the accelerator so that it can be loaded
+// with bulk copies instead of parsing text:
+//   TPackedDBHeader
+//   uint64_t seqs[numSeqs * wordsPerSeq]    Packed sequences (2-bit nucleobases, or residues in protein mode)
+//   uint32_t masks[numSeqs]                 Ambiguity masks, only if PACKED_DB_HAS_MASKS
+//   uint8_t lengths[numSeqs]
+// The checksum covers everything after the header. Shared by the host program, genSequenceFiles and convertDB.
+
+#define PACKED_DB_MAGIC "SEQMATDB"
+#define PACKED_DB_VERSION 1
+#define PACKED_DB_MAX_LENGTH 32
+
+#define PACKED_DB_HAS_MASKS 0x1
+
+struct TPackedDBHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t headerSize;      // Offset of the payload
+  uint32_t numSeqs;
+  uint32_t wordsPerSeq;     // 64-bit words per sequence (1 for nucleobases)
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t checksum;
+  uint32_t lengthHistogram[PACKED_DB_MAX_LENGTH + 1];  // Number of sequences of every length
+  uint32_t padding;
+};
+
+// 2-bit code of a nucleobase in the accelerator (A = 0, T = 1, G = 2, C = 3). Returns false for other characters.
+inline bool PackedDBNucleobaseCode(char c, uint8_t & code)
+{
+  switch (c) {
+  case 'A': case 'a': code = 0; return true;
+  case 'T': case 't': code = 1; return true;
+  case 'G': case 'g': code = 2; return true;
+  case 'C': case 'c': code = 3; return true;
+  }
+  return false;
+}
+
+uint64_t PackedDBChecksum(const void * data, uint64_t size);
+
+// Writes a packed DB. masks can be NULL when there are no ambiguous nucleobases.
+bool WritePackedDB(const char * fileName, const uint64_t * seqs, const uint32_t * masks, const uint8_t * lengths,
+    uint32_t numSeqs, uint32_t wordsPerSeq = 1);
+
+// Reads the header. Returns false (silently) if the file is not a packed DB.
+bool ReadPackedDBHeader(const char * fileName, TPackedDBHeader & header);
+
+// Loads the first maxSeqs sequences (all of them if maxSeqs == 0) into the given buffers and checks the checksum.
+// masks can be NULL. Returns the number of sequences loaded, 0 on error.
+uint32_t LoadPackedDB(const char * fileName, uint64_t * seqs, uint32_t * masks, uint8_t * lengths,
+    uint32_t maxSeqs, uint32_t wordsPerSeq = 1);
+
+#endif // PACKEDDB_HPP
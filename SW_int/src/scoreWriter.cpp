@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+#include "scoreWriter.hpp"
+#include "trace.hpp"
+
+#define BLOCK_ALIGNMENT 4096
+
+///////////////////////////////////////////////////////////////////////////////
+void CopyFromUncached(void * dest, const void * src, uint32_t size)
+{
+  uint8_t * d = (uint8_t *)dest;
+  const uint8_t * s = (const uint8_t *)src;
+
+#ifdef __ARM_NEON
+  // Every uncached load is a bus transaction, so each one moves 64 bytes
+  for (; size >= 64; size -= 64, s += 64, d += 64) {
+    uint8x16_t data0 = vld1q_u8(s);
+    uint8x16_t data1 = vld1q_u8(s + 16);
+    uint8x16_t data2 = vld1q_u8(s + 32);
+    uint8x16_t data3 = vld1q_u8(s + 48);
+    vst1q_u8(d, data0);
+    vst1q_u8(d + 16, data1);
+    vst1q_u8(d + 32, data2);
+    vst1q_u8(d + 48, data3);
+  }
+#endif
+
+  memcpy(d, s, size);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////////// CScoreWriter() ///////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CScoreWriter::CScoreWriter(uint32_t BlockSize, uint32_t MaxBlocks)
+  : blockSize(BlockSize), maxBlocks(MaxBlocks)
+{
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////// ~CScoreWriter() ///////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CScoreWriter::~CScoreWriter()
+{
+  if (file != -1)
+    Close();
+
+  for (TBlock * block : freeBlocks) {
+    free(block->data);
+    delete block;
+  }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// Open() ////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CScoreWriter::Open(const char * fileName)
+{
+  if (file != -1)
+    return false;
+
+  if ( (file = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1 ) {
+    printf("Error opening file [%s]\n", fileName);
+    return false;
+  }
+
+  closing = false;
+  error = false;
+  writer = std::thread(&CScoreWriter::WriterThread, this);
+
+  return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// Write() ///////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CScoreWriter::Write(const int8_t * scores, uint32_t numScores)
+{
+  TRACE_SCOPE("Copy scores");
+  if (file == -1)
+    return false;
+
+  while (numScores > 0) {
+    if (current == NULL) {
+      if ( (current = GetFreeBlock()) == NULL )
+        return false;
+      current->size = 0;
+    }
+
+    uint32_t toCopy = blockSize - current->size;
+    if (toCopy > numScores)
+      toCopy = numScores;
+
+    CopyFromUncached(current->data + current->size, scores, toCopy);
+    current->size += toCopy;
+    scores += toCopy;
+    numScores -= toCopy;
+
+    if (current->size == blockSize) {
+      std::lock_guard<std::mutex> guard(lock);
+      queuedBlocks.push_back(current);
+      current = NULL;
+      blockQueued.notify_one();
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  return !error;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////// Close() ///////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+bool CScoreWriter::Close()
+{
+  if (file == -1)
+    return false;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    if (current != NULL)
+      queuedBlocks.push_back(current);
+    current = NULL;
+    closing = true;
+    blockQueued.notify_one();
+  }
+
+  {
+    TRACE_SCOPE("Wait for the score writer");
+    writer.join();
+  }
+
+  if (close(file) != 0)
+    error = true;
+  file = -1;
+
+  if (error)
+    printf("Error writing scores.\n");
+  return !error;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////////// GetFreeBlock() ///////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+// Reuses a written block, allocates a new one or, when maxBlocks are queued, waits for the writer thread.
+CScoreWriter::TBlock * CScoreWriter::GetFreeBlock()
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  if (freeBlocks.empty() && (numBlocks < maxBlocks)) {
+    TBlock * block = new TBlock;
+    if (posix_memalign((void **)&block->data, BLOCK_ALIGNMENT, blockSize) != 0) {
+      printf("Error allocating %u bytes for the score writer.\n", blockSize);
+      delete block;
+      return NULL;
+    }
+    ++ numBlocks;
+    return block;
+  }
+
+  blockFreed.wait(guard, [this]() { return !freeBlocks.empty(); });
+  TBlock * block = freeBlocks.front();
+  freeBlocks.pop_front();
+  return block;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////////// WriterThread() ///////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+void CScoreWriter::WriterThread()
+{
+  std::unique_lock<std::mutex> guard(lock);
+
+  while (true) {
+    blockQueued.wait(guard, [this]() { return closing || !queuedBlocks.empty(); });
+    if (queuedBlocks.empty())
+      break;
+
+    TBlock * block = queuedBlocks.front();
+    queuedBlocks.pop_front();
+    // After an error the remaining blocks are only recycled, so that Write() never blocks
+    bool ok = !error;
+    guard.unlock();
+
+    {
+      TRACE_SCOPE("Write scores block");
+      for (uint32_t written = 0; ok && (written < block->size); ) {
+        ssize_t res = write(file, block->data + written, block->size - written);
+        if ((res < 0) && (errno == EINTR))
+          continue;
+        if (res <= 0)
+          ok = false;
+        else
+          written += res;
+      }
+    }
+
+    guard.lock();
+    if (!ok)
+      error = true;
+    freeBlocks.push_back(block);
+    blockFreed.notify_one();
+  }
+}
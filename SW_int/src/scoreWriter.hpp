@@ -0,0 +1,55 @@
+#ifndef SCOREWRITER_HPP
+#define SCOREWRITER_HPP
+
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+// Requires <stdint.h>, <deque>, <mutex>, <thread>, <condition_variable>
+
+// Asynchronous writer of score files. Write() copies the scores out of the DMA buffer with wide (NEON) loads into
+// page-aligned blocks and returns as soon as the source buffer can be reused; a background thread writes the full
+// blocks to the file with large write() calls, so writing the file overlaps with the next computations. The wide
+// loads matter most with non-cacheable DMA buffers (--uncached), where reading byte by byte is very slow.
+
+#define SCORE_WRITER_BLOCK_SIZE (1 << 20)
+#define SCORE_WRITER_MAX_BLOCKS 64
+
+// Copies size bytes from non-cacheable memory with 64-byte loads
+void CopyFromUncached(void * dest, const void * src, uint32_t size);
+
+class CScoreWriter {
+  protected:
+    struct TBlock {
+      uint8_t * data;
+      uint32_t size;
+    };
+
+    int file = -1;
+    uint32_t blockSize, maxBlocks, numBlocks = 0;
+    TBlock * current = NULL;
+    std::deque<TBlock *> queuedBlocks, freeBlocks;
+    std::mutex lock;
+    std::condition_variable blockQueued, blockFreed;
+    std::thread writer;
+    bool closing = false, error = false;
+
+    void WriterThread();
+    TBlock * GetFreeBlock();
+
+  public:
+    CScoreWriter(uint32_t BlockSize = SCORE_WRITER_BLOCK_SIZE, uint32_t MaxBlocks = SCORE_WRITER_MAX_BLOCKS);
+    virtual ~CScoreWriter();
+
+    // Creates the file and starts the writer thread.
+    bool Open(const char * fileName);
+    // Copies the scores and queues them to be written. The scores buffer can be reused when it returns; it only
+    // waits for the writer thread when MaxBlocks blocks are already queued.
+    bool Write(const int8_t * scores, uint32_t numScores);
+    // Writes the remaining blocks and closes the file. Returns false if any write failed.
+    bool Close();
+};
+
+#endif // SCOREWRITER_HPP
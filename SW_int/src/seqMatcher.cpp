@@ -3,16 +3,30 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <time.h>
 #include <stdint.h>
 #include <inttypes.h>
 #include <locale.h>
 #include <assert.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <map>
+#include <thread>
+#include <string>
+#include <vector>
+#include <algorithm>
 #include "util.hpp"
 
 #include "CAccelDriver.hpp"
 #include "CSeqMatcherDriver.hpp"
+#include "seqMatcherCPU.hpp"
+#include "CSeqMatcherEmuDriver.hpp"
+#include "seqParser.hpp"
+#include "packedDB.hpp"
+#include "scoreWriter.hpp"
+#include "trace.hpp"
 
 #define NUM_CORES_IN_SYSTEM 2
 
@@ -24,15 +38,41 @@ typedef int8_t TPathMatrix[MAX_SEQ_LENGTH+1][MAX_SEQ_LENGTH+1];
 
 const char* DRIVER_NAME = "/dev/seq_matcher";
 
+// Split execution (--split): measured throughputs (comparisons/s) of the accelerator and the CPU engine are kept
+// in this file between runs to size the CPU slice (--split-rates=file, by default in the XDG state directory of the
+// user). The accelerator rate is a rough estimate until the first split run.
+const char* SPLIT_RATES_FILE = "seqMatcher_rates";
+const char * splitRatesFile = NULL;
+const double DEFAULT_HW_RATE = 60e6;
+// DB entries scored by the CPU before starting the accelerator, to measure the current CPU rate
+#define SPLIT_PROBE_ENTRIES 64
+
+// DMA buffers are cacheable, with the cache maintenance done by the kernel module around each job. --uncached
+// allocates them non-cacheable (coherent), without cache maintenance.
+uint32_t dmaCacheable = 1;
+// Busy-poll window of the kernel module before sleeping until the interrupt (--poll-us)
+uint32_t pollWindowUs = 0;
+// Time limit of each job (--timeout-ms), 0 for the default of the kernel module
+uint32_t jobTimeoutMs = 0;
+// Engine that emulates the accelerator on the CPU (--backend=emu), or CPU_ENGINE_NONE to use the device
+TCPUEngine emuEngine = CPU_ENGINE_NONE;
+// Chrome trace-event file of the timing of the phases (--trace), NULL when they are not traced
+const char * traceFile = NULL;
+
+// Chunked execution (--chunk=N): buffer sets rotating through the parse, accelerate and write stages
+#define NUM_CHUNK_BUFFERS 3
+
 ///////////////////////////////////////////////////////////////////////////////
-bool InitDevice(CSeqMatcherDriver & seqMatcher, uint32_t numDBEntries, uint32_t numSeqsSpecimen,
-    uint64_t * &seqsDB, uint64_t * &seqsSpecimen,
-    uint8_t * &lengthsDB, uint8_t * &lengthsSpecimen, int8_t * &scores, bool log=true)
+bool OpenDevice(CSeqMatcherDriver & seqMatcher, bool log=true)
 {
-  printf("\n\nThis program requires that the bitstream is loaded in the FPGA.\n");
-  printf("This program has to be run with sudo.\n");
-  printf("Press ENTER to confirm that the bitstream is loaded (proceeding without it can crash the board).\n\n");
-  getchar();
+  if (emuEngine != CPU_ENGINE_NONE)
+    printf("Emulating the accelerator on the CPU.\n");
+  else {
+    printf("\n\nThis program requires that the bitstream is loaded in the FPGA.\n");
+    printf("This program has to be run with sudo.\n");
+    printf("Press ENTER to confirm that the bitstream is loaded (proceeding without it can crash the board).\n\n");
+    getchar();
+  }
 
   if ( seqMatcher.Open(DRIVER_NAME) != CAccelDriver::OK ) {
     printf("Error opening the device driver %s", DRIVER_NAME);
@@ -43,28 +83,98 @@ bool InitDevice(CSeqMatcherDriver & seqMatcher, uint32_t numDBEntries, uint32_t
   if (log)
     printf("Device driver %s succesfully open\n\n", DRIVER_NAME);
 
+  if ((pollWindowUs > 0) && !seqMatcher.SetPollWindow(pollWindowUs))
+    printf("Warning: cannot set the busy-poll window, waiting for the interrupts.\n");
+  seqMatcher.SetJobTimeout(jobTimeoutMs);
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Space taken by a buffer in the DMA arena
+uint32_t ArenaBlockSize(uint32_t size)
+{
+  return (size == 0) ? DMA_ARENA_ALIGNMENT : (size + DMA_ARENA_ALIGNMENT - 1) & ~(DMA_ARENA_ALIGNMENT - 1);
+}
+
+// All the DMA buffers of a run are sub-allocated from one arena. If the CMA memory is too fragmented for it, they
+// are allocated one by one.
+void CreateArena(CSeqMatcherDriver & seqMatcher, uint32_t size)
+{
+  if (!seqMatcher.CreateDMAArena(size, dmaCacheable))
+    printf("Warning: cannot allocate a DMA arena of %'u bytes, allocating each buffer separately.\n", size);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool InitDevice(CSeqMatcherDriver & seqMatcher, uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    uint64_t * &seqsDB, uint64_t * &seqsSpecimen,
+    uint8_t * &lengthsDB, uint8_t * &lengthsSpecimen, uint32_t * &masksDB, uint32_t * &masksSpecimen,
+    int8_t * &scores, uint32_t wordsPerSeq = 1, bool log=true)
+{
+  if (!OpenDevice(seqMatcher, log))
+    return false;
+
+  TRACE_SCOPE("InitDevice");
+
   // Allocate DMA memory for use by the device. We receive addresses in the *virtual* address space of the application.
   if (log)
     printf("Allocating DMA memory...\n");
 
-  seqsDB = (uint64_t *)seqMatcher.AllocDMACompatible(numDBEntries*sizeof(uint64_t));
-  lengthsDB = (uint8_t *)seqMatcher.AllocDMACompatible(numDBEntries*sizeof(uint8_t));
-  seqsSpecimen = (uint64_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen*sizeof(uint64_t));
-  lengthsSpecimen = (uint8_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen*sizeof(uint8_t));
-  scores = (int8_t *)seqMatcher.AllocDMACompatible(numDBEntries*numSeqsSpecimen*sizeof(int8_t));
+  CreateArena(seqMatcher, ArenaBlockSize(numDBEntries*wordsPerSeq*sizeof(uint64_t)) +
+                          ArenaBlockSize(numDBEntries*sizeof(uint8_t)) +
+                          ArenaBlockSize(numSeqsSpecimen*wordsPerSeq*sizeof(uint64_t)) +
+                          ArenaBlockSize(numSeqsSpecimen*sizeof(uint8_t)) +
+                          ArenaBlockSize(numDBEntries*sizeof(uint32_t)) +
+                          ArenaBlockSize(numSeqsSpecimen*sizeof(uint32_t)) +
+                          ArenaBlockSize(numDBEntries*numSeqsSpecimen*sizeof(int8_t)));
+
+  seqsDB = (uint64_t *)seqMatcher.AllocDMACompatible(numDBEntries*wordsPerSeq*sizeof(uint64_t), dmaCacheable);
+  lengthsDB = (uint8_t *)seqMatcher.AllocDMACompatible(numDBEntries*sizeof(uint8_t), dmaCacheable);
+  seqsSpecimen = (uint64_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen*wordsPerSeq*sizeof(uint64_t), dmaCacheable);
+  lengthsSpecimen = (uint8_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen*sizeof(uint8_t), dmaCacheable);
+  masksDB = (uint32_t *)seqMatcher.AllocDMACompatible(numDBEntries*sizeof(uint32_t), dmaCacheable);
+  masksSpecimen = (uint32_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen*sizeof(uint32_t), dmaCacheable);
+  scores = (int8_t *)seqMatcher.AllocDMACompatible(numDBEntries*numSeqsSpecimen*sizeof(int8_t), dmaCacheable);
 
-  if ( (seqsDB == NULL) || (lengthsDB == NULL) || (seqsSpecimen == NULL) || (lengthsSpecimen == NULL) || (scores == NULL) ) {
+  if ( (seqsDB == NULL) || (lengthsDB == NULL) || (seqsSpecimen == NULL) || (lengthsSpecimen == NULL) ||
+       (masksDB == NULL) || (masksSpecimen == NULL) || (scores == NULL) ) {
     printf("Error allocating DMA memory.\n");
     return false;
   }
  
   if (log) {
     printf("DMA memory allocated.\n");
-    printf("seqsDB: Virtual address: 0x%08X (%u)\n", (uint32_t)seqsDB, (uint32_t)seqsDB);
-    printf("lengthsDB: Virtual address: 0x%08X (%u)\n", (uint32_t)lengthsDB, (uint32_t)lengthsDB);
-    printf("seqsSpecimen: Virtual address: 0x%08X (%u)\n", (uint32_t)seqsSpecimen, (uint32_t)seqsSpecimen);
-    printf("lengthsSpecimen: Virtual address: 0x%08X (%u)\n", (uint32_t)lengthsSpecimen, (uint32_t)lengthsSpecimen);
-    printf("scores: Virtual address: 0x%08X (%u)\n", (uint32_t)scores, (uint32_t)scores);
+    printf("seqsDB: Virtual address: %p\n", (void *)seqsDB);
+    printf("lengthsDB: Virtual address: %p\n", (void *)lengthsDB);
+    printf("seqsSpecimen: Virtual address: %p\n", (void *)seqsSpecimen);
+    printf("lengthsSpecimen: Virtual address: %p\n", (void *)lengthsSpecimen);
+    printf("masksDB: Virtual address: %p\n", (void *)masksDB);
+    printf("masksSpecimen: Virtual address: %p\n", (void *)masksSpecimen);
+    printf("scores: Virtual address: %p\n", (void *)scores);
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Allocates the data arrays in regular memory, for the CPU engines (the device is not used).
+bool InitHostBuffers(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    uint64_t * &seqsDB, uint64_t * &seqsSpecimen,
+    uint8_t * &lengthsDB, uint8_t * &lengthsSpecimen, uint32_t * &masksDB, uint32_t * &masksSpecimen,
+    int8_t * &scores)
+{
+  seqsDB = (uint64_t *)malloc(numDBEntries*sizeof(uint64_t));
+  lengthsDB = (uint8_t *)malloc(numDBEntries*sizeof(uint8_t));
+  seqsSpecimen = (uint64_t *)malloc(numSeqsSpecimen*sizeof(uint64_t));
+  lengthsSpecimen = (uint8_t *)malloc(numSeqsSpecimen*sizeof(uint8_t));
+  masksDB = (uint32_t *)malloc(numDBEntries*sizeof(uint32_t));
+  masksSpecimen = (uint32_t *)malloc(numSeqsSpecimen*sizeof(uint32_t));
+  scores = (int8_t *)malloc(numDBEntries*numSeqsSpecimen*sizeof(int8_t));
+
+  if ( (seqsDB == NULL) || (lengthsDB == NULL) || (seqsSpecimen == NULL) || (lengthsSpecimen == NULL) ||
+       (masksDB == NULL) || (masksSpecimen == NULL) || (scores == NULL) ) {
+    printf("Error allocating memory.\n");
+    return false;
   }
 
   return true;
@@ -89,97 +199,127 @@ const uint8_t NB_T = 1;
 const uint8_t NB_G = 2;
 const uint8_t NB_C = 3;
 
+// Protein mode (requires the bitstream synthesized with PROTEIN_MODE): residues are encoded as their index in
+// RESIDUE_ALPHABET (5 bits) and packed RESIDUES_PER_WORD per 64-bit word.
+const char RESIDUE_ALPHABET[] = "ARNDCQEGHILKMFPSTWYVBZX*";
+#define RESIDUES_PER_WORD 12
+#define PROTEIN_WORDS_PER_SEQ 3
+
 // Splits an uint8 into the 4 nucleobases it contains (each nucleobase is two bits)
 inline uint8_t joinNucleobasesToUint8(uint8_t in[4]) {
 	return ((in[0] & 0b11) << 6) | ((in[1] & 0b11) << 4) | ((in[2] & 0b11) << 2) | (in[3] & 0b11);
 }
 
-uint8_t compressNucleoBase(char c) {
-	if (c == 'A') {
-		return NB_A;
-	} else if (c == 'T') {
-		return NB_T;
-	} else if (c == 'G') {
-		return NB_G;
-	} else if (c == 'C') {
-		return NB_C;
+// Compresses a nucleobase into its 2-bit code. Ambiguous IUPAC codes (N, R, Y, ...) are stored as NB_A and flagged
+// through 'ambiguous', so that the accelerator can score them as a mismatch or as a wildcard.
+// Returns false if the character is not a nucleobase.
+bool compressNucleoBase(char c, uint8_t & nbase, bool & ambiguous) {
+	ambiguous = false;
+
+	switch (toupper(c)) {
+	case 'A': nbase = NB_A; return true;
+	case 'T': nbase = NB_T; return true;
+	case 'G': nbase = NB_G; return true;
+	case 'C': nbase = NB_C; return true;
+	case 'N': case 'R': case 'Y': case 'S': case 'W': case 'K':
+	case 'M': case 'B': case 'D': case 'H': case 'V':
+		nbase = NB_A;
+		ambiguous = true;
+		return true;
 	}
 
-	// Shouldn't find any other letter
-	assert(false);
+	return false;
+}
+
+// Compresses an amino acid into its 5-bit code. Returns false if the character is not an amino acid.
+bool compressResidue(char c, uint8_t & residue) {
+  const char * pos = (c != '\0') ? strchr(RESIDUE_ALPHABET, toupper(c)) : NULL;
+
+  if (pos == NULL)
+    return false;
+
+  residue = pos - RESIDUE_ALPHABET;
+  return true;
 }
 
-uint32_t ReadLines(uint64_t* dest, uint8_t* lengths, const char * fileName, uint32_t numLines)
+// Reads up to numLines protein sequences, one per line, from an open file. Every sequence takes
+// PROTEIN_WORDS_PER_SEQ words of dest. firstLine is only used to report errors. It stops at the first line with an
+// invalid residue and sets invalid, so that a parse error is not mistaken for the end of the file.
+uint32_t ReadProteinLinesFromStream(FILE * input, const char * fileName, uint32_t firstLine,
+    uint64_t* dest, uint8_t* lengths, uint32_t numLines, bool & invalid)
 {
-  FILE * input;
+  TRACE_SCOPE("ReadProteinLines");
   uint32_t readLines = 0;
 
-  if ( (input = fopen(fileName, "rt")) == NULL ) {
-    printf("Error opening file [%s]\n", fileName);
-    return 0;
-  }
+  invalid = false;
 
   for (readLines = 0; readLines < numLines; ++ readLines) {
     char line[MAX_SEQ_LENGTH+2];  // + newline + NULL
     if (fgets(line, MAX_SEQ_LENGTH+2, input) == NULL)
       break;
     uint32_t lineSize = strlen(line);
-    uint32_t iChar;
-
     uint8_t length = 0;
-    uint64_t seq = 0;
 
-    for (iChar = 0; (iChar < lineSize) && (iChar < MAX_SEQ_LENGTH); ++ iChar) {
-      if (line[iChar] != '\n') {  // New lines are included in the string by fgets
+    for (uint32_t iWord = 0; iWord < PROTEIN_WORDS_PER_SEQ; ++ iWord)
+      dest[iWord] = 0;
 
-    	uint8_t nbase = compressNucleoBase(line[iChar]) & 0b11;
-    	seq |= uint64_t(nbase) << (2 * iChar);
+    for (uint32_t iChar = 0; (iChar < lineSize) && (iChar < MAX_SEQ_LENGTH); ++ iChar) {
+      if ((line[iChar] != '\n') && (line[iChar] != '\r')) {
+        uint8_t residue;
 
+        if (!compressResidue(line[iChar], residue)) {
+          printf("Invalid amino acid '%c' in line %u of [%s]\n", line[iChar], firstLine + readLines + 1, fileName);
+          invalid = true;
+          return readLines;
+        }
+
+        dest[length / RESIDUES_PER_WORD] |= uint64_t(residue) << (5 * (length % RESIDUES_PER_WORD));
         ++length;
       }
     }
 
-    *dest++ = seq;
+    dest += PROTEIN_WORDS_PER_SEQ;
     *lengths++ = length;
   }
 
-  fclose(input);
   return readLines;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-bool DumpScores(int8_t * scores, uint32_t numScores, const char * fileName)
+uint32_t ReadProteinLines(uint64_t* dest, uint8_t* lengths, const char * fileName, uint32_t numLines)
 {
-  FILE * output;
+  FILE * input;
 
-  if ( (output = fopen(fileName, "wb")) == NULL ) {
+  if ( (input = fopen(fileName, "rt")) == NULL ) {
     printf("Error opening file [%s]\n", fileName);
-    return false;
+    return 0;
   }
 
-  // Using I/O functions on non-cacheable memory can give trouble.
-  /*if ( fwrite(scores, sizeof(int8_t), numScores, output) != numScores ) {
-    printf("Error writing scores.\n");
-    return false;
-  }*/
-
-  for (uint32_t iScore = 0; iScore < numScores; ++ iScore) {
-    int8_t score = scores[iScore];
-    if ( fwrite(&score, sizeof(int8_t), 1, output) != 1 ) {
-      printf("Error writing scores.\n");
-      return false;
-    }
-  }
+  bool invalid;
+  uint32_t readLines = ReadProteinLinesFromStream(input, fileName, 0, dest, lengths, numLines, invalid);
 
-  fclose(output);
-  return true;
+  fclose(input);
+  return invalid ? 0 : readLines;
 }
 
+// Reads up to numSeqs sequences of a packed DB or of a text file (nucleobases or proteins). Returns the number of
+// sequences read, or 0 on error (including a sequence with an invalid character).
+uint32_t ReadSequences(const char * fileName, bool protein, uint32_t numThreads,
+    uint64_t * seqs, uint32_t * masks, uint8_t * lengths, uint32_t numSeqs)
+{
+  TPackedDBHeader packedHeader;
+
+  return ReadPackedDBHeader(fileName, packedHeader) ?
+    LoadPackedDB(fileName, seqs, masks, lengths, numSeqs, protein ? PROTEIN_WORDS_PER_SEQ : 1) :
+    protein ?
+    ReadProteinLines(seqs, lengths, fileName, numSeqs) :
+    ParseSequenceFile(fileName, seqs, masks, lengths, numSeqs, numThreads);
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 uint32_t SeqMatcher_HW(CSeqMatcherDriver * seqMatcher,
     uint32_t numDBEntries, uint32_t numSeqsSpecimen,
     uint64_t * seqsDB, uint64_t * seqsSpecimen, uint8_t * lengthsDB, uint8_t * lengthsSpecimen,
+    uint32_t * masksDB, uint32_t * masksSpecimen, uint32_t ambiguousMode,
     int8_t * scores, uint64_t & elapsedTime, double & cpuUtilization)
 {
   struct timespec start, end;
@@ -188,7 +328,38 @@ uint32_t SeqMatcher_HW(CSeqMatcherDriver * seqMatcher,
 
   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, & startCPUTime);
   clock_gettime(CLOCK_MONOTONIC_RAW, &start);
-  seqMatcher->SeqMatcher_HW(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen, scores, numComparisons);
+  uint32_t status = seqMatcher->SeqMatcher_HW(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+                                              scores, numComparisons, masksDB, masksSpecimen, ambiguousMode);
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, & endCPUTime);
+  elapsedTime = CalcTimeDiff(end, start);
+  cpuUtilization = (double)CalcTimeDiff(endCPUTime, startCPUTime) / elapsedTime;
+
+  // A job that timed out or failed has no scores
+  if (status != CAccelDriver::OK) {
+    printf("Error: the accelerator job failed (%s).\n", (status == CAccelDriver::JOB_TIMEOUT) ? "timeout" : "device error");
+    return 0;
+  }
+
+  return numComparisons;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+uint32_t SeqMatcher_CPU(TCPUEngine engine, uint32_t numThreads,
+    uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    uint64_t * seqsDB, uint64_t * seqsSpecimen, uint8_t * lengthsDB, uint8_t * lengthsSpecimen,
+    uint32_t * masksDB, uint32_t * masksSpecimen, uint32_t ambiguousMode,
+    int8_t * scores, uint64_t & elapsedTime, double & cpuUtilization)
+{
+  struct timespec start, end;
+  struct timespec startCPUTime, endCPUTime;
+  uint32_t numComparisons;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, & startCPUTime);
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+  numComparisons = SeqMatcher_CPU(engine, numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+                                  masksDB, masksSpecimen, ambiguousMode, scores, numThreads);
   clock_gettime(CLOCK_MONOTONIC_RAW, &end);
   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, & endCPUTime);
   elapsedTime = CalcTimeDiff(end, start);
@@ -198,6 +369,703 @@ uint32_t SeqMatcher_HW(CSeqMatcherDriver * seqMatcher,
 }
 
 
+///////////////////////////////////////////////////////////////////////////////
+// File of the split rates: --split-rates, or $XDG_STATE_HOME/seqMatcher_rates ($HOME/.local/state by default).
+// create makes the default state directory if it does not exist. Empty if there is no home directory.
+std::string SplitRatesFile(bool create)
+{
+  const char * stateHome = getenv("XDG_STATE_HOME");
+  const char * home = getenv("HOME");
+  std::string dir;
+
+  if (splitRatesFile != NULL)
+    return splitRatesFile;
+
+  if ((stateHome != NULL) && (stateHome[0] == '/'))
+    dir = stateHome;
+  else if ((home != NULL) && (home[0] != '\0')) {
+    dir = std::string(home) + "/.local";
+    if (create)
+      mkdir(dir.c_str(), 0700);
+    dir += "/state";
+  }
+  else
+    return "";
+
+  if (create)
+    mkdir(dir.c_str(), 0700);
+  return dir + "/" + SPLIT_RATES_FILE;
+}
+
+void LoadSplitRates(double & hwRate, double & cpuRate)
+{
+  std::string fileName = SplitRatesFile(false);
+  FILE * input = fileName.empty() ? NULL : fopen(fileName.c_str(), "rt");
+
+  hwRate = DEFAULT_HW_RATE;
+  cpuRate = 0;
+  if (input == NULL)
+    return;
+  if (fscanf(input, "%lf %lf", &hwRate, &cpuRate) != 2)
+    hwRate = DEFAULT_HW_RATE;
+  fclose(input);
+}
+
+void SaveSplitRates(double hwRate, double cpuRate)
+{
+  std::string fileName = SplitRatesFile(true);
+  FILE * output = fileName.empty() ? NULL : fopen(fileName.c_str(), "wt");
+
+  if (output == NULL)
+    return;
+  fprintf(output, "%lf %lf\n", hwRate, cpuRate);
+  fclose(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Splits the DB between the accelerator and the CPU: the accelerator scores the first DB entries (its buffers have
+// to start at the base of the DMA allocations) while a CPU engine scores a tail slice into the same score matrix.
+// The slice is sized so that both finish at the same time, from the accelerator rate measured in previous runs and
+// the CPU rate measured on a small probe of the tail. engine must compute the same scores as the accelerator. A failed
+// accelerator job fails the whole run (it returns 0 comparisons).
+uint32_t SeqMatcher_Split(CSeqMatcherDriver * seqMatcher, TCPUEngine engine, uint32_t numThreads,
+    uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    uint64_t * seqsDB, uint64_t * seqsSpecimen, uint8_t * lengthsDB, uint8_t * lengthsSpecimen,
+    uint32_t * masksDB, uint32_t * masksSpecimen, uint32_t ambiguousMode,
+    int8_t * scores, uint64_t & elapsedTime, double & cpuUtilization)
+{
+  struct timespec start, end, hwEnd, cpuEnd;
+  struct timespec startCPUTime, endCPUTime;
+  bool useMasks = (ambiguousMode != CSeqMatcherDriver::AMBIGUOUS_DISABLED);
+  uint32_t numComparisons = 0;
+  uint32_t hwComparisons = 0;
+  uint32_t cpuComparisons = 0;
+  double hwRate, cpuRate;
+
+  LoadSplitRates(hwRate, cpuRate);
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, & startCPUTime);
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+  // Probe the CPU rate on the last DB entries (they are part of its slice)
+  uint32_t numProbe = (numDBEntries / 4 < SPLIT_PROBE_ENTRIES) ? numDBEntries / 4 : SPLIT_PROBE_ENTRIES;
+  uint32_t probeBegin = numDBEntries - numProbe;
+
+  if (numProbe > 0) {
+    struct timespec probeEnd;
+
+    numComparisons += SeqMatcher_CPU(engine, numProbe, numSeqsSpecimen,
+                                     seqsDB + probeBegin, seqsSpecimen, lengthsDB + probeBegin, lengthsSpecimen,
+                                     useMasks ? masksDB + probeBegin : NULL, masksSpecimen, ambiguousMode,
+                                     scores + probeBegin * numSeqsSpecimen, numThreads);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &probeEnd);
+    cpuRate = numProbe * numSeqsSpecimen / (CalcTimeDiff(probeEnd, start) / 1e9);
+  }
+
+  uint32_t numCPUEntries = (cpuRate > 0) ? probeBegin * (cpuRate / (cpuRate + hwRate)) : 0;
+  uint32_t numHWEntries = probeBegin - numCPUEntries;
+
+  // The scores of the accelerator end at a cache line boundary, so that no line is shared with the CPU slice
+  numHWEntries -= numHWEntries % DMA_ARENA_ALIGNMENT;
+  numCPUEntries = probeBegin - numHWEntries;
+
+  printf("Split: accelerator %'u DB entries (%'.0lf cmp/s), CPU %'u DB entries (%'.0lf cmp/s)\n",
+         numHWEntries, hwRate, numCPUEntries + numProbe, cpuRate);
+
+  std::thread cpuThread([&]() {
+    cpuComparisons = SeqMatcher_CPU(engine, numCPUEntries, numSeqsSpecimen,
+                                    seqsDB + numHWEntries, seqsSpecimen, lengthsDB + numHWEntries, lengthsSpecimen,
+                                    useMasks ? masksDB + numHWEntries : NULL, masksSpecimen, ambiguousMode,
+                                    scores + numHWEntries * numSeqsSpecimen, numThreads);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &cpuEnd);
+  });
+
+  struct timespec hwStart;
+  uint32_t hwStatus = CAccelDriver::OK;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &hwStart);
+  if (numHWEntries > 0)
+    hwStatus = seqMatcher->SeqMatcher_HW(numHWEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen, scores,
+                              hwComparisons, masksDB, masksSpecimen, ambiguousMode);
+  clock_gettime(CLOCK_MONOTONIC_RAW, &hwEnd);
+
+  cpuThread.join();
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, & endCPUTime);
+  elapsedTime = CalcTimeDiff(end, start);
+  cpuUtilization = (double)CalcTimeDiff(endCPUTime, startCPUTime) / elapsedTime;
+
+  uint64_t hwTime = CalcTimeDiff(hwEnd, hwStart);
+  uint64_t cpuTime = CalcTimeDiff(cpuEnd, hwStart);
+  printf("Split: accelerator finished in %0.3lf s, CPU in %0.3lf s\n", hwTime/1e9, cpuTime/1e9);
+
+  // The slice of the accelerator has no scores, and its time is not a valid rate
+  if (hwStatus != CAccelDriver::OK) {
+    printf("Error: the accelerator job failed (%s).\n", (hwStatus == CAccelDriver::JOB_TIMEOUT) ? "timeout" : "device error");
+    return 0;
+  }
+
+  // Remember the measured rates for the next run
+  if ((numHWEntries > 0) && (hwTime > 0))
+    hwRate = (double)numHWEntries * numSeqsSpecimen / (hwTime / 1e9);
+  if ((numCPUEntries > 0) && (cpuTime > 0))
+    cpuRate = (double)numCPUEntries * numSeqsSpecimen / (cpuTime / 1e9);
+  SaveSplitRates(hwRate, cpuRate);
+
+  return numComparisons + hwComparisons + cpuComparisons;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Buffers are DMA-compatible when a device is given, and regular memory for the CPU engines.
+void * AllocBuffer(CSeqMatcherDriver * seqMatcher, uint32_t size)
+{
+  return (seqMatcher != NULL) ? seqMatcher->AllocDMACompatible(size, dmaCacheable) : malloc(size);
+}
+
+void FreeBuffer(CSeqMatcherDriver * seqMatcher, void * buffer)
+{
+  if (buffer == NULL)
+    return;
+  if (seqMatcher != NULL)
+    seqMatcher->FreeDMACompatible(buffer);
+  else
+    free(buffer);
+}
+
+// Data of one chunk of DB entries
+struct TChunkBuffers {
+  uint64_t * seqsDB;
+  uint8_t * lengthsDB;
+  uint32_t * masksDB;
+  int8_t * scores;
+  uint32_t numEntries;
+  uint32_t firstEntry;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Streams the DB through NUM_CHUNK_BUFFERS fixed-size buffer sets, so that its size is not limited by the CMA memory
+// and reading, computing and writing overlap: while chunk k is computed (by the accelerator, or by cpuEngine when
+// seqMatcher is NULL), chunk k+1 is read from the DB file and the scores of chunk k-1 are written.
+// numDBEntries == 0 processes the whole DB file. An invalid sequence in the DB or a failed job stops the run (res is
+// false). Returns the number of DB entries processed.
+uint32_t SeqMatcher_Chunked(CSeqMatcherDriver * seqMatcher, TCPUEngine cpuEngine, uint32_t numThreads,
+    uint32_t chunkSize, bool protein, FILE * database, const char * databaseTitle, uint32_t numDBEntries,
+    uint32_t numSeqsSpecimen, uint64_t * seqsSpecimen, uint8_t * lengthsSpecimen, uint32_t * masksSpecimen,
+    uint32_t ambiguousMode, CScoreWriter & scoreWriter, uint64_t & elapsedTime, uint64_t & computeTime, bool & res)
+{
+  TChunkBuffers chunks[NUM_CHUNK_BUFFERS];
+  uint32_t wordsPerSeq = protein ? PROTEIN_WORDS_PER_SEQ : 1;
+  uint32_t numRead = 0;
+  bool writeOk = true;
+  bool parseError = false;
+  struct timespec start, end;
+  // Nucleobase DBs are parsed by records (any format of seqParser.hpp) from dbOffset, protein DBs by lines
+  TSeqFormat dbFormat = protein ? SEQ_FORMAT_LINES : DetectSequenceFormat(database);
+  uint64_t dbOffset = 0;
+
+  res = true;
+  computeTime = 0;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+  for (uint32_t iChunk = 0; iChunk < NUM_CHUNK_BUFFERS; ++ iChunk) {
+    chunks[iChunk].seqsDB = (uint64_t *)AllocBuffer(seqMatcher, chunkSize*wordsPerSeq*sizeof(uint64_t));
+    chunks[iChunk].lengthsDB = (uint8_t *)AllocBuffer(seqMatcher, chunkSize*sizeof(uint8_t));
+    chunks[iChunk].masksDB = (uint32_t *)AllocBuffer(seqMatcher, chunkSize*sizeof(uint32_t));
+    chunks[iChunk].scores = (int8_t *)AllocBuffer(seqMatcher, chunkSize*numSeqsSpecimen*sizeof(int8_t));
+    chunks[iChunk].numEntries = 0;
+
+    if ( (chunks[iChunk].seqsDB == NULL) || (chunks[iChunk].lengthsDB == NULL) || (chunks[iChunk].masksDB == NULL) ||
+         (chunks[iChunk].scores == NULL) ) {
+      printf("Error allocating the chunk buffers.\n");
+      res = false;
+    }
+  }
+
+  // Reads the next chunk of the DB into a buffer set. A chunk cut short by an invalid sequence sets parseError.
+  auto readChunk = [&](TChunkBuffers & chunk) {
+    uint32_t toRead = chunkSize;
+    if ((numDBEntries > 0) && (numDBEntries - numRead < toRead))
+      toRead = numDBEntries - numRead;
+
+    chunk.firstEntry = numRead;
+    chunk.numEntries = protein ?
+      ReadProteinLinesFromStream(database, databaseTitle, numRead, chunk.seqsDB, chunk.lengthsDB, toRead, parseError) :
+      ParseSequenceRecords(database, dbFormat, dbOffset, chunk.seqsDB, chunk.masksDB, chunk.lengthsDB, toRead,
+                           databaseTitle, numRead, parseError);
+    numRead += chunk.numEntries;
+  };
+
+  TChunkBuffers * computing = &chunks[0];
+  TChunkBuffers * writing = NULL;
+  uint32_t iChunk = 0;
+
+  if (res) {
+    readChunk(*computing);
+    res = !parseError;
+  }
+
+  while (res && (computing->numEntries > 0)) {
+    TChunkBuffers * next = &chunks[(iChunk + 1) % NUM_CHUNK_BUFFERS];
+    std::thread parser(readChunk, std::ref(*next));
+    std::thread writer;
+
+    if (writing != NULL)
+      writer = std::thread([&, writing]() {
+        writeOk = scoreWriter.Write(writing->scores, writing->numEntries*numSeqsSpecimen);
+      });
+
+    struct timespec computeStart, computeEnd;
+    uint32_t numComparisons = 0;
+    uint32_t status = CAccelDriver::OK;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &computeStart);
+    TRACE_SCOPE("Compute chunk");
+    if (seqMatcher != NULL)
+      status = seqMatcher->SeqMatcher_HW(computing->numEntries, numSeqsSpecimen, computing->seqsDB, seqsSpecimen,
+                                         computing->lengthsDB, lengthsSpecimen, computing->scores, numComparisons,
+                                         computing->masksDB, masksSpecimen, ambiguousMode);
+    else
+      numComparisons = SeqMatcher_CPU(cpuEngine, computing->numEntries, numSeqsSpecimen, computing->seqsDB,
+                                      seqsSpecimen, computing->lengthsDB, lengthsSpecimen, computing->masksDB,
+                                      masksSpecimen, ambiguousMode, computing->scores, numThreads);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &computeEnd);
+
+    // A chunk whose job timed out or failed has no scores, and its time is not a compute time
+    if (status != CAccelDriver::OK) {
+      printf("Error: the accelerator job of chunk %u failed (%s).\n", iChunk,
+             (status == CAccelDriver::JOB_TIMEOUT) ? "timeout" : "device error");
+      res = false;
+    }
+    else if (numComparisons != computing->numEntries * numSeqsSpecimen) {
+      printf("Error computing chunk %u (DB entries %'u to %'u)\n", iChunk, computing->firstEntry,
+             computing->firstEntry + computing->numEntries - 1);
+      res = false;
+    }
+    else
+      computeTime += CalcTimeDiff(computeEnd, computeStart);
+
+    parser.join();
+    if (writer.joinable())
+      writer.join();
+    res = res && writeOk && !parseError;
+
+    writing = computing;
+    computing = next;
+    ++ iChunk;
+  }
+
+  if (res && (writing != NULL))
+    res = scoreWriter.Write(writing->scores, writing->numEntries*numSeqsSpecimen);
+
+  if (parseError)
+    printf("Error reading database: invalid sequence after %'u sequences\n", numRead);
+  else if (res && (numDBEntries > 0) && (numRead != numDBEntries)) {
+    printf("Error reading database: Read %'u sequences instead of %'u\n", numRead, numDBEntries);
+    res = false;
+  }
+
+  for (uint32_t iChunk = 0; iChunk < NUM_CHUNK_BUFFERS; ++ iChunk) {
+    FreeBuffer(seqMatcher, chunks[iChunk].seqsDB);
+    FreeBuffer(seqMatcher, chunks[iChunk].lengthsDB);
+    FreeBuffer(seqMatcher, chunks[iChunk].masksDB);
+    FreeBuffer(seqMatcher, chunks[iChunk].scores);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  elapsedTime = CalcTimeDiff(end, start);
+
+  return numRead;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Runs a whole job with SeqMatcher_Chunked: only the specimen and NUM_CHUNK_BUFFERS chunks are kept in memory.
+int RunChunkedJob(uint32_t chunkSize, TCPUEngine cpuEngine, uint32_t numThreads, bool protein,
+    uint32_t numDBEntries, uint32_t numSeqsSpecimen, const char * databaseTitle, const char * specimenTitle,
+    const char * scoresTitle, uint32_t ambiguousMode)
+{
+  CSeqMatcherDriver hwDevice(SHOULD_LOG);
+  CSeqMatcherEmuDriver emuDevice(emuEngine, numThreads, SHOULD_LOG);
+  CSeqMatcherDriver & seqMatcher = (emuEngine != CPU_ENGINE_NONE) ? emuDevice : hwDevice;
+  CSeqMatcherDriver * device = (cpuEngine == CPU_ENGINE_NONE) ? &seqMatcher : NULL;
+  uint32_t wordsPerSeq = protein ? PROTEIN_WORDS_PER_SEQ : 1;
+  FILE * database = NULL;
+  CScoreWriter scoreWriter;
+  bool res = true;
+
+  if ((device != NULL) && !OpenDevice(seqMatcher))
+    return -1;
+
+  // The specimen and the chunk buffer sets are carved out of one DMA arena
+  if (device != NULL)
+    CreateArena(seqMatcher, ArenaBlockSize(numSeqsSpecimen*wordsPerSeq*sizeof(uint64_t)) +
+                            ArenaBlockSize(numSeqsSpecimen*sizeof(uint8_t)) +
+                            ArenaBlockSize(numSeqsSpecimen*sizeof(uint32_t)) +
+                            NUM_CHUNK_BUFFERS * (ArenaBlockSize(chunkSize*wordsPerSeq*sizeof(uint64_t)) +
+                                                 ArenaBlockSize(chunkSize*sizeof(uint8_t)) +
+                                                 ArenaBlockSize(chunkSize*sizeof(uint32_t)) +
+                                                 ArenaBlockSize(chunkSize*numSeqsSpecimen*sizeof(int8_t))));
+
+  uint64_t * seqsSpecimen = (uint64_t *)AllocBuffer(device, numSeqsSpecimen*wordsPerSeq*sizeof(uint64_t));
+  uint8_t * lengthsSpecimen = (uint8_t *)AllocBuffer(device, numSeqsSpecimen*sizeof(uint8_t));
+  uint32_t * masksSpecimen = (uint32_t *)AllocBuffer(device, numSeqsSpecimen*sizeof(uint32_t));
+
+  if ( (seqsSpecimen == NULL) || (lengthsSpecimen == NULL) || (masksSpecimen == NULL) ) {
+    printf("Error allocating memory for the specimen.\n");
+    res = false;
+  }
+
+  TPackedDBHeader packedHeader;
+  if (ReadPackedDBHeader(databaseTitle, packedHeader)) {
+    printf("Packed DBs cannot be streamed with --chunk, load them whole instead\n");
+    res = false;
+  }
+
+  if (res) {
+    printf("Reading specimen file [%s]...\n", specimenTitle);
+    uint32_t readLines = ReadPackedDBHeader(specimenTitle, packedHeader) ?
+      LoadPackedDB(specimenTitle, seqsSpecimen, masksSpecimen, lengthsSpecimen, numSeqsSpecimen, wordsPerSeq) :
+      protein ?
+      ReadProteinLines(seqsSpecimen, lengthsSpecimen, specimenTitle, numSeqsSpecimen) :
+      ParseSequenceFile(specimenTitle, seqsSpecimen, masksSpecimen, lengthsSpecimen, numSeqsSpecimen, numThreads);
+    if (readLines != numSeqsSpecimen) {
+      printf("Error reading specimen: Read %'u lines instead of %'u\n", readLines, numSeqsSpecimen);
+      res = false;
+    }
+  }
+
+  if (res && ((database = fopen(databaseTitle, "rt")) == NULL)) {
+    printf("Error opening file [%s]\n", databaseTitle);
+    res = false;
+  }
+  if (res && !scoreWriter.Open(scoresTitle))
+    res = false;
+
+  if (res) {
+    uint64_t elapsedTime, computeTime;
+
+    printf("Streaming the database in chunks of %'u DB entries...\n", chunkSize);
+    uint32_t numProcessed = SeqMatcher_Chunked(device, cpuEngine, numThreads, chunkSize, protein, database, databaseTitle,
+                                               numDBEntries, numSeqsSpecimen, seqsSpecimen, lengthsSpecimen,
+                                               masksSpecimen, ambiguousMode, scoreWriter, elapsedTime, computeTime, res);
+    uint64_t numComparisons = (uint64_t)numProcessed * numSeqsSpecimen;
+
+    if (res) {
+      printf("Processed %'u DB entries (%'" PRIu64 " scores) in %0.3lf s, %0.3lf s of them computing\n",
+             numProcessed, numComparisons, elapsedTime/1e9, computeTime/1e9);
+      printf("Sequence comparisons per second: %'0.3lf\n", numComparisons / (elapsedTime/1e9));
+    }
+    else
+      printf("The streamed job failed (%'u DB entries read)\n", numProcessed);
+
+    // The last blocks of scores may still be queued in the writer
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    res = scoreWriter.Close() && res;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    printf("Remaining scores written in %0.3lf s\n", CalcTimeDiff(end, start)/1e9);
+  }
+
+  if (database != NULL)
+    fclose(database);
+  FreeBuffer(device, seqsSpecimen);
+  FreeBuffer(device, lengthsSpecimen);
+  FreeBuffer(device, masksSpecimen);
+
+  return res ? 0 : -1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// Specimen files of a batch: the regular files of a directory (in name order), or the paths listed in a text
+// file, one per line. Returns false if it cannot be read.
+bool ListSpecimenFiles(const char * batchSource, std::vector<std::string> & files)
+{
+  struct stat sourceStat;
+
+  if (stat(batchSource, &sourceStat) != 0) {
+    printf("Error: cannot find [%s]\n", batchSource);
+    return false;
+  }
+
+  if (S_ISDIR(sourceStat.st_mode)) {
+    DIR * dir = opendir(batchSource);
+    struct dirent * entry;
+
+    if (dir == NULL) {
+      printf("Error opening directory [%s]\n", batchSource);
+      return false;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+      std::string path = std::string(batchSource) + "/" + entry->d_name;
+      struct stat fileStat;
+      if ((entry->d_name[0] != '.') && (stat(path.c_str(), &fileStat) == 0) && S_ISREG(fileStat.st_mode))
+        files.push_back(path);
+    }
+    closedir(dir);
+    std::sort(files.begin(), files.end());
+    return true;
+  }
+
+  FILE * list = fopen(batchSource, "rt");
+  char line[4096];
+
+  if (list == NULL) {
+    printf("Error opening file [%s]\n", batchSource);
+    return false;
+  }
+  while (fgets(line, sizeof(line), list) != NULL) {
+    size_t length = strcspn(line, "\r\n");
+    if (length > 0)
+      files.push_back(std::string(line, length));
+  }
+  fclose(list);
+  return true;
+}
+
+// Scores file of a specimen in the output directory of the batch: its file name followed by ".bin"
+std::string BatchScoresFile(const char * scoresDir, const std::string & specimenFile)
+{
+  size_t slash = specimenFile.find_last_of('/');
+  std::string name = (slash == std::string::npos) ? specimenFile : specimenFile.substr(slash + 1);
+
+  return std::string(scoresDir) + "/" + name + ".bin";
+}
+
+// Buffers of one specimen of a batch and of its scores
+struct TSpecimenBuffers {
+  uint64_t * seqs;
+  uint32_t * masks;
+  uint8_t * lengths;
+  int8_t * scores;
+  uint32_t numSeqs;
+  CSeqMatcherDriver::TJobHandle job;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// Scores every specimen file of a batch against one DB, which is loaded into DMA memory once. The specimens go
+// through two buffer sets: specimen k+1 is parsed while the accelerator scores specimen k, and the scores of
+// specimen k are written while it scores specimen k+1. Every specimen can have up to numSeqsSpecimen sequences and
+// gets its own scores file in scoresDir. A specimen that fails is reported and skipped.
+int RunBatchJob(uint32_t numThreads, bool protein, uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const char * databaseTitle, const char * batchSource, const char * scoresDir, uint32_t ambiguousMode)
+{
+  CSeqMatcherDriver hwDevice(SHOULD_LOG);
+  CSeqMatcherEmuDriver emuDevice(emuEngine, numThreads, SHOULD_LOG);
+  CSeqMatcherDriver & seqMatcher = (emuEngine != CPU_ENGINE_NONE) ? emuDevice : hwDevice;
+  uint32_t wordsPerSeq = protein ? PROTEIN_WORDS_PER_SEQ : 1;
+  // One extra sequence detects the specimens that do not fit in the buffers
+  uint32_t specimenCapacity = numSeqsSpecimen + 1;
+  std::vector<std::string> files;
+  TSpecimenBuffers sets[2];
+  uint32_t numFailed = 0;
+  uint64_t numComparisons = 0;
+  struct timespec start, loaded, end;
+  bool res = true;
+
+  if (!ListSpecimenFiles(batchSource, files))
+    return -1;
+  if (files.empty()) {
+    printf("Error: no specimen files in [%s]\n", batchSource);
+    return -1;
+  }
+  // Specimens of a list can share their file name, which would overwrite each other's scores
+  std::map<std::string, uint32_t> scoresFiles;
+  for (uint32_t iFile = 0; iFile < files.size(); ++ iFile) {
+    auto inserted = scoresFiles.insert(std::make_pair(BatchScoresFile(scoresDir, files[iFile]), iFile));
+    if (!inserted.second) {
+      printf("Error: specimens [%s] and [%s] would both write [%s]\n", files[inserted.first->second].c_str(),
+             files[iFile].c_str(), inserted.first->first.c_str());
+      return -1;
+    }
+  }
+  if ((mkdir(scoresDir, 0755) != 0) && (errno != EEXIST)) {
+    printf("Error creating the scores directory [%s]\n", scoresDir);
+    return -1;
+  }
+  printf("Batch of %'zu specimen files, scores written to [%s]\n", files.size(), scoresDir);
+
+  if (!OpenDevice(seqMatcher))
+    return -1;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+  // The DB and both specimen sets are carved out of one DMA arena
+  CreateArena(seqMatcher, ArenaBlockSize(numDBEntries*wordsPerSeq*sizeof(uint64_t)) +
+                          ArenaBlockSize(numDBEntries*sizeof(uint8_t)) +
+                          ArenaBlockSize(numDBEntries*sizeof(uint32_t)) +
+                          2 * (ArenaBlockSize(specimenCapacity*wordsPerSeq*sizeof(uint64_t)) +
+                               ArenaBlockSize(specimenCapacity*sizeof(uint8_t)) +
+                               ArenaBlockSize(specimenCapacity*sizeof(uint32_t)) +
+                               ArenaBlockSize(numDBEntries*numSeqsSpecimen*sizeof(int8_t))));
+
+  uint64_t * seqsDB = (uint64_t *)AllocBuffer(&seqMatcher, numDBEntries*wordsPerSeq*sizeof(uint64_t));
+  uint8_t * lengthsDB = (uint8_t *)AllocBuffer(&seqMatcher, numDBEntries*sizeof(uint8_t));
+  uint32_t * masksDB = (uint32_t *)AllocBuffer(&seqMatcher, numDBEntries*sizeof(uint32_t));
+  res = (seqsDB != NULL) && (lengthsDB != NULL) && (masksDB != NULL);
+
+  for (TSpecimenBuffers & set : sets) {
+    set.seqs = (uint64_t *)AllocBuffer(&seqMatcher, specimenCapacity*wordsPerSeq*sizeof(uint64_t));
+    set.lengths = (uint8_t *)AllocBuffer(&seqMatcher, specimenCapacity*sizeof(uint8_t));
+    set.masks = (uint32_t *)AllocBuffer(&seqMatcher, specimenCapacity*sizeof(uint32_t));
+    set.scores = (int8_t *)AllocBuffer(&seqMatcher, numDBEntries*numSeqsSpecimen*sizeof(int8_t));
+    set.numSeqs = 0;
+    set.job = CSeqMatcherDriver::INVALID_JOB_HANDLE;
+    res = res && (set.seqs != NULL) && (set.lengths != NULL) && (set.masks != NULL) && (set.scores != NULL);
+  }
+  if (!res)
+    printf("Error allocating DMA memory.\n");
+
+  if (res) {
+    TRACE_SCOPE("Read database");
+    printf("Reading database file [%s]...\n", databaseTitle);
+    uint32_t readLines = ReadSequences(databaseTitle, protein, numThreads, seqsDB, masksDB, lengthsDB, numDBEntries);
+    if (readLines != numDBEntries) {
+      printf("Error reading database: Read %'u lines instead of %'u\n", readLines, numDBEntries);
+      res = false;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC_RAW, &loaded);
+
+  // Parses a specimen into a buffer set. Returns false if it cannot be scored.
+  auto parseSpecimen = [&](uint32_t iFile, TSpecimenBuffers & set) {
+    TRACE_SCOPE("Read specimen");
+    set.job = CSeqMatcherDriver::INVALID_JOB_HANDLE;
+    set.numSeqs = ReadSequences(files[iFile].c_str(), protein, numThreads, set.seqs, set.masks, set.lengths,
+                                specimenCapacity);
+    // An empty, unreadable or invalid specimen reads 0 sequences (the reason has been printed)
+    if (set.numSeqs == 0) {
+      printf("Error: specimen [%s] skipped\n", files[iFile].c_str());
+      return false;
+    }
+    if (set.numSeqs > numSeqsSpecimen) {
+      printf("Error: specimen [%s] has too many sequences (up to %'u are allowed)\n", files[iFile].c_str(),
+             numSeqsSpecimen);
+      return false;
+    }
+    return true;
+  };
+
+  // Starts the job of a parsed specimen
+  auto submitSpecimen = [&](uint32_t iFile, TSpecimenBuffers & set) {
+    set.job = seqMatcher.Submit(numDBEntries, set.numSeqs, seqsDB, set.seqs, lengthsDB, set.lengths, set.scores,
+                                masksDB, set.masks, ambiguousMode);
+    if (set.job == CSeqMatcherDriver::INVALID_JOB_HANDLE)
+      printf("Error: cannot start the job of specimen [%s]\n", files[iFile].c_str());
+  };
+
+  if (res && parseSpecimen(0, sets[0]))
+    submitSpecimen(0, sets[0]);
+
+  for (uint32_t iFile = 0; res && (iFile < files.size()); ++ iFile) {
+    TSpecimenBuffers & current = sets[iFile % 2];
+    TSpecimenBuffers & next = sets[(iFile + 1) % 2];
+    bool ok = false;
+
+    // Only one job can be in flight: the next specimen is parsed while this job runs, and started after Wait()
+    bool nextParsed = (iFile + 1 < files.size()) && parseSpecimen(iFile + 1, next);
+
+    if (current.job != CSeqMatcherDriver::INVALID_JOB_HANDLE) {
+      uint32_t jobComparisons = 0;
+      uint32_t status = seqMatcher.Wait(current.job, jobComparisons);
+      ok = (status == CAccelDriver::OK) && (jobComparisons == numDBEntries * current.numSeqs);
+      if (!ok)
+        printf("Error: the job of specimen [%s] failed (status %u)\n", files[iFile].c_str(), status);
+    }
+
+    // The next job runs while the scores of this one are written
+    if (nextParsed)
+      submitSpecimen(iFile + 1, next);
+
+    if (ok) {
+      TRACE_SCOPE("DumpScores");
+      std::string scoresFile = BatchScoresFile(scoresDir, files[iFile]);
+      CScoreWriter scoreWriter;
+      ok = scoreWriter.Open(scoresFile.c_str()) && scoreWriter.Write(current.scores, numDBEntries*current.numSeqs);
+      ok = scoreWriter.Close() && ok;
+      if (ok) {
+        numComparisons += (uint64_t)numDBEntries * current.numSeqs;
+        printf("[%'u/%'zu] %s: %'u sequences -> %s\n", iFile + 1, files.size(), files[iFile].c_str(),
+               current.numSeqs, scoresFile.c_str());
+      }
+    }
+    if (!ok)
+      ++ numFailed;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+
+  if (res) {
+    uint64_t batchTime = CalcTimeDiff(end, loaded);
+    printf("Database loaded once in %0.3lf s\n", CalcTimeDiff(loaded, start)/1e9);
+    printf("Scored %'zu of %'zu specimens (%'" PRIu64 " scores) in %0.3lf s\n", files.size() - numFailed,
+           files.size(), numComparisons, batchTime/1e9);
+    printf("Sequence comparisons per second: %'0.3lf\n", numComparisons / (batchTime/1e9));
+  }
+
+  FreeBuffer(&seqMatcher, seqsDB);
+  FreeBuffer(&seqMatcher, lengthsDB);
+  FreeBuffer(&seqMatcher, masksDB);
+  for (TSpecimenBuffers & set : sets) {
+    FreeBuffer(&seqMatcher, set.seqs);
+    FreeBuffer(&seqMatcher, set.lengths);
+    FreeBuffer(&seqMatcher, set.masks);
+    FreeBuffer(&seqMatcher, set.scores);
+  }
+
+  return (res && (numFailed == 0)) ? 0 : -1;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+// With --trace, prints the time of every phase and writes the Chrome trace. Returns the exit code of the program.
+int ReportTrace(int res)
+{
+  if (traceFile == NULL)
+    return res;
+
+  TracePrintSummary();
+  if (TraceWriteChrome(traceFile))
+    printf("Trace written to [%s]\n", traceFile);
+  return res;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+void PrintUsage()
+{
+  printf("Matches variable-length sequences from one specimen file against a sequence database.\n\n");
+  printf("Usage: seqMatcherSW numDBEntries numSeqsSpecimen databaseFile specimenFile scoresFile [options]\n\n");
+  printf("Options:\n");
+  printf("  --ambiguous=mismatch   Ambiguous nucleobases (N, R, Y...) always count as a mismatch (default)\n");
+  printf("  --ambiguous=wildcard   Ambiguous nucleobases match any nucleobase\n");
+  printf("  --protein              Sequences are proteins (requires the PROTEIN_MODE bitstream)\n");
+  printf("  --cpu-engine=sw        Compute the scores on the CPU (SIMD, bit-exact with the accelerator), without the device\n");
+  printf("  --cpu-engine=editdistance\n");
+  printf("                         Compute edit distances on the CPU (bit-parallel Myers), without the device\n");
+  printf("  --threads=N            Number of threads of the CPU engines (default: all the cores)\n");
+  printf("  --uncached             Allocate the DMA buffers non-cacheable (coherent, without cache maintenance)\n");
+  printf("  --poll-us=N            Busy-poll the accelerator for up to N us before waiting for its interrupt\n");
+  printf("  --timeout-ms=N         Reset the accelerator and fail a job that runs for more than N ms\n");
+  printf("  --backend=hw           Run the jobs on the accelerator (default)\n");
+  printf("  --backend=emu          Emulate the (Smith-Waterman) accelerator on the CPU, without the board\n");
+  printf("  --backend=emu-editdistance\n");
+  printf("                         Emulate the EDIT_DISTANCE_ENGINE accelerator on the CPU\n");
+  printf("  --split                Score a tail slice of the DB on the CPU while the accelerator scores the rest\n");
+  printf("                         (with the CPU engine selected by --cpu-engine, sw by default). The engine must\n");
+  printf("                         compute what the accelerator computes: sw, or editdistance with\n");
+  printf("                         --backend=emu-editdistance\n");
+  printf("  --split-rates=file     File of the throughputs measured by --split (default:\n");
+  printf("                         $XDG_STATE_HOME/seqMatcher_rates, or ~/.local/state/seqMatcher_rates)\n");
+  printf("  --chunk=N              Stream the database in chunks of N entries, overlapping reading, computing\n");
+  printf("                         and writing. numDBEntries = 0 processes the whole database file\n");
+  printf("  --batch                specimenFile is a directory or a list of specimen files (one per line), scored\n");
+  printf("                         against the DB loaded once; scoresFile is the directory of their scores files.\n");
+  printf("                         numSeqsSpecimen is the maximum number of sequences of a specimen\n");
+  printf("  --trace=file           Print the time spent in every phase and write it as a Chrome trace to file\n\n");
+  printf("Example: ./seqMatcherSW 10000 1000 database.txt specimen.txt scores.bin\n\n");
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////
 int main(int argc, char ** argv)
 {
@@ -208,6 +1076,14 @@ int main(int argc, char ** argv)
   char * scoresTitle = NULL;
   uint64_t * seqsDB, * seqsSpecimen; // Have to be allocated for DMA access
   uint8_t * lengthsDB, * lengthsSpecimen; // Have to be allocated for DMA access
+  uint32_t * masksDB, * masksSpecimen; // Have to be allocated for DMA access
+  uint32_t ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_MISMATCH;
+  bool protein = false;
+  TCPUEngine cpuEngine = CPU_ENGINE_NONE;
+  uint32_t numThreads = 0;
+  bool split = false;
+  uint32_t chunkSize = 0;
+  bool batch = false;
   int8_t * scores; // Has to be allocated for DMA access
   uint64_t elapsedTime;
   double cpuUtilization;
@@ -216,34 +1092,144 @@ int main(int argc, char ** argv)
   // Obtain arguments from command line.
   setlocale(LC_NUMERIC, "en_US.utf8");  // Enables printing human-readable numbers with %'
   printf("\n");
-  if ( (argc != 6) || 
+  if ( (argc < 6) || 
        (sscanf(argv[1], "%u", &numDBEntries) != 1) ||
        (sscanf(argv[2], "%u", &numSeqsSpecimen) != 1) )
   {
-    printf("Matches variable-length sequences from one specimen file against a sequence database.\n\n");
-    printf("Usage: seqMatcherSW numDBEntries numSeqsSpecimen databaseFile specimenFile scoresFile\n\n");
-    printf("Example: ./seqMatcherSW 10000 1000 database.txt specimen.txt scores.bin\n\n");
+    PrintUsage();
     return -1;
   }
   databaseTitle = argv[3];
   specimenTitle = argv[4];
   scoresTitle = argv[5];
+
+  for (int iArg = 6; iArg < argc; ++ iArg) {
+    if (strcmp(argv[iArg], "--ambiguous=mismatch") == 0)
+      ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_MISMATCH;
+    else if (strcmp(argv[iArg], "--ambiguous=wildcard") == 0)
+      ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_WILDCARD;
+    else if (strcmp(argv[iArg], "--protein") == 0)
+      protein = true;
+    else if (strcmp(argv[iArg], "--cpu-engine=sw") == 0)
+      cpuEngine = CPU_ENGINE_SW;
+    else if (strcmp(argv[iArg], "--cpu-engine=editdistance") == 0)
+      cpuEngine = CPU_ENGINE_EDIT_DISTANCE;
+    else if (sscanf(argv[iArg], "--threads=%u", &numThreads) == 1)
+      ;
+    else if (strcmp(argv[iArg], "--uncached") == 0)
+      dmaCacheable = 0;
+    else if (sscanf(argv[iArg], "--poll-us=%u", &pollWindowUs) == 1)
+      ;
+    else if (sscanf(argv[iArg], "--timeout-ms=%u", &jobTimeoutMs) == 1)
+      ;
+    else if (strcmp(argv[iArg], "--backend=hw") == 0)
+      emuEngine = CPU_ENGINE_NONE;
+    else if (strcmp(argv[iArg], "--backend=emu") == 0)
+      emuEngine = CPU_ENGINE_SW;
+    else if (strcmp(argv[iArg], "--backend=emu-editdistance") == 0)
+      emuEngine = CPU_ENGINE_EDIT_DISTANCE;
+    else if (strcmp(argv[iArg], "--split") == 0)
+      split = true;
+    else if (strncmp(argv[iArg], "--split-rates=", 14) == 0)
+      splitRatesFile = argv[iArg] + 14;
+    else if ((sscanf(argv[iArg], "--chunk=%u", &chunkSize) == 1) && (chunkSize > 0))
+      ;
+    else if (strcmp(argv[iArg], "--batch") == 0)
+      batch = true;
+    else if (strncmp(argv[iArg], "--trace=", 8) == 0)
+      traceFile = argv[iArg] + 8;
+    else {
+      printf("Unknown option [%s]\n\n", argv[iArg]);
+      PrintUsage();
+      return -1;
+    }
+  }
+  if (traceFile != NULL)
+    TraceEnable();
+
+  // Packed DBs (see packedDB.hpp) are loaded with bulk copies instead of being parsed. numDBEntries = 0 or
+  // numSeqsSpecimen = 0 load the whole packed file.
+  TPackedDBHeader packedHeader;
+  bool packedDB = ReadPackedDBHeader(databaseTitle, packedHeader);
+  if (packedDB && (numDBEntries == 0) && (chunkSize == 0))
+    numDBEntries = packedHeader.numSeqs;
+  bool packedSpecimen = ReadPackedDBHeader(specimenTitle, packedHeader);
+  if (packedSpecimen && (numSeqsSpecimen == 0))
+    numSeqsSpecimen = packedHeader.numSeqs;
+
   printf("Matching %'u DB entries against a specimen with %'u sequences.\n", numDBEntries, numSeqsSpecimen);
   printf("Database file: [%s]\n", databaseTitle);
   printf("Specimen file: [%s]\n", specimenTitle);
   printf("Scores file: [%s]\n", scoresTitle);
 
+  // Proteins have no ambiguity masks: unknown residues are encoded as X and scored by the substitution matrix.
+  if (protein)
+    ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_DISABLED;
 
-  // Initialize device and obtain memory for all the data arrays.
-  CSeqMatcherDriver seqMatcher(SHOULD_LOG);
-  if (!InitDevice(seqMatcher, numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen, scores))
+  if (protein && ((cpuEngine != CPU_ENGINE_NONE) || split || (emuEngine != CPU_ENGINE_NONE))) {
+    printf("The CPU engines only support nucleobase sequences\n");
     return -1;
+  }
+
+  if (batch) {
+    if (split || (chunkSize > 0) || (cpuEngine != CPU_ENGINE_NONE)) {
+      printf("--batch cannot be combined with --split, --chunk or --cpu-engine\n");
+      return -1;
+    }
+    if ((numDBEntries == 0) || (numSeqsSpecimen == 0)) {
+      printf("--batch needs the number of DB entries and the maximum number of sequences of a specimen\n");
+      return -1;
+    }
+    return ReportTrace(RunBatchJob(numThreads, protein, numDBEntries, numSeqsSpecimen, databaseTitle, specimenTitle,
+                                   scoresTitle, ambiguousMode));
+  }
+
+  if (chunkSize > 0) {
+    if (split) {
+      printf("--split cannot be combined with --chunk\n");
+      return -1;
+    }
+    return ReportTrace(RunChunkedJob(chunkSize, cpuEngine, numThreads, protein, numDBEntries, numSeqsSpecimen,
+                                     databaseTitle, specimenTitle, scoresTitle, ambiguousMode));
+  }
+
+  // In split mode the device is used together with the CPU engine, which must fill its part of the score matrix
+  // with the same scores. The device is assumed to run the Smith-Waterman bitstream.
+  TCPUEngine splitEngine = CPU_ENGINE_NONE;
+  if (split) {
+    TCPUEngine accelEngine = (emuEngine != CPU_ENGINE_NONE) ? emuEngine : CPU_ENGINE_SW;
+
+    splitEngine = (cpuEngine != CPU_ENGINE_NONE) ? cpuEngine : accelEngine;
+    if ((splitEngine == CPU_ENGINE_EDIT_DISTANCE) != (accelEngine == CPU_ENGINE_EDIT_DISTANCE)) {
+      printf("--split: the CPU engine computes %s but the accelerator computes %s\n",
+             (splitEngine == CPU_ENGINE_EDIT_DISTANCE) ? "edit distances" : "Smith-Waterman scores",
+             (accelEngine == CPU_ENGINE_EDIT_DISTANCE) ? "edit distances" : "Smith-Waterman scores");
+      return -1;
+    }
+    cpuEngine = CPU_ENGINE_NONE;
+  }
+
+
+  // Initialize device and obtain memory for all the data arrays. The CPU engines only need regular memory.
+  CSeqMatcherDriver hwDevice(SHOULD_LOG);
+  CSeqMatcherEmuDriver emuDevice(emuEngine, numThreads, SHOULD_LOG);
+  CSeqMatcherDriver & seqMatcher = (emuEngine != CPU_ENGINE_NONE) ? emuDevice : hwDevice;
+  if (cpuEngine != CPU_ENGINE_NONE) {
+    printf("Using the CPU engine, the device is not used.\n");
+    if (!InitHostBuffers(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+                         masksDB, masksSpecimen, scores))
+      return ReportTrace(-1);
+  }
+  else if (!InitDevice(seqMatcher, numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+                       masksDB, masksSpecimen, scores, protein ? PROTEIN_WORDS_PER_SEQ : 1))
+    return ReportTrace(-1);
 
   // Read the database and the specimen file
   if (res) {
+    TRACE_SCOPE("Read database");
     printf("Reading database file [%s]...\n", databaseTitle);
     uint32_t readLines;
-    readLines = ReadLines(seqsDB, lengthsDB, databaseTitle, numDBEntries);
+    readLines = ReadSequences(databaseTitle, protein, numThreads, seqsDB, masksDB, lengthsDB, numDBEntries);
     if (readLines != numDBEntries) {
       printf("Error reading database: Read %'u lines instead of %'u\n", readLines, numDBEntries);
       res = false;
@@ -253,9 +1239,11 @@ int main(int argc, char ** argv)
   }
 
   if (res) {
+    TRACE_SCOPE("Read specimen");
     printf("Reading specimen file [%s]...\n", specimenTitle);
     uint32_t readLines;
-    readLines = ReadLines(seqsSpecimen, lengthsSpecimen, specimenTitle, numSeqsSpecimen);
+    readLines = ReadSequences(specimenTitle, protein, numThreads, seqsSpecimen, masksSpecimen, lengthsSpecimen,
+                              numSeqsSpecimen);
     if (readLines != numSeqsSpecimen) {
       printf("Error reading specimen: Read %'u lines instead of %'u\n", readLines, numSeqsSpecimen);
       res = false;
@@ -268,21 +1256,56 @@ int main(int argc, char ** argv)
   if (res) {
     printf("Calculating scores. Num comparisons: %'u * %'u = %'u\n", numDBEntries, numSeqsSpecimen, numDBEntries*numSeqsSpecimen);
 
-    uint32_t comparisons =
+    uint32_t comparisons = (cpuEngine != CPU_ENGINE_NONE) ?
+      SeqMatcher_CPU(cpuEngine, numThreads, numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen,
+                     lengthsDB, lengthsSpecimen, masksDB, masksSpecimen, ambiguousMode,
+                     scores, elapsedTime, cpuUtilization) :
+      split ?
+      SeqMatcher_Split(&seqMatcher, splitEngine, numThreads, numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen,
+                       lengthsDB, lengthsSpecimen, masksDB, masksSpecimen, ambiguousMode,
+                       scores, elapsedTime, cpuUtilization) :
       SeqMatcher_HW(&seqMatcher, numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen,
-                    lengthsDB, lengthsSpecimen, scores, elapsedTime, cpuUtilization);
+                    lengthsDB, lengthsSpecimen, masksDB, masksSpecimen, ambiguousMode,
+                    scores, elapsedTime, cpuUtilization);
+
+    if (comparisons != numDBEntries * numSeqsSpecimen) {
+      printf("Error: %'u comparisons instead of %'u\n", comparisons, numDBEntries * numSeqsSpecimen);
+      res = false;
+    }
+  }
 
-    assert(comparisons == numDBEntries * numSeqsSpecimen);
-    printf("Calculated %'u scores in %0.3lf s (%'" PRIu64 " ns)\n", comparisons, elapsedTime/1e9, elapsedTime);
+  if (res) {
+    printf("Calculated %'u scores in %0.3lf s (%'" PRIu64 " ns)\n", numDBEntries*numSeqsSpecimen, elapsedTime/1e9, elapsedTime);
     printf("Sequence comparisons per second: %'0.3lf\n", numDBEntries*numSeqsSpecimen / (elapsedTime/1e9) );
     printf("CPU utilization percentage: %0.0lf %%\n", (cpuUtilization * 100) / NUM_CORES_IN_SYSTEM );
 
+    // The scores are copied out of the DMA buffer with wide loads and written by a background thread
     printf("Dumping scores...\n");
-    DumpScores(scores, numDBEntries*numSeqsSpecimen, scoresTitle);
-    printf("Scores dumped.\n");
+    TRACE_SCOPE("DumpScores");
+    CScoreWriter scoreWriter;
+    struct timespec start, copied, end;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    bool dumped = scoreWriter.Open(scoresTitle) && scoreWriter.Write(scores, numDBEntries*numSeqsSpecimen);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &copied);
+    dumped = scoreWriter.Close() && dumped;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    if (dumped)
+      printf("Scores dumped (copied in %0.3lf s, written in %0.3lf s).\n", CalcTimeDiff(copied, start)/1e9,
+             CalcTimeDiff(end, start)/1e9);
   }
 
 
+  if (cpuEngine != CPU_ENGINE_NONE) {
+    free(seqsDB);
+    free(seqsSpecimen);
+    free(lengthsDB);
+    free(lengthsSpecimen);
+    free(masksDB);
+    free(masksSpecimen);
+    free(scores);
+    return ReportTrace(res ? 0 : -1);
+  }
+
   // Free DMA memory.
   if (seqsDB != NULL)
     seqMatcher.FreeDMACompatible(seqsDB);
@@ -292,9 +1315,13 @@ int main(int argc, char ** argv)
     seqMatcher.FreeDMACompatible(lengthsDB);
   if (lengthsSpecimen != NULL)
     seqMatcher.FreeDMACompatible(lengthsSpecimen);
+  if (masksDB != NULL)
+    seqMatcher.FreeDMACompatible(masksDB);
+  if (masksSpecimen != NULL)
+    seqMatcher.FreeDMACompatible(masksSpecimen);
   if (scores != NULL)
     seqMatcher.FreeDMACompatible(scores);
 
-  return 0;
+  return ReportTrace(res ? 0 : -1);
 }
 
@@ -0,0 +1,577 @@
+// Benchmarks of the host pipeline: the Smith-Waterman kernel of the CPU engine per length pair, the 2-bit packing
+// of the sequences, the parser, the score writer and end-to-end runs (parse, job, write) over sweeps of the
+// sequence length and of the number of specimen sequences. The inputs are generated from a fixed seed, so every
+// release is measured on the same data. Every benchmark is repeated and reported as JSON, with the mean, standard
+// deviation, minimum and maximum of its time and rates (GCUPS: billions of DP cells per second, bytes/s).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdint.h>
+#include <math.h>
+#include <locale.h>
+#include <unistd.h>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include "util.hpp"
+
+#include "CAccelDriver.hpp"
+#include "CSeqMatcherDriver.hpp"
+#include "seqMatcherCPU.hpp"
+#include "CSeqMatcherEmuDriver.hpp"
+#include "seqParser.hpp"
+#include "packedDB.hpp"
+#include "scoreWriter.hpp"
+
+#define MAX_SEQ_LENGTH 32
+
+#define DEFAULT_REPEATS 5
+#define DEFAULT_SEED 1
+#define DEFAULT_DB_ENTRIES 20000
+
+// Size of the inputs of the micro-benchmarks
+#define KERNEL_PAIRS 20000
+#define PACK_SEQS 1000000
+#define PARSE_SEQS 1000000
+#define DUMP_BYTES (64 << 20)
+
+const char* DRIVER_NAME = "/dev/seq_matcher";
+
+// Engine that emulates the accelerator on the CPU in the end-to-end runs, or CPU_ENGINE_NONE to use the device
+TCPUEngine emuEngine = CPU_ENGINE_SW;
+uint32_t numThreads = 0;
+uint32_t numRepeats = DEFAULT_REPEATS;
+uint64_t seed = DEFAULT_SEED;
+
+///////////////////////////////////////////////////////////////////////////////
+// Result of one benchmark: the work done by every repetition and the time it took
+struct TBenchResult {
+  std::string group, name;
+  std::map<std::string, uint64_t> params;
+  uint64_t cells = 0;             // DP cells, for GCUPS (0 if it does not apply)
+  uint64_t comparisons = 0;       // Sequence comparisons
+  uint64_t bytes = 0;             // Bytes read or written, for bytes/s
+  std::vector<double> seconds;
+};
+
+std::vector<TBenchResult> results;
+
+///////////////////////////////////////////////////////////////////////////////
+// xorshift64*: the same sequences on every machine and release for the same seed (unlike rand())
+uint64_t NextRandom(uint64_t & state)
+{
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545F4914F6CDD1DULL;
+}
+
+// Random sequence of the given length, as text
+void GenSequenceText(uint64_t & state, uint32_t length, char * text)
+{
+  static const char nucleobases[4] = {'A', 'C', 'G', 'T'};
+
+  for (uint32_t iChar = 0; iChar < length; ++ iChar)
+    text[iChar] = nucleobases[NextRandom(state) >> 62];
+}
+
+// Random packed sequence of the given length
+uint64_t GenPackedSequence(uint64_t & state, uint32_t length)
+{
+  uint64_t seq = NextRandom(state);
+  return (length >= 32) ? seq : seq & ((1ULL << (2 * length)) - 1);
+}
+
+// Writes numSeqs random sequences of the given length, one per line. Returns the size of the file, 0 on error.
+uint64_t GenSequenceFile(const char * fileName, uint64_t & state, uint32_t numSeqs, uint32_t length)
+{
+  FILE * output = fopen(fileName, "w");
+  char line[MAX_SEQ_LENGTH + 1];
+  bool ok = (output != NULL);
+
+  line[length] = '\n';
+  for (uint32_t iSeq = 0; ok && (iSeq < numSeqs); ++ iSeq) {
+    GenSequenceText(state, length, line);
+    ok = (fwrite(line, 1, length + 1, output) == length + 1);
+  }
+
+  if ((output == NULL) || (fclose(output) != 0) || !ok) {
+    printf("Error writing benchmark file [%s]\n", fileName);
+    return 0;
+  }
+  return (uint64_t)numSeqs * (length + 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+double Now()
+{
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+void PrintResult(const TBenchResult & result)
+{
+  double best = result.seconds[0];
+
+  for (double seconds : result.seconds)
+    best = (seconds < best) ? seconds : best;
+
+  printf("%-10s %-28s %10.3lf ms", result.group.c_str(), result.name.c_str(), best * 1e3);
+  if (result.cells > 0)
+    printf(" %9.3lf GCUPS", result.cells / best / 1e9);
+  if (result.bytes > 0)
+    printf(" %10.1lf MB/s", result.bytes / best / 1e6);
+  printf("\n");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Micro-benchmark of the Smith-Waterman kernel (CalcScore_CPU, bit-exact with CalcScoreLinearSystolicArray) on
+// KERNEL_PAIRS pairs of sequences of the given lengths.
+void BenchKernel(uint32_t lengthA, uint32_t lengthB)
+{
+  uint64_t state = seed;
+  std::vector<uint64_t> seqsA(KERNEL_PAIRS), seqsB(KERNEL_PAIRS);
+  TBenchResult result;
+  volatile uint32_t sink = 0;
+
+  for (uint32_t iPair = 0; iPair < KERNEL_PAIRS; ++ iPair) {
+    seqsA[iPair] = GenPackedSequence(state, lengthA);
+    seqsB[iPair] = GenPackedSequence(state, lengthB);
+  }
+
+  result.group = "kernel";
+  result.name = "sw_" + std::to_string(lengthA) + "x" + std::to_string(lengthB);
+  result.params["lengthA"] = lengthA;
+  result.params["lengthB"] = lengthB;
+  result.params["pairs"] = KERNEL_PAIRS;
+  result.cells = (uint64_t)KERNEL_PAIRS * lengthA * lengthB;
+  result.comparisons = KERNEL_PAIRS;
+
+  for (uint32_t iRepeat = 0; iRepeat < numRepeats; ++ iRepeat) {
+    uint32_t sum = 0;
+    double start = Now();
+    for (uint32_t iPair = 0; iPair < KERNEL_PAIRS; ++ iPair)
+      sum += CalcScore_CPU(seqsA[iPair], 0, lengthA, seqsB[iPair], 0, lengthB,
+                           CSeqMatcherDriver::AMBIGUOUS_DISABLED);
+    result.seconds.push_back(Now() - start);
+    sink = sink + sum;
+  }
+
+  PrintResult(result);
+  results.push_back(result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Packing of PACK_SEQS sequences of 32 nucleobases from text into the 2-bit words of the accelerator, and back
+// (the host counterpart of seqFromUInt64 in the kernel).
+void BenchPack()
+{
+  uint64_t state = seed;
+  std::vector<char> text((size_t)PACK_SEQS * MAX_SEQ_LENGTH);
+  std::vector<uint64_t> seqs(PACK_SEQS);
+  std::vector<uint8_t> unpacked((size_t)PACK_SEQS * MAX_SEQ_LENGTH);
+  TBenchResult pack, unpack;
+
+  for (uint32_t iSeq = 0; iSeq < PACK_SEQS; ++ iSeq)
+    GenSequenceText(state, MAX_SEQ_LENGTH, &text[(size_t)iSeq * MAX_SEQ_LENGTH]);
+
+  pack.group = unpack.group = "pack";
+  pack.name = "pack_text";
+  unpack.name = "unpack_words";
+  pack.params["seqs"] = unpack.params["seqs"] = PACK_SEQS;
+  pack.params["length"] = unpack.params["length"] = MAX_SEQ_LENGTH;
+  pack.bytes = unpack.bytes = text.size();
+
+  for (uint32_t iRepeat = 0; iRepeat < numRepeats; ++ iRepeat) {
+    double start = Now();
+    for (uint32_t iSeq = 0; iSeq < PACK_SEQS; ++ iSeq) {
+      const char * seqText = &text[(size_t)iSeq * MAX_SEQ_LENGTH];
+      uint64_t seq = 0;
+      for (uint32_t iChar = 0; iChar < MAX_SEQ_LENGTH; ++ iChar) {
+        uint8_t code = 0;
+        PackedDBNucleobaseCode(seqText[iChar], code);
+        seq |= uint64_t(code) << (2 * iChar);
+      }
+      seqs[iSeq] = seq;
+    }
+    pack.seconds.push_back(Now() - start);
+
+    start = Now();
+    for (uint32_t iSeq = 0; iSeq < PACK_SEQS; ++ iSeq) {
+      uint8_t * seqUnpacked = &unpacked[(size_t)iSeq * MAX_SEQ_LENGTH];
+      for (uint32_t iChar = 0; iChar < MAX_SEQ_LENGTH; ++ iChar)
+        seqUnpacked[iChar] = (seqs[iSeq] >> (2 * iChar)) & 0b11;
+    }
+    unpack.seconds.push_back(Now() - start);
+  }
+
+  PrintResult(pack);
+  PrintResult(unpack);
+  results.push_back(pack);
+  results.push_back(unpack);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Parsing of a file of PARSE_SEQS sequences (ParseSequenceFile, with numThreads threads). The file is read once
+// before timing, so it is measured from the page cache.
+bool BenchParse(const std::string & dir)
+{
+  uint64_t state = seed;
+  std::string fileName = dir + "/parse.txt";
+  std::vector<uint64_t> seqs(PARSE_SEQS);
+  std::vector<uint32_t> masks(PARSE_SEQS);
+  std::vector<uint8_t> lengths(PARSE_SEQS);
+  TBenchResult result;
+
+  result.group = "parse";
+  result.name = "lines_32";
+  result.params["seqs"] = PARSE_SEQS;
+  result.params["length"] = MAX_SEQ_LENGTH;
+  result.params["threads"] = numThreads;
+  result.bytes = GenSequenceFile(fileName.c_str(), state, PARSE_SEQS, MAX_SEQ_LENGTH);
+  if (result.bytes == 0)
+    return false;
+
+  for (uint32_t iRepeat = 0; iRepeat <= numRepeats; ++ iRepeat) {
+    double start = Now();
+    uint32_t numParsed = ParseSequenceFile(fileName.c_str(), seqs.data(), masks.data(), lengths.data(), PARSE_SEQS,
+                                           numThreads);
+    double seconds = Now() - start;
+
+    if (numParsed != PARSE_SEQS) {
+      printf("Error: parsed %u of %u sequences\n", numParsed, PARSE_SEQS);
+      return false;
+    }
+    // The first run warms up the page cache
+    if (iRepeat > 0)
+      result.seconds.push_back(seconds);
+  }
+
+  unlink(fileName.c_str());
+  PrintResult(result);
+  results.push_back(result);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writing of DUMP_BYTES of scores through CScoreWriter, including the final flush and close of the file.
+bool BenchDump(const std::string & dir)
+{
+  uint64_t state = seed;
+  std::string fileName = dir + "/scores.bin";
+  std::vector<int8_t> scores(DUMP_BYTES);
+  TBenchResult result;
+
+  for (int8_t & score : scores)
+    score = NextRandom(state) % (MAX_SEQ_LENGTH + 1);
+
+  result.group = "dump";
+  result.name = "score_writer";
+  result.params["bytes"] = DUMP_BYTES;
+  result.bytes = DUMP_BYTES;
+
+  for (uint32_t iRepeat = 0; iRepeat < numRepeats; ++ iRepeat) {
+    CScoreWriter writer;
+    double start = Now();
+    bool ok = writer.Open(fileName.c_str());
+
+    // In slices, as the chunked runs write them
+    for (uint32_t offset = 0; ok && (offset < DUMP_BYTES); offset += SCORE_WRITER_BLOCK_SIZE / 4)
+      ok = writer.Write(scores.data() + offset, SCORE_WRITER_BLOCK_SIZE / 4);
+    ok = writer.Close() && ok;
+    result.seconds.push_back(Now() - start);
+
+    if (!ok) {
+      printf("Error writing [%s]\n", fileName.c_str());
+      return false;
+    }
+  }
+
+  unlink(fileName.c_str());
+  PrintResult(result);
+  results.push_back(result);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// End-to-end run: parses the DB and the specimen into DMA buffers, runs the job on the device (or its emulation)
+// and writes the scores file. Opening the device and generating the files are not timed.
+bool BenchEndToEnd(CSeqMatcherDriver & seqMatcher, const std::string & dir, uint32_t numDBEntries,
+    uint32_t numSeqsSpecimen, uint32_t length)
+{
+  uint64_t state = seed;
+  std::string databaseFile = dir + "/database.txt";
+  std::string specimenFile = dir + "/specimen.txt";
+  std::string scoresFile = dir + "/e2e_scores.bin";
+  TBenchResult result;
+  bool ok = true;
+
+  uint64_t databaseBytes = GenSequenceFile(databaseFile.c_str(), state, numDBEntries, length);
+  uint64_t specimenBytes = GenSequenceFile(specimenFile.c_str(), state, numSeqsSpecimen, length);
+  if ((databaseBytes == 0) || (specimenBytes == 0))
+    return false;
+
+  result.group = "end_to_end";
+  result.name = "db" + std::to_string(numDBEntries) + "_spec" + std::to_string(numSeqsSpecimen) +
+                "_len" + std::to_string(length);
+  result.params["dbEntries"] = numDBEntries;
+  result.params["specimenSeqs"] = numSeqsSpecimen;
+  result.params["length"] = length;
+  result.comparisons = (uint64_t)numDBEntries * numSeqsSpecimen;
+  result.cells = result.comparisons * length * length;
+  result.bytes = databaseBytes + specimenBytes + result.comparisons;
+
+  uint64_t * seqsDB = (uint64_t *)seqMatcher.AllocDMACompatible(numDBEntries * sizeof(uint64_t), 1);
+  uint32_t * masksDB = (uint32_t *)seqMatcher.AllocDMACompatible(numDBEntries * sizeof(uint32_t), 1);
+  uint8_t * lengthsDB = (uint8_t *)seqMatcher.AllocDMACompatible(numDBEntries * sizeof(uint8_t), 1);
+  uint64_t * seqsSpecimen = (uint64_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen * sizeof(uint64_t), 1);
+  uint32_t * masksSpecimen = (uint32_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen * sizeof(uint32_t), 1);
+  uint8_t * lengthsSpecimen = (uint8_t *)seqMatcher.AllocDMACompatible(numSeqsSpecimen * sizeof(uint8_t), 1);
+  int8_t * scores = (int8_t *)seqMatcher.AllocDMACompatible(result.comparisons * sizeof(int8_t), 1);
+
+  if ( (seqsDB == NULL) || (masksDB == NULL) || (lengthsDB == NULL) || (seqsSpecimen == NULL) ||
+       (masksSpecimen == NULL) || (lengthsSpecimen == NULL) || (scores == NULL) ) {
+    printf("Error allocating DMA memory.\n");
+    ok = false;
+  }
+
+  for (uint32_t iRepeat = 0; ok && (iRepeat <= numRepeats); ++ iRepeat) {
+    CScoreWriter writer;
+    uint32_t numComparisons = 0;
+    double start = Now();
+
+    ok = (ParseSequenceFile(databaseFile.c_str(), seqsDB, masksDB, lengthsDB, numDBEntries, numThreads) == numDBEntries) &&
+         (ParseSequenceFile(specimenFile.c_str(), seqsSpecimen, masksSpecimen, lengthsSpecimen, numSeqsSpecimen,
+                            numThreads) == numSeqsSpecimen) &&
+         (seqMatcher.SeqMatcher_HW(numDBEntries, numSeqsSpecimen, seqsDB, seqsSpecimen, lengthsDB, lengthsSpecimen,
+                                   scores, numComparisons) == CAccelDriver::OK) &&
+         writer.Open(scoresFile.c_str()) && writer.Write(scores, result.comparisons);
+    ok = writer.Close() && ok;
+    double seconds = Now() - start;
+
+    if (!ok)
+      printf("Error in the end-to-end run %s\n", result.name.c_str());
+    // The first run warms up the page cache and the buffers
+    else if (iRepeat > 0)
+      result.seconds.push_back(seconds);
+  }
+
+  seqMatcher.FreeDMACompatible(seqsDB);
+  seqMatcher.FreeDMACompatible(masksDB);
+  seqMatcher.FreeDMACompatible(lengthsDB);
+  seqMatcher.FreeDMACompatible(seqsSpecimen);
+  seqMatcher.FreeDMACompatible(masksSpecimen);
+  seqMatcher.FreeDMACompatible(lengthsSpecimen);
+  seqMatcher.FreeDMACompatible(scores);
+  unlink(databaseFile.c_str());
+  unlink(specimenFile.c_str());
+  unlink(scoresFile.c_str());
+
+  if (ok) {
+    PrintResult(result);
+    results.push_back(result);
+  }
+  return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Mean, standard deviation, minimum and maximum of the samples, as a JSON object
+std::string StatsToJSON(const std::vector<double> & samples)
+{
+  double sum = 0, sumSquares = 0, min = samples[0], max = samples[0];
+  char buffer[256];
+
+  for (double x : samples) {
+    sum += x;
+    min = (x < min) ? x : min;
+    max = (x > max) ? x : max;
+  }
+  double mean = sum / samples.size();
+  for (double x : samples)
+    sumSquares += (x - mean) * (x - mean);
+  double stddev = (samples.size() > 1) ? sqrt(sumSquares / (samples.size() - 1)) : 0;
+
+  snprintf(buffer, sizeof(buffer), "{\"mean\": %.6g, \"stddev\": %.6g, \"min\": %.6g, \"max\": %.6g}",
+           mean, stddev, min, max);
+  return buffer;
+}
+
+// Rate of every repetition, from the work done by each one
+std::vector<double> Rates(const TBenchResult & result, uint64_t work, double scale)
+{
+  std::vector<double> rates;
+
+  for (double seconds : result.seconds)
+    rates.push_back(work / seconds / scale);
+  return rates;
+}
+
+bool WriteJSON(FILE * output, const char * backend)
+{
+  fprintf(output, "{\n");
+  fprintf(output, "  \"benchmark\": \"seqMatcherBench\",\n");
+  fprintf(output, "  \"seed\": %llu,\n", (unsigned long long)seed);
+  fprintf(output, "  \"repeats\": %u,\n", numRepeats);
+  fprintf(output, "  \"threads\": %u,\n", (numThreads > 0) ? numThreads : std::thread::hardware_concurrency());
+  fprintf(output, "  \"backend\": \"%s\",\n", backend);
+  fprintf(output, "  \"results\": [\n");
+
+  for (size_t iResult = 0; iResult < results.size(); ++ iResult) {
+    const TBenchResult & result = results[iResult];
+
+    fprintf(output, "    {\"group\": \"%s\", \"name\": \"%s\", \"params\": {", result.group.c_str(), result.name.c_str());
+    for (auto it = result.params.begin(); it != result.params.end(); ++ it)
+      fprintf(output, "%s\"%s\": %llu", (it == result.params.begin()) ? "" : ", ", it->first.c_str(),
+              (unsigned long long)it->second);
+    fprintf(output, "},\n");
+    fprintf(output, "     \"time_s\": %s", StatsToJSON(result.seconds).c_str());
+    if (result.cells > 0)
+      fprintf(output, ",\n     \"gcups\": %s", StatsToJSON(Rates(result, result.cells, 1e9)).c_str());
+    if (result.comparisons > 0)
+      fprintf(output, ",\n     \"comparisons_per_s\": %s", StatsToJSON(Rates(result, result.comparisons, 1)).c_str());
+    if (result.bytes > 0)
+      fprintf(output, ",\n     \"bytes_per_s\": %s", StatsToJSON(Rates(result, result.bytes, 1)).c_str());
+    fprintf(output, "}%s\n", (iResult + 1 < results.size()) ? "," : "");
+  }
+
+  fprintf(output, "  ]\n");
+  fprintf(output, "}\n");
+  return !ferror(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+bool OpenDevice(CSeqMatcherDriver & seqMatcher)
+{
+  if (emuEngine == CPU_ENGINE_NONE) {
+    printf("\n\nThe end-to-end benchmarks require that the bitstream is loaded in the FPGA.\n");
+    printf("This program has to be run with sudo.\n");
+    printf("Press ENTER to confirm that the bitstream is loaded (proceeding without it can crash the board).\n\n");
+    getchar();
+  }
+
+  if (seqMatcher.Open(DRIVER_NAME) != CAccelDriver::OK) {
+    printf("Error opening the device driver %s\n", DRIVER_NAME);
+    return false;
+  }
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void PrintUsage()
+{
+  printf("Benchmarks of the kernel, packing, parser, score writer and end-to-end runs, with reproducible inputs.\n\n");
+  printf("Usage: seqMatcherBench [options]\n\n");
+  printf("Options:\n");
+  printf("  --json=file            Writes the results as JSON (default: seqMatcherBench.json)\n");
+  printf("  --repeats=N            Repetitions of every benchmark (default: %u)\n", DEFAULT_REPEATS);
+  printf("  --seed=S               Seed of the generated inputs (default: %u)\n", DEFAULT_SEED);
+  printf("  --threads=N            Threads of the parser and the emulator (default: all the cores)\n");
+  printf("  --db-entries=N         DB entries of the end-to-end runs (default: %u)\n", DEFAULT_DB_ENTRIES);
+  printf("  --backend=emu          End-to-end runs on the emulation of the accelerator on the CPU (default)\n");
+  printf("  --backend=hw           End-to-end runs on the accelerator\n");
+  printf("  --no-end-to-end        Only runs the micro-benchmarks\n");
+  printf("  --tmpdir=dir           Directory of the generated files (default: /tmp)\n\n");
+  printf("Example: ./seqMatcherBench --json=bench.json --repeats=10\n\n");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char ** argv)
+{
+  const char * jsonFile = "seqMatcherBench.json";
+  const char * tmpDir = "/tmp";
+  const char * backend = "emu";
+  uint32_t numDBEntries = DEFAULT_DB_ENTRIES;
+  bool endToEnd = true;
+
+  setlocale(LC_NUMERIC, "en_US.utf8");
+
+  for (int iArg = 1; iArg < argc; ++ iArg) {
+    unsigned long long value;
+
+    if (strncmp(argv[iArg], "--json=", 7) == 0)
+      jsonFile = argv[iArg] + 7;
+    else if ((sscanf(argv[iArg], "--repeats=%u", &numRepeats) == 1) && (numRepeats > 0))
+      ;
+    else if (sscanf(argv[iArg], "--seed=%llu", &value) == 1)
+      seed = (value != 0) ? value : DEFAULT_SEED;    // xorshift needs a non-zero state
+    else if (sscanf(argv[iArg], "--threads=%u", &numThreads) == 1)
+      ;
+    else if ((sscanf(argv[iArg], "--db-entries=%u", &numDBEntries) == 1) && (numDBEntries > 0))
+      ;
+    else if (strcmp(argv[iArg], "--backend=emu") == 0) {
+      emuEngine = CPU_ENGINE_SW;
+      backend = "emu";
+    }
+    else if (strcmp(argv[iArg], "--backend=hw") == 0) {
+      emuEngine = CPU_ENGINE_NONE;
+      backend = "hw";
+    }
+    else if (strcmp(argv[iArg], "--no-end-to-end") == 0)
+      endToEnd = false;
+    else if (strncmp(argv[iArg], "--tmpdir=", 9) == 0)
+      tmpDir = argv[iArg] + 9;
+    else {
+      printf("Unknown option %s\n\n", argv[iArg]);
+      PrintUsage();
+      return -1;
+    }
+  }
+
+  // Generated files go to a private directory
+  std::string dirTemplate = std::string(tmpDir) + "/seqMatcherBench.XXXXXX";
+  std::vector<char> dirName(dirTemplate.begin(), dirTemplate.end());
+  dirName.push_back('\0');
+  if (mkdtemp(dirName.data()) == NULL) {
+    printf("Error creating a directory in [%s]\n", tmpDir);
+    return -1;
+  }
+  std::string dir = dirName.data();
+
+  printf("%-10s %-28s %13s\n", "group", "benchmark", "best time");
+
+  static const uint32_t kernelLengths[] = {8, 16, 24, 32};
+  for (uint32_t lengthA : kernelLengths)
+    for (uint32_t lengthB : kernelLengths)
+      BenchKernel(lengthA, lengthB);
+
+  BenchPack();
+  bool ok = BenchParse(dir) && BenchDump(dir);
+
+  if (ok && endToEnd) {
+    CSeqMatcherDriver hwDevice(false);
+    CSeqMatcherEmuDriver emuDevice(emuEngine, numThreads, false);
+    CSeqMatcherDriver & seqMatcher = (emuEngine != CPU_ENGINE_NONE) ? emuDevice : hwDevice;
+
+    // Length sweep with the full specimen cache of the accelerator, and specimen sweep with the longest sequences
+    static const uint32_t sweepLengths[] = {8, 16, 24, 32};
+    static const uint32_t sweepSpecimens[] = {100, 250, 500};
+
+    ok = OpenDevice(seqMatcher);
+    for (uint32_t length : sweepLengths)
+      ok = ok && BenchEndToEnd(seqMatcher, dir, numDBEntries, 1000, length);
+    for (uint32_t numSeqsSpecimen : sweepSpecimens)
+      ok = ok && BenchEndToEnd(seqMatcher, dir, numDBEntries, numSeqsSpecimen, MAX_SEQ_LENGTH);
+  }
+
+  rmdir(dir.c_str());
+
+  FILE * output = fopen(jsonFile, "w");
+  if (output == NULL) {
+    printf("Error opening file [%s]\n", jsonFile);
+    return -1;
+  }
+  bool written = WriteJSON(output, backend);
+  written = (fclose(output) == 0) && written;
+  if (!written)
+    printf("Error writing [%s]\n", jsonFile);
+  else
+    printf("\nResults written to [%s]\n", jsonFile);
+
+  return (ok && written) ? 0 : -1;
+}
@@ -0,0 +1,558 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <thread>
+#include "CAccelDriver.hpp"
+#include "CSeqMatcherDriver.hpp"
+#include "seqMatcherCPU.hpp"
+#include "trace.hpp"
+
+#define MAX_SEQ_LENGTH 32
+
+///////////////////////////////////////////////////////////////////////////////
+// Minimal 8-bit unsigned SIMD layer used by the Smith-Waterman engine. Every lane holds the scores of a different
+// DB entry.
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VEC_LANES 32
+typedef __m256i vec8_t;
+static inline vec8_t VecSet1(uint8_t x) { return _mm256_set1_epi8((char)x); }
+static inline void VecStore(uint8_t * dest, vec8_t a) { _mm256_storeu_si256((__m256i *)dest, a); }
+static inline vec8_t VecLoad(const uint8_t * src) { return _mm256_loadu_si256((const __m256i *)src); }
+static inline vec8_t VecCmpEq(vec8_t a, vec8_t b) { return _mm256_cmpeq_epi8(a, b); }
+static inline vec8_t VecOr(vec8_t a, vec8_t b) { return _mm256_or_si256(a, b); }
+static inline vec8_t VecAnd(vec8_t a, vec8_t b) { return _mm256_and_si256(a, b); }
+static inline vec8_t VecAddSat(vec8_t a, vec8_t b) { return _mm256_adds_epu8(a, b); }
+static inline vec8_t VecSubSat(vec8_t a, vec8_t b) { return _mm256_subs_epu8(a, b); }
+static inline vec8_t VecMax(vec8_t a, vec8_t b) { return _mm256_max_epu8(a, b); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VEC_LANES 16
+typedef __m128i vec8_t;
+static inline vec8_t VecSet1(uint8_t x) { return _mm_set1_epi8((char)x); }
+static inline void VecStore(uint8_t * dest, vec8_t a) { _mm_storeu_si128((__m128i *)dest, a); }
+static inline vec8_t VecLoad(const uint8_t * src) { return _mm_loadu_si128((const __m128i *)src); }
+static inline vec8_t VecCmpEq(vec8_t a, vec8_t b) { return _mm_cmpeq_epi8(a, b); }
+static inline vec8_t VecOr(vec8_t a, vec8_t b) { return _mm_or_si128(a, b); }
+static inline vec8_t VecAnd(vec8_t a, vec8_t b) { return _mm_and_si128(a, b); }
+static inline vec8_t VecAddSat(vec8_t a, vec8_t b) { return _mm_adds_epu8(a, b); }
+static inline vec8_t VecSubSat(vec8_t a, vec8_t b) { return _mm_subs_epu8(a, b); }
+static inline vec8_t VecMax(vec8_t a, vec8_t b) { return _mm_max_epu8(a, b); }
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VEC_LANES 16
+typedef uint8x16_t vec8_t;
+static inline vec8_t VecSet1(uint8_t x) { return vdupq_n_u8(x); }
+static inline void VecStore(uint8_t * dest, vec8_t a) { vst1q_u8(dest, a); }
+static inline vec8_t VecLoad(const uint8_t * src) { return vld1q_u8(src); }
+static inline vec8_t VecCmpEq(vec8_t a, vec8_t b) { return vceqq_u8(a, b); }
+static inline vec8_t VecOr(vec8_t a, vec8_t b) { return vorrq_u8(a, b); }
+static inline vec8_t VecAnd(vec8_t a, vec8_t b) { return vandq_u8(a, b); }
+static inline vec8_t VecAddSat(vec8_t a, vec8_t b) { return vqaddq_u8(a, b); }
+static inline vec8_t VecSubSat(vec8_t a, vec8_t b) { return vqsubq_u8(a, b); }
+static inline vec8_t VecMax(vec8_t a, vec8_t b) { return vmaxq_u8(a, b); }
+#else
+// Portable fallback, left to the auto-vectorizer
+#define VEC_LANES 8
+struct vec8_t { uint8_t v[VEC_LANES]; };
+static inline vec8_t VecSet1(uint8_t x) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = x; return r; }
+static inline void VecStore(uint8_t * dest, vec8_t a) { for (int i = 0; i < VEC_LANES; ++ i) dest[i] = a.v[i]; }
+static inline vec8_t VecLoad(const uint8_t * src) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = src[i]; return r; }
+static inline vec8_t VecCmpEq(vec8_t a, vec8_t b) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = (a.v[i] == b.v[i]) ? 0xFF : 0; return r; }
+static inline vec8_t VecOr(vec8_t a, vec8_t b) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = a.v[i] | b.v[i]; return r; }
+static inline vec8_t VecAnd(vec8_t a, vec8_t b) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = a.v[i] & b.v[i]; return r; }
+static inline vec8_t VecAddSat(vec8_t a, vec8_t b) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = (a.v[i] + b.v[i] > 0xFF) ? 0xFF : a.v[i] + b.v[i]; return r; }
+static inline vec8_t VecSubSat(vec8_t a, vec8_t b) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = (a.v[i] > b.v[i]) ? a.v[i] - b.v[i] : 0; return r; }
+static inline vec8_t VecMax(vec8_t a, vec8_t b) { vec8_t r; for (int i = 0; i < VEC_LANES; ++ i) r.v[i] = (a.v[i] > b.v[i]) ? a.v[i] : b.v[i]; return r; }
+#endif
+
+// Match masks (Peq) of a pattern: bit i of peq[c] is set when nucleobase i of the pattern matches nucleobase c.
+// Ambiguous nucleobases of the pattern match everything as wildcards and nothing as mismatches; wildcardEq is the
+// mask used for ambiguous nucleobases of the text.
+struct TPatternMasks {
+  uint32_t peq[4];
+  uint32_t wildcardEq;
+  uint8_t length;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+static void BuildPatternMasks(uint64_t seq, uint32_t mask, uint8_t length, uint32_t ambiguousMode,
+    TPatternMasks & pattern)
+{
+  uint32_t lengthMask = (length == MAX_SEQ_LENGTH) ? 0xFFFFFFFF : ((1u << length) - 1);
+
+  if (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_DISABLED)
+    mask = 0;
+
+  for (uint8_t c = 0; c < 4; ++ c)
+    pattern.peq[c] = 0;
+
+  for (uint8_t i = 0; i < length; ++ i)
+    pattern.peq[(seq >> (2 * i)) & 0b11] |= 1u << i;
+
+  for (uint8_t c = 0; c < 4; ++ c) {
+    if (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_WILDCARD)
+      pattern.peq[c] |= mask & lengthMask;
+    else
+      pattern.peq[c] &= ~mask;
+  }
+
+  pattern.wildcardEq = (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_WILDCARD) ? lengthMask : 0;
+  pattern.length = length;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Processes the text one nucleobase (one full DP column) at a time. Pv/Mv are the vertical +1/-1 deltas of the
+// column and the distance in the last row is tracked incrementally. A 1 is shifted into Ph because the top row is
+// D[0][j] = j (global distance).
+static inline uint8_t CalcEditDistance(const TPatternMasks & pattern, uint64_t text, uint32_t textMask,
+    uint8_t textLength)
+{
+  if (pattern.length == 0)
+    return textLength;
+
+  uint32_t lastRowBit = 1u << (pattern.length - 1);
+  uint32_t pv = (pattern.length == MAX_SEQ_LENGTH) ? 0xFFFFFFFF : ((1u << pattern.length) - 1);
+  uint32_t mv = 0;
+  uint8_t distance = pattern.length;
+
+  for (uint8_t j = 0; j < textLength; ++ j) {
+    uint32_t eq = ((textMask >> j) & 1) ? pattern.wildcardEq : pattern.peq[(text >> (2 * j)) & 0b11];
+
+    uint32_t xv = eq | mv;
+    uint32_t xh = (((eq & pv) + pv) ^ pv) | eq;
+    uint32_t ph = mv | ~(xh | pv);
+    uint32_t mh = pv & xh;
+
+    if (ph & lastRowBit)
+      ++ distance;
+    else if (mh & lastRowBit)
+      -- distance;
+
+    ph = (ph << 1) | 1;
+    mh = mh << 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+  }
+
+  return distance;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint8_t CalcEditDistance_CPU(uint64_t seqA, uint32_t maskA, uint8_t lengthA,
+    uint64_t seqB, uint32_t maskB, uint8_t lengthB, uint32_t ambiguousMode)
+{
+  TPatternMasks pattern;
+
+  BuildPatternMasks(seqB, maskB, lengthB, ambiguousMode, pattern);
+  return CalcEditDistance(pattern, seqA, (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_DISABLED) ? 0 : maskA, lengthA);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+static uint32_t SeqMatcherEditDistance_CPU(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const uint64_t * seqsDB, const uint64_t * seqsSpecimen, const uint8_t * lengthsDB, const uint8_t * lengthsSpecimen,
+    const uint32_t * masksDB, const uint32_t * masksSpecimen, uint32_t ambiguousMode, int8_t * scores)
+{
+  bool useMasks = (ambiguousMode != CSeqMatcherDriver::AMBIGUOUS_DISABLED);
+
+  // The specimen sequences are the patterns: their masks are built once and reused for every DB entry.
+  TPatternMasks * patterns = (TPatternMasks *)malloc(numSeqsSpecimen * sizeof(TPatternMasks));
+  if (patterns == NULL) {
+    printf("Error allocating the edit distance pattern masks\n");
+    return 0;
+  }
+
+  for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec)
+    BuildPatternMasks(seqsSpecimen[iSpec], useMasks ? masksSpecimen[iSpec] : 0, lengthsSpecimen[iSpec],
+                      ambiguousMode, patterns[iSpec]);
+
+  for (uint32_t iDB = 0; iDB < numDBEntries; ++ iDB) {
+    uint32_t maskDB = useMasks ? masksDB[iDB] : 0;
+
+    for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec)
+      *scores++ = CalcEditDistance(patterns[iSpec], seqsDB[iDB], maskDB, lengthsDB[iDB]);
+  }
+
+  free(patterns);
+  return numDBEntries * numSeqsSpecimen;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Smith-Waterman engine, bit-exact with CalcScoreLinearSystolicArray (match +1, mismatch -1, gap -1, floor 0).
+// The accelerator scores are 5-bit, but no local alignment of two 32-nucleobase sequences can exceed 31 except a
+// full 32/32 match, which the workers bypass and output as 32. The only remaining difference with the textbook
+// recurrence is that PE0 of the array keeps comparing seqA[0] with the nucleobases of seqB that follow its length
+// (on every anti-diagonal of the sweep), so a pair with no real match scores 1 when seqA[0] matches that padding.
+
+// Whether two nucleobases match. Pairs involving an ambiguous nucleobase are scored according to ambiguousMode.
+static inline bool IsMatch(uint8_t a, bool ambiguousA, uint8_t b, bool ambiguousB, uint32_t ambiguousMode)
+{
+  return (ambiguousA || ambiguousB) ? (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_WILDCARD) : (a == b);
+}
+
+// Reproduces the PE0 comparisons of seqA[0] against every nucleobase of seqB, including the padding.
+static bool PE0Match(uint64_t seqA, uint32_t maskA, uint8_t lengthA, uint64_t seqB, uint32_t maskB, uint8_t lengthB,
+    uint32_t ambiguousMode)
+{
+  uint8_t numDiags = lengthA + lengthB - 1;  // Wraps like the uint8_t loop bound of the kernel
+
+  for (uint32_t k = 0; k < numDiags; ++ k) {
+    uint32_t iB = (k < MAX_SEQ_LENGTH) ? k : MAX_SEQ_LENGTH - 1;  // The seqB shift register stops at its last entry
+
+    if (IsMatch(seqA & 0b11, maskA & 1, (seqB >> (2 * iB)) & 0b11, (maskB >> iB) & 1, ambiguousMode))
+      return true;
+  }
+
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint8_t CalcScore_CPU(uint64_t seqA, uint32_t maskA, uint8_t lengthA,
+    uint64_t seqB, uint32_t maskB, uint8_t lengthB, uint32_t ambiguousMode)
+{
+  uint8_t H[MAX_SEQ_LENGTH+1][MAX_SEQ_LENGTH+1] = {};
+  uint8_t maxScore = 0;
+
+  if (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_DISABLED)
+    maskA = maskB = 0;
+
+  for (uint8_t i = 1; i <= lengthA; ++ i) {
+    for (uint8_t j = 1; j <= lengthB; ++ j) {
+      bool match = IsMatch((seqA >> (2 * (i-1))) & 0b11, (maskA >> (i-1)) & 1,
+                           (seqB >> (2 * (j-1))) & 0b11, (maskB >> (j-1)) & 1, ambiguousMode);
+      uint8_t score = match ? H[i-1][j-1] + 1 : (H[i-1][j-1] > 0 ? H[i-1][j-1] - 1 : 0);
+
+      if (H[i-1][j] > score + 1)
+        score = H[i-1][j] - 1;
+      if (H[i][j-1] > score + 1)
+        score = H[i][j-1] - 1;
+
+      H[i][j] = score;
+      if (score > maxScore)
+        maxScore = score;
+    }
+  }
+
+  if ((maxScore == 0) && PE0Match(seqA, maskA, lengthA, seqB, maskB, lengthB, ambiguousMode))
+    maxScore = 1;
+
+  return maxScore;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Scores VEC_LANES DB entries at a time against every specimen sequence. The codes of ambiguous nucleobases are
+// chosen so that they never compare equal (0xFF in the DB, 0xFE in the specimen), and in wildcard mode they are
+// ORed into the match mask instead.
+static uint32_t SeqMatcherSW_CPU(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const uint64_t * seqsDB, const uint64_t * seqsSpecimen, const uint8_t * lengthsDB, const uint8_t * lengthsSpecimen,
+    const uint32_t * masksDB, const uint32_t * masksSpecimen, uint32_t ambiguousMode, int8_t * scores)
+{
+  bool useMasks = (ambiguousMode != CSeqMatcherDriver::AMBIGUOUS_DISABLED);
+  bool wildcard = (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_WILDCARD);
+  const vec8_t one = VecSet1(1);
+  const vec8_t two = VecSet1(2);
+
+  for (uint32_t firstDB = 0; firstDB < numDBEntries; firstDB += VEC_LANES) {
+    uint32_t numLanes = (numDBEntries - firstDB < VEC_LANES) ? numDBEntries - firstDB : VEC_LANES;
+    uint8_t codesA[MAX_SEQ_LENGTH][VEC_LANES] = {};
+    uint8_t wildcardA[MAX_SEQ_LENGTH][VEC_LANES] = {};
+    uint8_t validA[MAX_SEQ_LENGTH][VEC_LANES] = {};  // 0xFF while the row is inside the DB entry
+    uint8_t maxLengthA = 0;
+
+    for (uint32_t iLane = 0; iLane < numLanes; ++ iLane) {
+      uint64_t seq = seqsDB[firstDB + iLane];
+      uint32_t mask = useMasks ? masksDB[firstDB + iLane] : 0;
+      uint8_t length = lengthsDB[firstDB + iLane];
+
+      for (uint8_t i = 0; i < length; ++ i) {
+        bool ambiguous = (mask >> i) & 1;
+        codesA[i][iLane] = ambiguous ? 0xFF : (seq >> (2 * i)) & 0b11;
+        wildcardA[i][iLane] = (ambiguous && wildcard) ? 0xFF : 0;
+        validA[i][iLane] = 0xFF;
+      }
+
+      if (length > maxLengthA)
+        maxLengthA = length;
+    }
+
+    for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec) {
+      uint64_t seqB = seqsSpecimen[iSpec];
+      uint32_t maskB = useMasks ? masksSpecimen[iSpec] : 0;
+      uint8_t lengthB = lengthsSpecimen[iSpec];
+      vec8_t codesB[MAX_SEQ_LENGTH], wildcardB[MAX_SEQ_LENGTH];
+      vec8_t H[MAX_SEQ_LENGTH+1];  // Previous row, H[0] is the left border
+      vec8_t best = VecSet1(0);
+
+      for (uint8_t j = 0; j < lengthB; ++ j) {
+        bool ambiguous = (maskB >> j) & 1;
+        codesB[j] = VecSet1(ambiguous ? 0xFE : (seqB >> (2 * j)) & 0b11);
+        wildcardB[j] = VecSet1((ambiguous && wildcard) ? 0xFF : 0);
+      }
+
+      for (uint8_t j = 0; j <= lengthB; ++ j)
+        H[j] = VecSet1(0);
+
+      for (uint8_t i = 0; i < maxLengthA; ++ i) {
+        vec8_t a = VecLoad(codesA[i]);
+        vec8_t aWildcard = VecLoad(wildcardA[i]);
+        vec8_t valid = VecLoad(validA[i]);
+        vec8_t diag = H[0];
+        vec8_t left = H[0];
+
+        for (uint8_t j = 0; j < lengthB; ++ j) {
+          vec8_t up = H[j+1];
+          vec8_t match = VecOr(VecOr(VecCmpEq(a, codesB[j]), aWildcard), wildcardB[j]);
+          vec8_t hit = VecSubSat(VecAddSat(diag, VecAnd(match, two)), one);  // diag + 1 or max(diag - 1, 0)
+          vec8_t score = VecMax(hit, VecSubSat(VecMax(up, left), one));
+
+          score = VecAnd(score, valid);
+          diag = up;
+          left = score;
+          H[j+1] = score;
+          best = VecMax(best, score);
+        }
+      }
+
+      uint8_t laneScores[VEC_LANES];
+      VecStore(laneScores, best);
+
+      for (uint32_t iLane = 0; iLane < numLanes; ++ iLane) {
+        uint32_t iDB = firstDB + iLane;
+        uint8_t score = laneScores[iLane];
+
+        if ((score == 0) && PE0Match(seqsDB[iDB], useMasks ? masksDB[iDB] : 0, lengthsDB[iDB], seqB, maskB, lengthB,
+                                     ambiguousMode))
+          score = 1;
+
+        scores[iDB * numSeqsSpecimen + iSpec] = score;
+      }
+    }
+  }
+
+  return numDBEntries * numSeqsSpecimen;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Bit-sliced (SWAR) Smith-Waterman engine. Scores are 5-bit like score_t in the accelerator, so plane k of a
+// TSlicedScore holds bit k of the scores of 64 DB entries, one per bit, and the +1/-1/max updates of the systolic
+// array become boolean operations over the planes. As in the accelerator, only a full 32/32 match could reach 32:
+// it is tracked separately along the main diagonal and output as 32.
+//
+// The cell update max(match ? diag + 1 : diag - 1, up - 1, left - 1, 0) is computed as
+// max(diag + 2 * match, up, left) - 1 saturated at 0, so every cell takes one add, two max and one dec-sat pass.
+// It still takes 4-5x the time of SeqMatcherSW_CPU with SSE2 or AVX2, so the tools do not offer it; it is kept
+// for targets without a SIMD unit.
+#define SCORE_NUM_BITS 5
+#define SWAR_LANES 64
+#define SWAR_AMBIGUOUS_CODE 4  // Match plane of an ambiguous specimen nucleobase
+
+struct TSlicedScore {
+  uint64_t bit[SCORE_NUM_BITS + 1];  // The top plane is only used by diag + 2, which can reach 32
+};
+
+static inline TSlicedScore SlicedMax(const TSlicedScore & a, const TSlicedScore & b, int numBits)
+{
+  TSlicedScore r;
+  uint64_t aGreater = 0;
+  uint64_t equal = ~0ULL;
+
+  for (int k = numBits - 1; k >= 0; -- k) {
+    uint64_t diff = a.bit[k] ^ b.bit[k];
+    aGreater |= equal & diff & a.bit[k];
+    equal &= ~diff;
+  }
+  for (int k = 0; k < numBits; ++ k)
+    r.bit[k] = b.bit[k] ^ ((a.bit[k] ^ b.bit[k]) & aGreater);
+  return r;
+}
+
+static uint32_t SeqMatcherSWAR_CPU(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const uint64_t * seqsDB, const uint64_t * seqsSpecimen, const uint8_t * lengthsDB, const uint8_t * lengthsSpecimen,
+    const uint32_t * masksDB, const uint32_t * masksSpecimen, uint32_t ambiguousMode, int8_t * scores)
+{
+  bool useMasks = (ambiguousMode != CSeqMatcherDriver::AMBIGUOUS_DISABLED);
+  bool wildcard = (ambiguousMode == CSeqMatcherDriver::AMBIGUOUS_WILDCARD);
+
+  for (uint32_t firstDB = 0; firstDB < numDBEntries; firstDB += SWAR_LANES) {
+    uint32_t numLanes = (numDBEntries - firstDB < SWAR_LANES) ? numDBEntries - firstDB : SWAR_LANES;
+
+    // Bit-sliced DB nucleobases: low and high bit of the 2-bit code, ambiguity and whether the row is inside the entry
+    uint64_t lowA[MAX_SEQ_LENGTH] = {}, highA[MAX_SEQ_LENGTH] = {}, ambiguousA[MAX_SEQ_LENGTH] = {};
+    uint64_t validA[MAX_SEQ_LENGTH] = {};
+    uint64_t fullLengthA = 0;
+    uint8_t maxLengthA = 0;
+
+    for (uint32_t iLane = 0; iLane < numLanes; ++ iLane) {
+      uint64_t seq = seqsDB[firstDB + iLane];
+      uint32_t mask = useMasks ? masksDB[firstDB + iLane] : 0;
+      uint8_t length = lengthsDB[firstDB + iLane];
+      uint64_t laneBit = 1ULL << iLane;
+
+      for (uint8_t i = 0; i < length; ++ i) {
+        lowA[i] |= ((seq >> (2 * i)) & 1) ? laneBit : 0;
+        highA[i] |= ((seq >> (2 * i + 1)) & 1) ? laneBit : 0;
+        ambiguousA[i] |= ((mask >> i) & 1) ? laneBit : 0;
+        validA[i] |= laneBit;
+      }
+
+      if (length == MAX_SEQ_LENGTH)
+        fullLengthA |= laneBit;
+      if (length > maxLengthA)
+        maxLengthA = length;
+    }
+
+    // Match plane of every row against every specimen nucleobase code, so the cells only look it up
+    uint64_t matchA[MAX_SEQ_LENGTH][SWAR_AMBIGUOUS_CODE + 1];
+
+    for (uint8_t i = 0; i < maxLengthA; ++ i) {
+      for (uint32_t code = 0; code < SWAR_AMBIGUOUS_CODE; ++ code) {
+        uint64_t lowB = (code & 1) ? ~0ULL : 0;
+        uint64_t highB = (code & 2) ? ~0ULL : 0;
+        uint64_t match = ~(lowA[i] ^ lowB) & ~(highA[i] ^ highB);
+
+        matchA[i][code] = wildcard ? (match | ambiguousA[i]) : (match & ~ambiguousA[i]);
+      }
+      matchA[i][SWAR_AMBIGUOUS_CODE] = wildcard ? ~0ULL : 0;
+    }
+
+    for (uint32_t iSpec = 0; iSpec < numSeqsSpecimen; ++ iSpec) {
+      uint64_t seqB = seqsSpecimen[iSpec];
+      uint32_t maskB = useMasks ? masksSpecimen[iSpec] : 0;
+      uint8_t lengthB = lengthsSpecimen[iSpec];
+      uint8_t codesB[MAX_SEQ_LENGTH];
+      TSlicedScore H[MAX_SEQ_LENGTH+1] = {};  // Previous row, H[0] is the left border
+      TSlicedScore best = {};
+      uint64_t fullMatch = (lengthB == MAX_SEQ_LENGTH) ? fullLengthA : 0;
+
+      for (uint8_t j = 0; j < lengthB; ++ j)
+        codesB[j] = ((maskB >> j) & 1) ? SWAR_AMBIGUOUS_CODE : (seqB >> (2 * j)) & 3;
+
+      for (uint8_t i = 0; i < maxLengthA; ++ i) {
+        const uint64_t * matchRow = matchA[i];
+        TSlicedScore diag = H[0];
+        TSlicedScore left = H[0];
+
+        for (uint8_t j = 0; j < lengthB; ++ j) {
+          uint64_t match = matchRow[codesB[j]];
+
+          if (i == j)
+            fullMatch &= match;
+
+          // diag + 2 * match: the carry enters at plane 1
+          TSlicedScore up = H[j+1];
+          TSlicedScore sum;
+          uint64_t carry = match;
+
+          sum.bit[0] = diag.bit[0];
+          for (int k = 1; k < SCORE_NUM_BITS; ++ k) {
+            sum.bit[k] = diag.bit[k] ^ carry;
+            carry &= diag.bit[k];
+          }
+          sum.bit[SCORE_NUM_BITS] = carry;
+
+          TSlicedScore gap = SlicedMax(up, left, SCORE_NUM_BITS);
+          gap.bit[SCORE_NUM_BITS] = 0;
+          TSlicedScore top = SlicedMax(sum, gap, SCORE_NUM_BITS + 1);
+
+          // Saturating - 1, with the rows outside the DB entry cleared
+          TSlicedScore score;
+          uint64_t borrow = ~0ULL;
+          uint64_t keep = 0;
+
+          for (int k = 0; k <= SCORE_NUM_BITS; ++ k)
+            keep |= top.bit[k];
+          keep &= validA[i];
+          for (int k = 0; k < SCORE_NUM_BITS; ++ k) {
+            score.bit[k] = (top.bit[k] ^ borrow) & keep;
+            borrow &= ~top.bit[k];
+          }
+
+          diag = up;
+          left = score;
+          H[j+1] = score;
+          best = SlicedMax(best, score, SCORE_NUM_BITS);
+        }
+      }
+
+      for (uint32_t iLane = 0; iLane < numLanes; ++ iLane) {
+        uint32_t iDB = firstDB + iLane;
+        uint8_t score = 0;
+
+        for (int k = 0; k < SCORE_NUM_BITS; ++ k)
+          score |= ((best.bit[k] >> iLane) & 1) << k;
+
+        if ((fullMatch >> iLane) & 1)
+          score = MAX_SEQ_LENGTH;
+        else if ((score == 0) && PE0Match(seqsDB[iDB], useMasks ? masksDB[iDB] : 0, lengthsDB[iDB], seqB, maskB,
+                                          lengthB, ambiguousMode))
+          score = 1;
+
+        scores[iDB * numSeqsSpecimen + iSpec] = score;
+      }
+    }
+  }
+
+  return numDBEntries * numSeqsSpecimen;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+typedef uint32_t (*TEngineFunc)(uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const uint64_t * seqsDB, const uint64_t * seqsSpecimen, const uint8_t * lengthsDB, const uint8_t * lengthsSpecimen,
+    const uint32_t * masksDB, const uint32_t * masksSpecimen, uint32_t ambiguousMode, int8_t * scores);
+
+uint32_t SeqMatcher_CPU(TCPUEngine engine, uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const uint64_t * seqsDB, const uint64_t * seqsSpecimen, const uint8_t * lengthsDB, const uint8_t * lengthsSpecimen,
+    const uint32_t * masksDB, const uint32_t * masksSpecimen, uint32_t ambiguousMode, int8_t * scores,
+    uint32_t numThreads)
+{
+  TRACE_SCOPE("CPU engine");
+  TEngineFunc engineFunc;
+  uint32_t groupSize;  // DB entries processed together by the engine
+
+  switch (engine) {
+  case CPU_ENGINE_EDIT_DISTANCE: engineFunc = SeqMatcherEditDistance_CPU; groupSize = VEC_LANES; break;
+  case CPU_ENGINE_SW: engineFunc = SeqMatcherSW_CPU; groupSize = VEC_LANES; break;
+  case CPU_ENGINE_SWAR: engineFunc = SeqMatcherSWAR_CPU; groupSize = SWAR_LANES; break;
+  default:
+    printf("Unknown CPU engine %d\n", engine);
+    return 0;
+  }
+
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  if (numThreads == 0)
+    numThreads = 1;
+
+  // Every thread takes a contiguous slice of the DB (a multiple of groupSize entries) and its rows of scores.
+  uint32_t numGroups = (numDBEntries + groupSize - 1) / groupSize;
+  if (numThreads > numGroups)
+    numThreads = (numGroups > 0) ? numGroups : 1;
+
+  std::vector<std::thread> threads;
+  std::vector<uint32_t> comparisons(numThreads, 0);
+  bool useMasks = (ambiguousMode != CSeqMatcherDriver::AMBIGUOUS_DISABLED);
+
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread) {
+    uint32_t begin = (uint64_t)numGroups * iThread / numThreads * groupSize;
+    uint32_t end = (uint64_t)numGroups * (iThread + 1) / numThreads * groupSize;
+    if (end > numDBEntries)
+      end = numDBEntries;
+
+    threads.push_back(std::thread([=, &comparisons]() {
+      TRACE_SCOPE("CPU engine slice");
+      comparisons[iThread] = engineFunc(end - begin, numSeqsSpecimen, seqsDB + begin, seqsSpecimen,
+                                        lengthsDB + begin, lengthsSpecimen, useMasks ? masksDB + begin : NULL,
+                                        masksSpecimen, ambiguousMode, scores + (uint64_t)begin * numSeqsSpecimen);
+    }));
+  }
+
+  uint32_t numComparisons = 0;
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread) {
+    threads[iThread].join();
+    numComparisons += comparisons[iThread];
+  }
+
+  return numComparisons;
+}
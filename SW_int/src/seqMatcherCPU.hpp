@@ -0,0 +1,27 @@
+#ifndef SEQMATCHERCPU_HPP
+#define SEQMATCHERCPU_HPP
+
+// Host (CPU) implementations of the sequence matching engines. They take the same packed inputs as the
+// accelerator (2-bit nucleobases in an uint64_t, ambiguity masks) and produce the scores in the same layout,
+// so they can run without the board.
+
+typedef enum {CPU_ENGINE_NONE = 0, CPU_ENGINE_EDIT_DISTANCE = 1, CPU_ENGINE_SW = 2, CPU_ENGINE_SWAR = 3} TCPUEngine;
+
+// Global (unit-cost) edit distance between two sequences, computed with the bit-parallel algorithm of Myers/Hyyro.
+// Matches the accelerator synthesized with EDIT_DISTANCE_ENGINE.
+uint8_t CalcEditDistance_CPU(uint64_t seqA, uint32_t maskA, uint8_t lengthA,
+    uint64_t seqB, uint32_t maskB, uint8_t lengthB, uint32_t ambiguousMode);
+
+// Smith-Waterman score of two sequences, bit-exact with the accelerator (CalcScoreLinearSystolicArray).
+uint8_t CalcScore_CPU(uint64_t seqA, uint32_t maskA, uint8_t lengthA,
+    uint64_t seqB, uint32_t maskB, uint8_t lengthB, uint32_t ambiguousMode);
+
+// Matches every DB entry against every specimen sequence with the given engine. scores[iDB * numSeqsSpecimen + iSpec]
+// receives the result, as in the accelerator. The DB is split among numThreads threads (0 uses all the cores).
+// Returns the number of comparisons performed.
+uint32_t SeqMatcher_CPU(TCPUEngine engine, uint32_t numDBEntries, uint32_t numSeqsSpecimen,
+    const uint64_t * seqsDB, const uint64_t * seqsSpecimen, const uint8_t * lengthsDB, const uint8_t * lengthsSpecimen,
+    const uint32_t * masksDB, const uint32_t * masksSpecimen, uint32_t ambiguousMode, int8_t * scores,
+    uint32_t numThreads = 0);
+
+#endif // SEQMATCHERCPU_HPP
@@ -0,0 +1,214 @@
+// Client of seqMatcherDaemon: scores a specimen file against one of the DBs loaded by the daemon and writes the
+// scores file, in the same format as seqMatcher.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <locale.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <map>
+#include <vector>
+#include <thread>
+#include "util.hpp"
+
+#include "CAccelDriver.hpp"
+#include "CSeqMatcherDriver.hpp"
+#include "seqParser.hpp"
+#include "seqMatcherProtocol.hpp"
+
+///////////////////////////////////////////////////////////////////////////////
+int ConnectToDaemon(const char * socketPath)
+{
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address;
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+
+  if ((fd != -1) && (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)) {
+    close(fd);
+    fd = -1;
+  }
+  if (fd == -1)
+    printf("Error connecting to the daemon at [%s]\n", socketPath);
+
+  return fd;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Scores the specimen with one query per seqsPerQuery sequences. The queries are sent by a thread while the replies
+// are read, so that the daemon can process them back to back, and can stop reading the requests while the client
+// owes it its reply budget. Returns the scores of the whole specimen (DB entry major), or an empty vector on error.
+std::vector<int8_t> RunQueries(int fd, uint32_t dbId, uint32_t ambiguousMode, uint32_t seqsPerQuery, uint32_t numSeqs,
+    const uint64_t * seqs, const uint32_t * masks, const uint8_t * lengths, uint32_t & numDBEntries)
+{
+  std::vector<int8_t> scores;
+  uint32_t numQueries = (numSeqs + seqsPerQuery - 1) / seqsPerQuery;
+
+  std::thread sender([=]() {
+    for (uint32_t iQuery = 0; iQuery < numQueries; ++ iQuery) {
+      uint32_t first = iQuery * seqsPerQuery;
+      uint32_t n = (numSeqs - first < seqsPerQuery) ? numSeqs - first : seqsPerQuery;
+      TQueryRequest request = {QUERY_MAGIC, iQuery, dbId, n, ambiguousMode};
+
+      if ( !SendAll(fd, &request, sizeof(request)) || !SendAll(fd, seqs + first, n * sizeof(uint64_t)) ||
+           !SendAll(fd, masks + first, n * sizeof(uint32_t)) || !SendAll(fd, lengths + first, n * sizeof(uint8_t)) ) {
+        printf("Error sending query %u\n", iQuery);
+        return;
+      }
+    }
+  });
+
+  // Reads the replies. After an error the connection is shut down, which also stops the sender.
+  auto ReadReplies = [&]() {
+    std::vector<int8_t> queryScores;
+
+    for (uint32_t iReply = 0; iReply < numQueries; ++ iReply) {
+      TQueryReply reply;
+
+      if (!RecvAll(fd, &reply, sizeof(reply)) || (reply.magic != QUERY_MAGIC) || (reply.tag >= numQueries)) {
+        printf("Error receiving the replies\n");
+        return false;
+      }
+      if ((reply.status == QUERY_TOO_LARGE) && (reply.numSeqs < seqsPerQuery)) {
+        printf("Error: the daemon accepts up to %u sequences per query against DB %u (--seqs-per-query)\n",
+               reply.numSeqs, dbId);
+        return false;
+      }
+      if (reply.status != QUERY_OK) {
+        printf("Error: the daemon returned status %u for query %u\n", reply.status, reply.tag);
+        return false;
+      }
+
+      // The payload size is only trusted if the reply matches its query
+      uint32_t first = reply.tag * seqsPerQuery;
+      uint32_t n = (numSeqs - first < seqsPerQuery) ? numSeqs - first : seqsPerQuery;
+      if ((reply.numSeqs != n) || ((uint64_t)reply.numDBEntries * numSeqs > SIZE_MAX)) {
+        printf("Error: invalid reply to query %u (%u DB entries, %u sequences)\n", reply.tag, reply.numDBEntries,
+               reply.numSeqs);
+        return false;
+      }
+
+      if (scores.empty()) {
+        numDBEntries = reply.numDBEntries;
+        scores.resize((size_t)numDBEntries * numSeqs);
+      }
+
+      queryScores.resize((size_t)reply.numDBEntries * reply.numSeqs);
+      if ((reply.numDBEntries != numDBEntries) || !RecvAll(fd, queryScores.data(), queryScores.size())) {
+        printf("Error receiving the scores of query %u\n", reply.tag);
+        return false;
+      }
+
+      // Each query holds a range of columns of the scores matrix
+      for (uint32_t iEntry = 0; iEntry < numDBEntries; ++ iEntry)
+        memcpy(scores.data() + (size_t)iEntry * numSeqs + first,
+               queryScores.data() + (size_t)iEntry * reply.numSeqs, reply.numSeqs);
+    }
+    return true;
+  };
+
+  bool ok = ReadReplies();
+  if (!ok) {
+    shutdown(fd, SHUT_RDWR);
+    scores.clear();
+  }
+  sender.join();
+
+  return scores;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void PrintUsage()
+{
+  printf("Scores a specimen file against a DB loaded by seqMatcherDaemon.\n\n");
+  printf("Usage: seqMatcherClient dbId specimenFile scoresFile [options]\n\n");
+  printf("Options:\n");
+  printf("  --socket=path          Unix socket of the daemon (default: %s)\n", DEFAULT_SOCKET_PATH);
+  printf("  --ambiguous=mismatch   Ambiguous nucleobases (N, R, Y...) always count as a mismatch (default)\n");
+  printf("  --ambiguous=wildcard   Ambiguous nucleobases match any nucleobase\n");
+  printf("  --seqs-per-query=N     Specimen sequences per query, up to %u (default). Queries against large DBs\n",
+         QUERY_MAX_SEQS);
+  printf("                         need fewer to fit in the reply budget of the daemon\n\n");
+  printf("Example: ./seqMatcherClient 0 specimen.txt scores.bin\n\n");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char ** argv)
+{
+  const char * socketPath = DEFAULT_SOCKET_PATH;
+  uint32_t ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_MISMATCH;
+  uint32_t seqsPerQuery = QUERY_MAX_SEQS;
+  uint32_t dbId;
+
+  setlocale(LC_NUMERIC, "en_US.utf8");
+
+  if ((argc < 4) || (sscanf(argv[1], "%u", &dbId) != 1)) {
+    PrintUsage();
+    return -1;
+  }
+
+  for (int iArg = 4; iArg < argc; ++ iArg) {
+    if (strncmp(argv[iArg], "--socket=", 9) == 0)
+      socketPath = argv[iArg] + 9;
+    else if (strcmp(argv[iArg], "--ambiguous=mismatch") == 0)
+      ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_MISMATCH;
+    else if (strcmp(argv[iArg], "--ambiguous=wildcard") == 0)
+      ambiguousMode = CSeqMatcherDriver::AMBIGUOUS_WILDCARD;
+    else if ((sscanf(argv[iArg], "--seqs-per-query=%u", &seqsPerQuery) == 1) && (seqsPerQuery > 0) &&
+             (seqsPerQuery <= QUERY_MAX_SEQS))
+      ;
+    else {
+      printf("Unknown option %s\n\n", argv[iArg]);
+      PrintUsage();
+      return -1;
+    }
+  }
+
+  uint64_t * seqs;
+  uint32_t * masks;
+  uint8_t * lengths;
+  uint32_t numSeqs = LoadSequenceFile(argv[2], seqs, masks, lengths);
+  if (numSeqs == 0)
+    return -1;
+
+  int fd = ConnectToDaemon(socketPath);
+  int res = -1;
+
+  if (fd != -1) {
+    struct timespec start, end;
+    uint32_t numDBEntries = 0;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+    std::vector<int8_t> scores = RunQueries(fd, dbId, ambiguousMode, seqsPerQuery, numSeqs, seqs, masks, lengths,
+                                            numDBEntries);
+    clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+    close(fd);
+
+    if (!scores.empty()) {
+      printf("Calculated %'u * %'u scores in %0.3lf ms\n", numDBEntries, numSeqs, CalcTimeDiff(end, start)/1e6);
+
+      FILE * output = fopen(argv[3], "wb");
+      if (output == NULL)
+        printf("Error opening file [%s]\n", argv[3]);
+      else {
+        if (fwrite(scores.data(), 1, scores.size(), output) == scores.size())
+          res = 0;
+        else
+          printf("Error writing scores.\n");
+        fclose(output);
+      }
+    }
+  }
+
+  free(seqs);
+  free(masks);
+  free(lengths);
+  return res;
+}
@@ -0,0 +1,662 @@
+// Persistent sequence matching service. It owns the device and the DMA buffers, keeps the reference DBs loaded and
+// scores the specimens of the queries received on a Unix socket (see seqMatcherProtocol.hpp). Pending queries
+// against the same DB are coalesced into one accelerator job, so each query only costs its share of the compute time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <locale.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <map>
+#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include "util.hpp"
+
+#include "CAccelDriver.hpp"
+#include "CSeqMatcherDriver.hpp"
+#include "seqMatcherCPU.hpp"
+#include "CSeqMatcherEmuDriver.hpp"
+#include "seqParser.hpp"
+#include "seqMatcherProtocol.hpp"
+
+const char* DRIVER_NAME = "/dev/seq_matcher";
+
+// Size of the scores buffer of one job. Larger DBs are processed in slices.
+#define DEFAULT_SCORES_BUFFER_MB 32
+// Time that the oldest pending query waits for other queries to be coalesced with it
+#define DEFAULT_COALESCE_US 1000
+// Reply budget of a client, in scores buffers: the scores of its queries being computed and of its replies not sent
+// yet. It is the largest reply, and the connection is not read while a new query would exceed it.
+#define CLIENT_REPLY_BUFFERS 2
+// Wait before accepting connections again when the daemon is out of file descriptors or memory
+#define ACCEPT_RETRY_MS 100
+
+struct TReferenceDB {
+  const char * fileName;
+  uint32_t numEntries;
+  uint64_t * seqs;
+  uint32_t * masks;
+  uint8_t * lengths;
+};
+
+struct TReply {
+  TQueryReply header;
+  std::vector<int8_t> scores;
+  uint64_t budgetScores;          // Reply budget of the client released when the reply is sent
+};
+
+// Connection of a client. The replies are queued by the scheduler, and by the reader thread of the connection for
+// invalid requests, and sent by the sender thread of the connection, so that a slow client does not stall the
+// scheduler. The socket is closed when all of them are done with it.
+struct TClient {
+  int fd;
+  std::mutex lock;
+  std::condition_variable replyQueued;
+  std::condition_variable replySent;
+  std::deque<TReply> replies;
+  uint32_t numPending = 0;        // Queries queued for the scheduler, whose reply has not been queued yet
+  uint64_t budgetScores = 0;      // Scores of the pending queries and of the queued replies (CLIENT_REPLY_BUFFERS)
+  bool readerDone = false;
+
+  TClient(int Fd) : fd(Fd) {}
+  ~TClient() { close(fd); }
+};
+
+struct TQuery {
+  std::shared_ptr<TClient> client;
+  TQueryRequest request;
+  std::vector<uint64_t> seqs;
+  std::vector<uint32_t> masks;
+  std::vector<uint8_t> lengths;
+  std::vector<int8_t> scores;
+  std::chrono::steady_clock::time_point arrival;
+};
+
+struct TDaemon {
+  CSeqMatcherDriver * device;      // NULL with a CPU engine
+  TCPUEngine cpuEngine;
+  uint32_t numThreads;
+  std::vector<TReferenceDB> dbs;
+
+  // Buffers of one job: the coalesced specimens and the scores of a slice of the DB
+  uint64_t * seqsSpecimen;
+  uint32_t * masksSpecimen;
+  uint8_t * lengthsSpecimen;
+  int8_t * scores;
+  uint32_t scoresSize;
+  uint64_t maxReplyScores;         // Reply budget of a client
+
+  std::chrono::microseconds coalesceTime;
+  std::list<TQuery *> pendingQueries;
+  std::mutex lock;
+  std::condition_variable queryQueued;
+};
+
+volatile sig_atomic_t stopRequested = 0;
+
+void StopHandler(int)
+{
+  stopRequested = 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Queues a reply for the sender thread of the connection. scores (numDBEntries * numSeqs) are only sent with
+// QUERY_OK. pending is set for the reply of a query that was queued for the scheduler, which holds
+// numDBEntries * numSeqs scores of the reply budget of the client until it is sent.
+void QueueReply(TClient & client, uint32_t tag, uint32_t status, uint32_t numDBEntries, uint32_t numSeqs,
+    std::vector<int8_t> && scores = std::vector<int8_t>(), bool pending = false)
+{
+  std::lock_guard<std::mutex> guard(client.lock);
+  uint64_t budgetScores = pending ? (uint64_t)numDBEntries * numSeqs : 0;
+
+  client.replies.push_back({{QUERY_MAGIC, tag, status, numDBEntries, numSeqs}, std::move(scores), budgetScores});
+  if (pending)
+    -- client.numPending;
+  client.replyQueued.notify_one();
+}
+
+// Sends the replies of a connection, until its reader is done and the scheduler has no query of it left. After a
+// failed send the connection is shut down, and the remaining replies are dropped.
+void SenderThread(std::shared_ptr<TClient> client)
+{
+  std::unique_lock<std::mutex> guard(client->lock);
+  bool ok = true;
+
+  while (true) {
+    client->replyQueued.wait(guard, [&]() {
+      return !client->replies.empty() || (client->readerDone && (client->numPending == 0));
+    });
+    if (client->replies.empty())
+      break;
+
+    TReply reply = std::move(client->replies.front());
+    client->replies.pop_front();
+    guard.unlock();
+
+    uint64_t numScores = (uint64_t)reply.header.numDBEntries * reply.header.numSeqs;
+    if (ok && (reply.header.status == QUERY_OK) && (numScores != reply.scores.size()))
+      reply.header.status = QUERY_DEVICE_ERROR;
+    if (ok)
+      ok = SendAll(client->fd, &reply.header, sizeof(reply.header)) &&
+           ((reply.header.status != QUERY_OK) || SendAll(client->fd, reply.scores.data(), (uint32_t)numScores));
+    if (!ok)
+      shutdown(client->fd, SHUT_RDWR);
+
+    guard.lock();
+    client->budgetScores -= reply.budgetScores;
+    client->replySent.notify_one();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Reads the requests of one connection and queues them for the scheduler.
+void ClientThread(TDaemon & daemon, std::shared_ptr<TClient> client)
+{
+  TQueryRequest request;
+  std::thread sender(SenderThread, client);
+
+  while (RecvAll(client->fd, &request, sizeof(request))) {
+    // The payload size cannot be trusted after these errors, so the connection is closed
+    if (request.magic != QUERY_MAGIC) {
+      QueueReply(*client, request.tag, QUERY_BAD_REQUEST, 0, 0);
+      break;
+    }
+    if ((request.numSeqs == 0) || (request.numSeqs > QUERY_MAX_SEQS)) {
+      QueueReply(*client, request.tag, QUERY_TOO_LARGE, 0, QUERY_MAX_SEQS);
+      break;
+    }
+
+    TQuery * query = new TQuery;
+    query->client = client;
+    query->request = request;
+    query->seqs.resize(request.numSeqs);
+    query->masks.resize(request.numSeqs);
+    query->lengths.resize(request.numSeqs);
+
+    if ( !RecvAll(client->fd, query->seqs.data(), request.numSeqs * sizeof(uint64_t)) ||
+         !RecvAll(client->fd, query->masks.data(), request.numSeqs * sizeof(uint32_t)) ||
+         !RecvAll(client->fd, query->lengths.data(), request.numSeqs * sizeof(uint8_t)) ) {
+      delete query;
+      break;
+    }
+
+    uint32_t status = QUERY_OK;
+    uint32_t numDBEntries = (request.dbId < daemon.dbs.size()) ? daemon.dbs[request.dbId].numEntries : 0;
+    uint64_t numScores = (uint64_t)numDBEntries * request.numSeqs;
+    uint32_t maxSeqs = request.numSeqs;
+
+    if (request.dbId >= daemon.dbs.size())
+      status = QUERY_UNKNOWN_DB;
+    else if (request.ambiguousMode > CSeqMatcherDriver::AMBIGUOUS_WILDCARD)
+      status = QUERY_BAD_REQUEST;
+    else if (numScores > daemon.maxReplyScores) {
+      status = QUERY_TOO_LARGE;
+      maxSeqs = daemon.maxReplyScores / numDBEntries;
+    }
+    else {
+      for (uint32_t iSeq = 0; iSeq < request.numSeqs; ++ iSeq)
+        if (query->lengths[iSeq] > 32)
+          status = QUERY_BAD_REQUEST;
+    }
+
+    if (status != QUERY_OK) {
+      QueueReply(*client, request.tag, status, 0, maxSeqs);
+      delete query;
+      continue;
+    }
+
+    // The reply budget bounds the memory of a client: its next requests stay in the socket until replies are sent
+    {
+      std::unique_lock<std::mutex> guard(client->lock);
+      client->replySent.wait(guard, [&]() { return client->budgetScores + numScores <= daemon.maxReplyScores; });
+      client->budgetScores += numScores;
+      ++ client->numPending;
+    }
+    std::lock_guard<std::mutex> guard(daemon.lock);
+    query->arrival = std::chrono::steady_clock::now();
+    daemon.pendingQueries.push_back(query);
+    daemon.queryQueued.notify_one();
+  }
+
+  // The sender ends after the replies of the queries still queued for the scheduler
+  {
+    std::lock_guard<std::mutex> guard(client->lock);
+    client->readerDone = true;
+    client->replyQueued.notify_one();
+  }
+  sender.join();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Accepts the connections. When the daemon is out of file descriptors or memory it retries every ACCEPT_RETRY_MS,
+// as connections are closed; after any other error no new client is accepted.
+void AcceptThread(TDaemon & daemon, int listenFd)
+{
+  bool retrying = false;
+
+  while (true) {
+    int fd = accept(listenFd, NULL, NULL);
+
+    if (fd == -1) {
+      if ((errno == EINTR) || (errno == ECONNABORTED))
+        continue;
+      if ((errno == EMFILE) || (errno == ENFILE) || (errno == ENOBUFS) || (errno == ENOMEM)) {
+        if (!retrying)
+          printf("Warning: cannot accept connections (%s), retrying\n", strerror(errno));
+        retrying = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(ACCEPT_RETRY_MS));
+        continue;
+      }
+      printf("Error accepting connections (%s), no new clients will be served\n", strerror(errno));
+      return;
+    }
+
+    retrying = false;
+    std::thread(ClientThread, std::ref(daemon), std::make_shared<TClient>(fd)).detach();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Queries that can share a job with the oldest pending query
+static inline bool SameJob(const TQuery * a, const TQuery * b)
+{
+  return (a->request.dbId == b->request.dbId) && (a->request.ambiguousMode == b->request.ambiguousMode);
+}
+
+// Number of specimen sequences pending for the job of the oldest query (called with the lock held)
+uint32_t PendingSeqs(TDaemon & daemon)
+{
+  uint32_t numSeqs = 0;
+  for (TQuery * query : daemon.pendingQueries)
+    if (SameJob(query, daemon.pendingQueries.front()))
+      numSeqs += query->request.numSeqs;
+  return numSeqs;
+}
+
+// Takes from the queue the oldest query and the following ones of the same job, while they fit in the specimen
+// cache of the accelerator (called with the lock held)
+std::vector<TQuery *> TakeBatch(TDaemon & daemon)
+{
+  std::vector<TQuery *> batch;
+  uint32_t numSeqs = 0;
+  TQuery * first = daemon.pendingQueries.front();
+
+  for (auto it = daemon.pendingQueries.begin(); it != daemon.pendingQueries.end(); ) {
+    if (!SameJob(*it, first)) {
+      ++ it;
+      continue;
+    }
+    if (numSeqs + (*it)->request.numSeqs > QUERY_MAX_SEQS)
+      break;
+    numSeqs += (*it)->request.numSeqs;
+    batch.push_back(*it);
+    it = daemon.pendingQueries.erase(it);
+  }
+
+  return batch;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Scores a batch of queries with one job per slice of the DB, and sends the replies.
+void RunBatch(TDaemon & daemon, std::vector<TQuery *> & batch)
+{
+  uint32_t dbId = batch[0]->request.dbId;
+  TReferenceDB & db = daemon.dbs[dbId];
+  uint32_t ambiguousMode = batch[0]->request.ambiguousMode;
+  uint32_t numSeqs = 0;
+  struct timespec start, end;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &start);
+
+  // The specimens of all the queries are concatenated
+  for (TQuery * query : batch) {
+    uint32_t n = query->request.numSeqs;
+    memcpy(daemon.seqsSpecimen + numSeqs, query->seqs.data(), n * sizeof(uint64_t));
+    memcpy(daemon.masksSpecimen + numSeqs, query->masks.data(), n * sizeof(uint32_t));
+    memcpy(daemon.lengthsSpecimen + numSeqs, query->lengths.data(), n * sizeof(uint8_t));
+    query->scores.resize((size_t)db.numEntries * n);
+    numSeqs += n;
+  }
+
+  // With the device the scores buffer is split in two halves: the job of a slice runs while the scores of the
+  // previous slice are copied to the queries
+  uint32_t numHalves = (daemon.device != NULL) ? 2 : 1;
+  uint32_t sliceEntries = daemon.scoresSize / numHalves / numSeqs;
+  // Keeps the second half as aligned as a DMA buffer
+  if (numHalves > 1)
+    sliceEntries -= sliceEntries % DMA_ARENA_ALIGNMENT;
+  uint32_t numSlices = (db.numEntries + sliceEntries - 1) / sliceEntries;
+  CSeqMatcherDriver::TJobHandle job = CSeqMatcherDriver::INVALID_JOB_HANDLE;
+  bool ok = true;
+
+  auto SubmitSlice = [&](uint32_t iSlice) {
+    uint32_t firstEntry = iSlice * sliceEntries;
+    uint32_t numEntries = (db.numEntries - firstEntry < sliceEntries) ? db.numEntries - firstEntry : sliceEntries;
+    job = daemon.device->Submit(numEntries, numSeqs, db.seqs + firstEntry, daemon.seqsSpecimen,
+                                db.lengths + firstEntry, daemon.lengthsSpecimen,
+                                daemon.scores + (iSlice % numHalves) * sliceEntries * numSeqs,
+                                db.masks + firstEntry, daemon.masksSpecimen, ambiguousMode);
+    return job != CSeqMatcherDriver::INVALID_JOB_HANDLE;
+  };
+
+  if (daemon.device != NULL)
+    ok = SubmitSlice(0);
+
+  for (uint32_t iSlice = 0; ok && (iSlice < numSlices); ++ iSlice) {
+    uint32_t firstEntry = iSlice * sliceEntries;
+    uint32_t numEntries = (db.numEntries - firstEntry < sliceEntries) ? db.numEntries - firstEntry : sliceEntries;
+    int8_t * sliceScores = daemon.scores + (iSlice % numHalves) * sliceEntries * numSeqs;
+    uint32_t numComparisons = 0;
+
+    if (daemon.device != NULL) {
+      ok = daemon.device->Wait(job, numComparisons) == CAccelDriver::OK;
+      job = CSeqMatcherDriver::INVALID_JOB_HANDLE;
+      if (ok && (iSlice + 1 < numSlices))
+        ok = SubmitSlice(iSlice + 1);
+    }
+    else
+      numComparisons = SeqMatcher_CPU(daemon.cpuEngine, numEntries, numSeqs, db.seqs + firstEntry,
+                                      daemon.seqsSpecimen, db.lengths + firstEntry, daemon.lengthsSpecimen,
+                                      db.masks + firstEntry, daemon.masksSpecimen, ambiguousMode, sliceScores,
+                                      daemon.numThreads);
+    ok = ok && (numComparisons == numEntries * numSeqs);
+
+    // Each row of scores holds the scores of all the queries of the batch
+    for (uint32_t iEntry = 0; ok && (iEntry < numEntries); ++ iEntry) {
+      const int8_t * row = sliceScores + iEntry * numSeqs;
+      for (TQuery * query : batch) {
+        uint32_t n = query->request.numSeqs;
+        memcpy(query->scores.data() + (size_t)(firstEntry + iEntry) * n, row, n);
+        row += n;
+      }
+    }
+  }
+
+  // After an error the job of the next slice may still be running
+  if (job != CSeqMatcherDriver::INVALID_JOB_HANDLE) {
+    uint32_t numComparisons;
+    daemon.device->Wait(job, numComparisons);
+  }
+
+  // The replies are sent by the connections, so that the next batch can start at once
+  for (TQuery * query : batch) {
+    QueueReply(*query->client, query->request.tag, ok ? QUERY_OK : QUERY_DEVICE_ERROR, db.numEntries,
+               query->request.numSeqs, ok ? std::move(query->scores) : std::vector<int8_t>(), true);
+    delete query;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &end);
+  printf("%s: %u queries (%u sequences) against DB %u in %0.3lf ms\n", ok ? "Done" : "Error", (uint32_t)batch.size(),
+         numSeqs, dbId, CalcTimeDiff(end, start)/1e6);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Loads a DB, into DMA buffers when there is a device.
+bool LoadReferenceDB(TDaemon & daemon, const char * fileName, uint32_t cacheable)
+{
+  TReferenceDB db = {fileName, 0, NULL, NULL, NULL};
+
+  printf("Loading DB %u [%s]...\n", (uint32_t)daemon.dbs.size(), fileName);
+  db.numEntries = LoadSequenceFile(fileName, db.seqs, db.masks, db.lengths, daemon.numThreads);
+  if (db.numEntries == 0)
+    return false;
+
+  if (daemon.device != NULL) {
+    uint64_t * seqs = (uint64_t *)daemon.device->AllocDMACompatible(db.numEntries * sizeof(uint64_t), cacheable);
+    uint32_t * masks = (uint32_t *)daemon.device->AllocDMACompatible(db.numEntries * sizeof(uint32_t), cacheable);
+    uint8_t * lengths = (uint8_t *)daemon.device->AllocDMACompatible(db.numEntries * sizeof(uint8_t), cacheable);
+
+    bool allocated = (seqs != NULL) && (masks != NULL) && (lengths != NULL);
+    if (allocated) {
+      memcpy(seqs, db.seqs, db.numEntries * sizeof(uint64_t));
+      memcpy(masks, db.masks, db.numEntries * sizeof(uint32_t));
+      memcpy(lengths, db.lengths, db.numEntries * sizeof(uint8_t));
+    }
+    free(db.seqs);
+    free(db.masks);
+    free(db.lengths);
+
+    if (!allocated) {
+      printf("Error allocating DMA memory for DB [%s].\n", fileName);
+      for (void * buffer : {(void *)seqs, (void *)masks, (void *)lengths})
+        if (buffer != NULL)
+          daemon.device->FreeDMACompatible(buffer);
+      return false;
+    }
+    db.seqs = seqs;
+    db.masks = masks;
+    db.lengths = lengths;
+  }
+
+  printf("Loaded %'u DB entries\n", db.numEntries);
+  daemon.dbs.push_back(db);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+void PrintUsage()
+{
+  printf("Keeps the device and the DBs loaded, and scores the specimens received on a Unix socket.\n\n");
+  printf("Usage: seqMatcherDaemon dbFile [dbFile...] [options]\n\n");
+  printf("The DBs are identified by their position (0, 1...). They can be sequence files or packed DBs.\n\n");
+  printf("Options:\n");
+  printf("  --socket=path          Unix socket to listen on (default: %s)\n", DEFAULT_SOCKET_PATH);
+  printf("  --coalesce-us=N        Time a query waits for others to share its job (default: %u us)\n",
+         DEFAULT_COALESCE_US);
+  printf("  --scores-buffer=N      Size of the scores buffer of a job in MB (default: %u). The replies owed to a\n",
+         DEFAULT_SCORES_BUFFER_MB);
+  printf("                         client, and the largest reply, are limited to %u times this size\n",
+         CLIENT_REPLY_BUFFERS);
+  printf("  --cpu-engine=sw|editdistance\n");
+  printf("                         Compute the scores on the CPU, without the device\n");
+  printf("  --threads=N            Number of threads of the parser and the CPU engines (default: all the cores)\n");
+  printf("  --uncached             Allocate the DMA buffers non-cacheable\n");
+  printf("  --poll-us=N            Busy-poll the accelerator for up to N us before waiting for its interrupt\n");
+  printf("  --timeout-ms=N         Reset the accelerator and fail a job that runs for more than N ms\n");
+  printf("  --backend=hw|emu|emu-editdistance\n");
+  printf("                         Run the jobs on the accelerator (default), or emulate it on the CPU\n\n");
+  printf("The bitstream has to be loaded before starting the daemon. Use seqMatcherClient to send queries.\n\n");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+int main(int argc, char ** argv)
+{
+  const char * socketPath = DEFAULT_SOCKET_PATH;
+  uint32_t coalesceUs = DEFAULT_COALESCE_US;
+  uint32_t scoresBufferMB = DEFAULT_SCORES_BUFFER_MB;
+  uint32_t cacheable = 1;
+  uint32_t pollWindowUs = 0;
+  uint32_t jobTimeoutMs = 0;
+  TCPUEngine emuEngine = CPU_ENGINE_NONE;
+  std::vector<const char *> dbFiles;
+  TDaemon daemon;
+
+  setlocale(LC_NUMERIC, "en_US.utf8");
+  // The output usually goes to a log file
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  daemon.device = NULL;
+  daemon.cpuEngine = CPU_ENGINE_NONE;
+  daemon.numThreads = 0;
+
+  for (int iArg = 1; iArg < argc; ++ iArg) {
+    if (strncmp(argv[iArg], "--socket=", 9) == 0)
+      socketPath = argv[iArg] + 9;
+    else if (sscanf(argv[iArg], "--coalesce-us=%u", &coalesceUs) == 1)
+      ;
+    else if ((sscanf(argv[iArg], "--scores-buffer=%u", &scoresBufferMB) == 1) && (scoresBufferMB > 0))
+      ;
+    else if (strcmp(argv[iArg], "--cpu-engine=sw") == 0)
+      daemon.cpuEngine = CPU_ENGINE_SW;
+    else if (strcmp(argv[iArg], "--cpu-engine=editdistance") == 0)
+      daemon.cpuEngine = CPU_ENGINE_EDIT_DISTANCE;
+    else if (sscanf(argv[iArg], "--threads=%u", &daemon.numThreads) == 1)
+      ;
+    else if (strcmp(argv[iArg], "--uncached") == 0)
+      cacheable = 0;
+    else if (sscanf(argv[iArg], "--poll-us=%u", &pollWindowUs) == 1)
+      ;
+    else if (sscanf(argv[iArg], "--timeout-ms=%u", &jobTimeoutMs) == 1)
+      ;
+    else if (strcmp(argv[iArg], "--backend=hw") == 0)
+      emuEngine = CPU_ENGINE_NONE;
+    else if (strcmp(argv[iArg], "--backend=emu") == 0)
+      emuEngine = CPU_ENGINE_SW;
+    else if (strcmp(argv[iArg], "--backend=emu-editdistance") == 0)
+      emuEngine = CPU_ENGINE_EDIT_DISTANCE;
+    else if (strncmp(argv[iArg], "--", 2) == 0) {
+      printf("Unknown option %s\n\n", argv[iArg]);
+      PrintUsage();
+      return -1;
+    }
+    else
+      dbFiles.push_back(argv[iArg]);
+  }
+
+  if (dbFiles.empty()) {
+    PrintUsage();
+    return -1;
+  }
+
+  // Open the device. Unlike seqMatcher, the daemon does not wait for a confirmation that the bitstream is loaded.
+  CSeqMatcherDriver hwDevice(false);
+  CSeqMatcherEmuDriver emuDevice(emuEngine, daemon.numThreads, false);
+  CSeqMatcherDriver & seqMatcher = (emuEngine != CPU_ENGINE_NONE) ? emuDevice : hwDevice;
+  if (daemon.cpuEngine == CPU_ENGINE_NONE) {
+    if (seqMatcher.Open(DRIVER_NAME) != CAccelDriver::OK) {
+      printf("Error opening the device driver %s\n", DRIVER_NAME);
+      return -1;
+    }
+    daemon.device = &seqMatcher;
+    if ((pollWindowUs > 0) && !seqMatcher.SetPollWindow(pollWindowUs))
+      printf("Warning: cannot set the busy-poll window, waiting for the interrupts.\n");
+    seqMatcher.SetJobTimeout(jobTimeoutMs);
+  }
+  else
+    printf("Using the CPU engine, the device is not used.\n");
+
+  bool res = true;
+  for (const char * dbFile : dbFiles)
+    res = res && LoadReferenceDB(daemon, dbFile, cacheable);
+
+  // Buffers of one job
+  daemon.scoresSize = scoresBufferMB << 20;
+  daemon.maxReplyScores = (uint64_t)CLIENT_REPLY_BUFFERS * daemon.scoresSize;
+  for (uint32_t iDB = 0; res && (iDB < daemon.dbs.size()); ++ iDB)
+    if (daemon.dbs[iDB].numEntries > daemon.maxReplyScores) {
+      printf("Error: the replies against DB %u do not fit in the reply budget of a client, increase --scores-buffer\n",
+             iDB);
+      res = false;
+    }
+  if (daemon.device != NULL) {
+    daemon.seqsSpecimen = (uint64_t *)seqMatcher.AllocDMACompatible(QUERY_MAX_SEQS * sizeof(uint64_t), cacheable);
+    daemon.masksSpecimen = (uint32_t *)seqMatcher.AllocDMACompatible(QUERY_MAX_SEQS * sizeof(uint32_t), cacheable);
+    daemon.lengthsSpecimen = (uint8_t *)seqMatcher.AllocDMACompatible(QUERY_MAX_SEQS * sizeof(uint8_t), cacheable);
+    daemon.scores = (int8_t *)seqMatcher.AllocDMACompatible(daemon.scoresSize, cacheable);
+  }
+  else {
+    daemon.seqsSpecimen = (uint64_t *)malloc(QUERY_MAX_SEQS * sizeof(uint64_t));
+    daemon.masksSpecimen = (uint32_t *)malloc(QUERY_MAX_SEQS * sizeof(uint32_t));
+    daemon.lengthsSpecimen = (uint8_t *)malloc(QUERY_MAX_SEQS * sizeof(uint8_t));
+    daemon.scores = (int8_t *)malloc(daemon.scoresSize);
+  }
+  if ( (daemon.seqsSpecimen == NULL) || (daemon.masksSpecimen == NULL) || (daemon.lengthsSpecimen == NULL) ||
+       (daemon.scores == NULL) ) {
+    printf("Error allocating the buffers of the jobs.\n");
+    res = false;
+  }
+
+  // Listen on the socket. Clients do not need to run as root.
+  int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+  unlink(socketPath);
+
+  if ( res && ((listenFd == -1) || (bind(listenFd, (struct sockaddr *)&address, sizeof(address)) != 0) ||
+               (listen(listenFd, 16) != 0)) ) {
+    printf("Error listening on socket [%s]\n", socketPath);
+    res = false;
+  }
+
+  if (res) {
+    chmod(socketPath, 0666);
+    signal(SIGINT, StopHandler);
+    signal(SIGTERM, StopHandler);
+    signal(SIGPIPE, SIG_IGN);
+
+    daemon.coalesceTime = std::chrono::microseconds(coalesceUs);
+    std::thread(AcceptThread, std::ref(daemon), listenFd).detach();
+    printf("Listening on [%s]\n", socketPath);
+
+    // Scheduler: one job at a time, with the oldest pending query and the ones that can share its job
+    std::unique_lock<std::mutex> guard(daemon.lock);
+    while (!stopRequested) {
+      if (daemon.pendingQueries.empty()) {
+        daemon.queryQueued.wait_for(guard, std::chrono::milliseconds(100));
+        continue;
+      }
+
+      daemon.queryQueued.wait_until(guard, daemon.pendingQueries.front()->arrival + daemon.coalesceTime,
+                                    [&]() { return stopRequested || (PendingSeqs(daemon) >= QUERY_MAX_SEQS); });
+
+      std::vector<TQuery *> batch = TakeBatch(daemon);
+      guard.unlock();
+      RunBatch(daemon, batch);
+      guard.lock();
+    }
+
+    printf("Stopping.\n");
+  }
+
+  if (listenFd != -1) {
+    close(listenFd);
+    unlink(socketPath);
+  }
+
+  // Free the buffers. The queries still pending are dropped with the process.
+  if (daemon.device != NULL) {
+    for (TReferenceDB & db : daemon.dbs) {
+      seqMatcher.FreeDMACompatible(db.seqs);
+      seqMatcher.FreeDMACompatible(db.masks);
+      seqMatcher.FreeDMACompatible(db.lengths);
+    }
+    if (daemon.seqsSpecimen != NULL)
+      seqMatcher.FreeDMACompatible(daemon.seqsSpecimen);
+    if (daemon.masksSpecimen != NULL)
+      seqMatcher.FreeDMACompatible(daemon.masksSpecimen);
+    if (daemon.lengthsSpecimen != NULL)
+      seqMatcher.FreeDMACompatible(daemon.lengthsSpecimen);
+    if (daemon.scores != NULL)
+      seqMatcher.FreeDMACompatible(daemon.scores);
+  }
+  else {
+    for (TReferenceDB & db : daemon.dbs) {
+      free(db.seqs);
+      free(db.masks);
+      free(db.lengths);
+    }
+    free(daemon.seqsSpecimen);
+    free(daemon.masksSpecimen);
+    free(daemon.lengthsSpecimen);
+    free(daemon.scores);
+  }
+
+  return res ? 0 : -1;
+}
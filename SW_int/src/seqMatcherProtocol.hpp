@@ -0,0 +1,70 @@
+#ifndef SEQMATCHERPROTOCOL_HPP
+#define SEQMATCHERPROTOCOL_HPP
+
+#include <stdint.h>
+#include <unistd.h>
+
+// Requires <stdint.h>, <unistd.h>
+
+// Binary protocol of seqMatcherDaemon over a Unix stream socket. Both ends run on the same board, so the structures
+// are sent in native byte order.
+//  Request: TQueryRequest, followed by numSeqs packed specimen sequences (uint64_t), numSeqs ambiguity masks
+//           (uint32_t) and numSeqs lengths (uint8_t), in the layout of the accelerator buffers.
+//  Reply:   TQueryReply with the tag of the request, followed (if status is QUERY_OK) by numDBEntries * numSeqs
+//           scores (int8_t), DB entry major, as in the scores files of seqMatcher.
+// A client can send several requests without waiting for the replies. Replies may arrive in a different order, so
+// they are matched to the requests by their tag.
+
+#define QUERY_MAGIC 0x51514D53    // "SMQQ"
+#define DEFAULT_SOCKET_PATH "/tmp/seqMatcher.sock"
+// Sequences of one query: the size of the specimen cache of the accelerator (MAX_CACHED_SPECIMENS)
+#define QUERY_MAX_SEQS 1000
+// The scores of one reply (numDBEntries * numSeqs) are limited by the reply budget of the daemon, a multiple of its
+// scores buffer (seqMatcherDaemon --scores-buffer). Larger queries are rejected with QUERY_TOO_LARGE, with numSeqs
+// set to the largest number of sequences accepted per query against that DB.
+
+typedef enum {QUERY_OK = 0, QUERY_BAD_REQUEST = 1, QUERY_UNKNOWN_DB = 2, QUERY_TOO_LARGE = 3,
+              QUERY_DEVICE_ERROR = 4} TQueryStatus;
+
+struct TQueryRequest {
+  uint32_t magic;
+  uint32_t tag;             // Chosen by the client, returned in the reply
+  uint32_t dbId;            // Index of the DB in the command line of the daemon
+  uint32_t numSeqs;
+  uint32_t ambiguousMode;   // CSeqMatcherDriver::TAmbiguousMode
+};
+
+struct TQueryReply {
+  uint32_t magic;
+  uint32_t tag;
+  uint32_t status;          // TQueryStatus
+  uint32_t numDBEntries;
+  uint32_t numSeqs;
+};
+
+// Blocking transfers of a whole buffer. Return false if the connection is closed or fails.
+inline bool SendAll(int fd, const void * data, uint32_t size)
+{
+  for (const uint8_t * p = (const uint8_t *)data; size > 0; ) {
+    ssize_t sent = write(fd, p, size);
+    if (sent <= 0)
+      return false;
+    p += sent;
+    size -= sent;
+  }
+  return true;
+}
+
+inline bool RecvAll(int fd, void * data, uint32_t size)
+{
+  for (uint8_t * p = (uint8_t *)data; size > 0; ) {
+    ssize_t received = read(fd, p, size);
+    if (received <= 0)
+      return false;
+    p += received;
+    size -= received;
+  }
+  return true;
+}
+
+#endif // SEQMATCHERPROTOCOL_HPP
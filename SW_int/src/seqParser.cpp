@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include "seqParser.hpp"
+#include "packedDB.hpp"
+#include "trace.hpp"
+
+#define MAX_SEQ_LENGTH 32
+
+// Lookup table from characters to the 2-bit codes of the accelerator (A = 0, T = 1, G = 2, C = 3). Ambiguous IUPAC
+// codes are packed as A with their mask bit set, as compressNucleoBase does.
+const uint8_t CODE_AMBIGUOUS = 4;
+const uint8_t CODE_SKIP = 0xFE;      // Line breaks inside FASTA sequences
+const uint8_t CODE_INVALID = 0xFF;
+
+struct TNucleobaseTable {
+  uint8_t code[256];
+
+  TNucleobaseTable() {
+    memset(code, CODE_INVALID, sizeof(code));
+    for (const char * c = "NRYSWKMBDHV"; *c != '\0'; ++ c)
+      SetCode(*c, CODE_AMBIGUOUS);
+    SetCode('A', 0);
+    SetCode('T', 1);
+    SetCode('G', 2);
+    SetCode('C', 3);
+    code[(uint8_t)'\r'] = CODE_SKIP;
+    code[(uint8_t)'\n'] = CODE_SKIP;
+  }
+
+  void SetCode(char c, uint8_t value) {
+    code[(uint8_t)c] = value;
+    code[(uint8_t)(c - 'A' + 'a')] = value;
+  }
+};
+
+static const TNucleobaseTable nucleobaseTable;
+
+// Byte range of the file assigned to a thread. Both ends are at the start of a line.
+struct TParseRange {
+  const char * begin;
+  const char * end;
+  uint32_t numLines;
+  uint32_t numHeaders;     // Lines starting with '>'
+  uint32_t firstRecord;    // Index of the first record that starts in the range
+  uint32_t firstLine;
+  uint32_t invalidRecord;  // First record with an invalid character (0xFFFFFFFF if none)
+  char invalidChar;
+  uint32_t numTruncated;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+static inline const char * NextLine(const char * line, const char * fileEnd)
+{
+  const char * newLine = (const char *)memchr(line, '\n', fileEnd - line);
+  return (newLine != NULL) ? newLine + 1 : fileEnd;
+}
+
+// Packs the sequence text in [begin, end). Returns false on an invalid character.
+static inline bool PackSequence(const char * begin, const char * end, uint64_t & seq, uint32_t & mask,
+    uint8_t & length, bool & truncated, char & invalidChar)
+{
+  seq = 0;
+  mask = 0;
+  length = 0;
+  truncated = false;
+
+  for (const char * c = begin; c < end; ++ c) {
+    uint8_t code = nucleobaseTable.code[(uint8_t)*c];
+
+    if (code == CODE_SKIP)
+      continue;
+    if (code == CODE_INVALID) {
+      invalidChar = *c;
+      return false;
+    }
+    if (length == MAX_SEQ_LENGTH) {
+      truncated = true;
+      continue;
+    }
+
+    seq |= uint64_t(code & 0b11) << (2 * length);
+    mask |= uint32_t(code == CODE_AMBIGUOUS) << length;
+    ++ length;
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// First pass: counts the lines and FASTA headers of the range.
+static void CountRange(TParseRange & range, const char * fileEnd)
+{
+  range.numLines = 0;
+  range.numHeaders = 0;
+
+  for (const char * line = range.begin; line < range.end; line = NextLine(line, fileEnd)) {
+    ++ range.numLines;
+    if (*line == '>')
+      ++ range.numHeaders;
+  }
+}
+
+// Second pass: packs the records that start in the range (the last one can end after it).
+static void ParseRange(TParseRange & range, TSeqFormat format, const char * fileEnd,
+    uint64_t * seqs, uint32_t * masks, uint8_t * lengths, uint32_t maxSeqs)
+{
+  uint32_t iRecord = range.firstRecord;
+  uint32_t iLine = range.firstLine;
+
+  range.invalidRecord = 0xFFFFFFFF;
+  range.numTruncated = 0;
+
+  for (const char * line = range.begin; (line < range.end) && (iRecord < maxSeqs); ++ iLine) {
+    const char * next = NextLine(line, fileEnd);
+    const char * seqBegin = NULL;
+    const char * seqEnd = NULL;
+
+    switch (format) {
+    case SEQ_FORMAT_LINES:
+      seqBegin = line;
+      seqEnd = next;
+      break;
+    case SEQ_FORMAT_FASTA:
+      // The sequence runs until the next header
+      if (*line == '>') {
+        seqBegin = next;
+        for (seqEnd = next; (seqEnd < fileEnd) && (*seqEnd != '>'); seqEnd = NextLine(seqEnd, fileEnd))
+          ;
+      }
+      break;
+    case SEQ_FORMAT_FASTQ:
+      // Header, sequence, '+' and quality lines
+      if (iLine % 4 == 0) {
+        seqBegin = next;
+        seqEnd = NextLine(next, fileEnd);
+      }
+      break;
+    }
+
+    if (seqBegin != NULL) {
+      bool truncated;
+
+      if (!PackSequence(seqBegin, seqEnd, seqs[iRecord], masks[iRecord], lengths[iRecord], truncated,
+                        range.invalidChar)) {
+        range.invalidRecord = iRecord;
+        return;
+      }
+      range.numTruncated += truncated;
+      ++ iRecord;
+    }
+
+    line = next;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint32_t ParseSequenceFile(const char * fileName, uint64_t * seqs, uint32_t * masks, uint8_t * lengths,
+    uint32_t maxSeqs, uint32_t numThreads)
+{
+  TRACE_SCOPE("Parse sequence file");
+  int fd = open(fileName, O_RDONLY);
+  struct stat fileStat;
+
+  if ((fd == -1) || (fstat(fd, &fileStat) != 0)) {
+    printf("Error opening file [%s]\n", fileName);
+    if (fd != -1)
+      close(fd);
+    return 0;
+  }
+
+  if (fileStat.st_size == 0) {
+    close(fd);
+    return 0;
+  }
+
+  const char * data = (const char *)mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("Error mapping file [%s]\n", fileName);
+    return 0;
+  }
+  madvise((void *)data, fileStat.st_size, MADV_SEQUENTIAL);
+
+  const char * fileEnd = data + fileStat.st_size;
+  TSeqFormat format = (data[0] == '>') ? SEQ_FORMAT_FASTA : (data[0] == '@') ? SEQ_FORMAT_FASTQ : SEQ_FORMAT_LINES;
+
+  if (numThreads == 0)
+    numThreads = std::thread::hardware_concurrency();
+  if (numThreads == 0)
+    numThreads = 1;
+
+  // Split the file in ranges of similar size, moved forward to the next line start
+  std::vector<TParseRange> ranges(numThreads);
+  const char * rangeBegin = data;
+
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread) {
+    const char * rangeEnd = (iThread == numThreads - 1) ? fileEnd : data + fileStat.st_size * (iThread + 1) / numThreads;
+
+    if (rangeEnd < rangeBegin)
+      rangeEnd = rangeBegin;
+    if ((rangeEnd > data) && (rangeEnd < fileEnd) && (rangeEnd[-1] != '\n'))
+      rangeEnd = NextLine(rangeEnd, fileEnd);
+
+    ranges[iThread].begin = rangeBegin;
+    ranges[iThread].end = rangeEnd;
+    rangeBegin = rangeEnd;
+  }
+
+  std::vector<std::thread> threads;
+
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread)
+    threads.push_back(std::thread(CountRange, std::ref(ranges[iThread]), fileEnd));
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread)
+    threads[iThread].join();
+
+  // Index of the first record and line of every range
+  uint32_t numLines = 0;
+  uint32_t numHeaders = 0;
+
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread) {
+    ranges[iThread].firstLine = numLines;
+    switch (format) {
+    case SEQ_FORMAT_LINES: ranges[iThread].firstRecord = numLines; break;
+    case SEQ_FORMAT_FASTA: ranges[iThread].firstRecord = numHeaders; break;
+    case SEQ_FORMAT_FASTQ: ranges[iThread].firstRecord = (numLines + 3) / 4; break;
+    }
+    numLines += ranges[iThread].numLines;
+    numHeaders += ranges[iThread].numHeaders;
+  }
+
+  uint32_t numRecords = (format == SEQ_FORMAT_LINES) ? numLines :
+                        (format == SEQ_FORMAT_FASTA) ? numHeaders : (numLines + 3) / 4;
+
+  threads.clear();
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread)
+    threads.push_back(std::thread(ParseRange, std::ref(ranges[iThread]), format, fileEnd, seqs, masks, lengths,
+                                  maxSeqs));
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread)
+    threads[iThread].join();
+
+  munmap((void *)data, fileStat.st_size);
+
+  uint32_t numParsed = (numRecords < maxSeqs) ? numRecords : maxSeqs;
+  uint32_t numTruncated = 0;
+
+  for (uint32_t iThread = 0; iThread < numThreads; ++ iThread) {
+    numTruncated += ranges[iThread].numTruncated;
+
+    // Ranges are in file order, so the first invalid record found is the first one of the file. The sequences
+    // after it are not parsed, so the whole file fails.
+    if (ranges[iThread].invalidRecord < numParsed) {
+      printf("Invalid nucleobase '%c' in sequence %u of [%s]\n", ranges[iThread].invalidChar,
+             ranges[iThread].invalidRecord + 1, fileName);
+      numParsed = 0;
+      break;
+    }
+  }
+
+  if (numTruncated > 0)
+    printf("Warning: %u sequences of [%s] were longer than %u nucleobases and have been truncated\n",
+           numTruncated, fileName, MAX_SEQ_LENGTH);
+
+  return numParsed;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+TSeqFormat DetectSequenceFormat(FILE * input)
+{
+  int first = (fseeko(input, 0, SEEK_SET) == 0) ? fgetc(input) : EOF;
+
+  return (first == '>') ? SEQ_FORMAT_FASTA : (first == '@') ? SEQ_FORMAT_FASTQ : SEQ_FORMAT_LINES;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// The records are packed as ParseRange() does. A FASTA record ends at the next header, which is left for the next
+// call, so offset stays at the start of a record in every format.
+uint32_t ParseSequenceRecords(FILE * input, TSeqFormat format, uint64_t & offset, uint64_t * seqs, uint32_t * masks,
+    uint8_t * lengths, uint32_t maxSeqs, const char * fileName, uint32_t firstSeq, bool & invalid)
+{
+  TRACE_SCOPE("Parse sequence records");
+  char * line = NULL;
+  size_t capacity = 0;
+  ssize_t lineSize;
+  std::string fastaSeq;       // Sequence lines of the current FASTA record
+  bool inFastaRecord = false;
+  uint32_t numSeqs = 0;
+  uint32_t numTruncated = 0;
+  uint32_t iLine = 0;
+
+  invalid = false;
+  if (maxSeqs == 0)
+    return 0;
+  if (fseeko(input, offset, SEEK_SET) != 0) {
+    printf("Error seeking to byte %llu of [%s]\n", (unsigned long long)offset, fileName);
+    invalid = true;
+    return 0;
+  }
+
+  auto pack = [&](const char * begin, const char * end) {
+    bool truncated;
+    char invalidChar;
+
+    if (!PackSequence(begin, end, seqs[numSeqs], masks[numSeqs], lengths[numSeqs], truncated, invalidChar)) {
+      printf("Invalid nucleobase '%c' in sequence %u of [%s]\n", invalidChar, firstSeq + numSeqs + 1, fileName);
+      invalid = true;
+      return;
+    }
+    numTruncated += truncated;
+    ++ numSeqs;
+  };
+
+  while (!invalid && ((lineSize = getline(&line, &capacity, input)) != -1)) {
+    switch (format) {
+    case SEQ_FORMAT_LINES:
+      pack(line, line + lineSize);
+      break;
+    case SEQ_FORMAT_FASTA:
+      if (*line == '>') {
+        if (inFastaRecord)
+          pack(fastaSeq.data(), fastaSeq.data() + fastaSeq.size());
+        inFastaRecord = (numSeqs < maxSeqs);
+        fastaSeq.clear();
+      }
+      else if (inFastaRecord)
+        fastaSeq.append(line, lineSize);
+      break;
+    case SEQ_FORMAT_FASTQ:
+      // Header, sequence, '+' and quality lines
+      if (iLine % 4 == 1)
+        pack(line, line + lineSize);
+      break;
+    }
+
+    // The header of the record after the last one is not consumed
+    if ((format == SEQ_FORMAT_FASTA) && (*line == '>') && !inFastaRecord)
+      break;
+
+    offset += lineSize;
+    ++ iLine;
+
+    if ((numSeqs == maxSeqs) && ((format == SEQ_FORMAT_LINES) || ((format == SEQ_FORMAT_FASTQ) && (iLine % 4 == 0))))
+      break;
+  }
+
+  // The last FASTA record ends at the end of the file
+  if (!invalid && inFastaRecord && (lineSize == -1))
+    pack(fastaSeq.data(), fastaSeq.data() + fastaSeq.size());
+
+  free(line);
+
+  if (numTruncated > 0)
+    printf("Warning: %u sequences of [%s] were longer than %u nucleobases and have been truncated\n",
+           numTruncated, fileName, MAX_SEQ_LENGTH);
+
+  return numSeqs;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint32_t CountLines(const char * fileName)
+{
+  FILE * input = fopen(fileName, "rb");
+  char buffer[1 << 16];
+  uint32_t numLines = 1;
+  size_t size;
+
+  if (input == NULL)
+    return 0;
+  while ((size = fread(buffer, 1, sizeof(buffer), input)) > 0)
+    for (const char * p = buffer; (p = (const char *)memchr(p, '\n', buffer + size - p)) != NULL; ++ p)
+      ++ numLines;
+  fclose(input);
+
+  return numLines;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+uint32_t LoadSequenceFile(const char * fileName, uint64_t * &seqs, uint32_t * &masks, uint8_t * &lengths,
+    uint32_t numThreads)
+{
+  TPackedDBHeader header;
+  bool packed = ReadPackedDBHeader(fileName, header);
+  uint32_t maxSeqs = packed ? header.numSeqs : CountLines(fileName);
+  uint32_t numSeqs = 0;
+
+  seqs = (uint64_t *)malloc(maxSeqs * sizeof(uint64_t));
+  masks = (uint32_t *)malloc(maxSeqs * sizeof(uint32_t));
+  lengths = (uint8_t *)malloc(maxSeqs * sizeof(uint8_t));
+
+  if ((maxSeqs == 0) || (seqs == NULL) || (masks == NULL) || (lengths == NULL))
+    printf("Error reading file [%s]\n", fileName);
+  else
+    numSeqs = packed ? LoadPackedDB(fileName, seqs, masks, lengths, maxSeqs) :
+                       ParseSequenceFile(fileName, seqs, masks, lengths, maxSeqs, numThreads);
+
+  if (numSeqs == 0) {
+    free(seqs);
+    free(masks);
+    free(lengths);
+    seqs = NULL;
+    masks = NULL;
+    lengths = NULL;
+  }
+
+  return numSeqs;
+}
@@ -0,0 +1,37 @@
+#ifndef SEQPARSER_HPP
+#define SEQPARSER_HPP
+
+// Requires <stdio.h>, <stdint.h>
+
+// Parser of nucleobase sequence files into the packed arrays used by the accelerator (2-bit nucleobases in an
+// uint64_t, ambiguity masks and lengths). The file is memory-mapped, split at line boundaries among threads and
+// packed through a 256-entry lookup table. The format is detected from the first character of the file:
+// one sequence per line, FASTA ('>', sequences can span several lines) or FASTQ ('@', 4 lines per record).
+
+typedef enum {SEQ_FORMAT_LINES = 0, SEQ_FORMAT_FASTA = 1, SEQ_FORMAT_FASTQ = 2} TSeqFormat;
+
+// Parses up to maxSeqs sequences. Sequences longer than 32 nucleobases are truncated (with a warning). Returns the
+// number of sequences parsed, or 0 on error: a sequence with an invalid character fails the whole file (with an
+// error message). numThreads == 0 uses all the cores.
+uint32_t ParseSequenceFile(const char * fileName, uint64_t * seqs, uint32_t * masks, uint8_t * lengths,
+    uint32_t maxSeqs, uint32_t numThreads = 0);
+
+// Format of an open text sequence file, from its first character.
+TSeqFormat DetectSequenceFormat(FILE * input);
+
+// Parses up to maxSeqs records of an open text sequence file of the given format, from the record that starts at byte
+// offset, for files streamed in chunks: offset is moved to the start of the first record not parsed. Single-threaded.
+// Returns the number of sequences parsed. It stops at a sequence with an invalid character and sets invalid (with an
+// error message numbering the sequence from firstSeq), so that a parse error is not mistaken for the end of the file.
+uint32_t ParseSequenceRecords(FILE * input, TSeqFormat format, uint64_t & offset, uint64_t * seqs, uint32_t * masks,
+    uint8_t * lengths, uint32_t maxSeqs, const char * fileName, uint32_t firstSeq, bool & invalid);
+
+// Upper bound of the number of sequences of a file, to size the buffers: its number of lines. 0 if it cannot be read.
+uint32_t CountLines(const char * fileName);
+
+// Loads a whole nucleobase file, as text (any of the formats above) or packed DB (see packedDB.hpp), into arrays
+// allocated with malloc. Returns the number of sequences (0 on error, with the arrays set to NULL).
+uint32_t LoadSequenceFile(const char * fileName, uint64_t * &seqs, uint32_t * &masks, uint8_t * &lengths,
+    uint32_t numThreads = 0);
+
+#endif // SEQPARSER_HPP
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "trace.hpp"
+
+struct TTraceEvent {
+  const char * name;
+  uint32_t thread;
+  uint64_t start;       // ns since TraceEnable()
+  uint64_t duration;    // ns
+};
+
+static bool traceEnabled = false;
+static uint64_t traceOrigin = 0;
+static std::mutex traceLock;
+static std::vector<TTraceEvent> traceEvents;
+static std::atomic<uint32_t> nextThreadId(1);
+
+static inline uint64_t TraceNow()
+{
+  struct timespec time;
+
+  clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+  return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+// Small, stable number of the calling thread, in order of first use (the thread that enables the trace is 1)
+static uint32_t TraceThreadId()
+{
+  static thread_local uint32_t threadId = 0;
+
+  if (threadId == 0)
+    threadId = nextThreadId ++;
+  return threadId;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////// CTraceScope /////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+CTraceScope::CTraceScope(const char * Name)
+  : name(Name), start(traceEnabled ? TraceNow() : 0)
+{
+}
+
+
+CTraceScope::~CTraceScope()
+{
+  if (start == 0)
+    return;
+
+  uint64_t end = TraceNow();
+  TTraceEvent event = {name, TraceThreadId(), start - traceOrigin, end - start};
+
+  std::lock_guard<std::mutex> guard(traceLock);
+  traceEvents.push_back(event);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+void TraceEnable()
+{
+  TraceThreadId();
+  traceOrigin = TraceNow();
+  traceEnabled = true;
+}
+
+bool TraceEnabled()
+{
+  return traceEnabled;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+void TracePrintSummary()
+{
+  struct TPhase {
+    const char * name;
+    uint32_t count;
+    uint64_t first, total, max;
+  };
+  std::vector<TPhase> phases;
+  uint64_t elapsed = TraceNow() - traceOrigin;
+
+  if (!traceEnabled)
+    return;
+
+  // Phases in order of their first start (the events are recorded when they end)
+  {
+    std::lock_guard<std::mutex> guard(traceLock);
+    for (const TTraceEvent & event : traceEvents) {
+      size_t iPhase = 0;
+      while ((iPhase < phases.size()) && (strcmp(phases[iPhase].name, event.name) != 0))
+        ++ iPhase;
+      if (iPhase == phases.size())
+        phases.push_back({event.name, 0, event.start, 0, 0});
+
+      ++ phases[iPhase].count;
+      if (event.start < phases[iPhase].first)
+        phases[iPhase].first = event.start;
+      phases[iPhase].total += event.duration;
+      if (event.duration > phases[iPhase].max)
+        phases[iPhase].max = event.duration;
+    }
+  }
+  std::sort(phases.begin(), phases.end(), [](const TPhase & a, const TPhase & b) { return a.first < b.first; });
+
+  printf("\n%-28s %8s %12s %12s %12s %7s\n", "Phase", "Count", "Total (ms)", "Mean (ms)", "Max (ms)", "%");
+  for (const TPhase & phase : phases)
+    printf("%-28s %8u %12.3lf %12.3lf %12.3lf %6.1lf%%\n", phase.name, phase.count, phase.total/1e6,
+           phase.total/1e6/phase.count, phase.max/1e6, 100.0 * phase.total / elapsed);
+  printf("%-28s %8s %12.3lf\n\n", "Elapsed since start", "", elapsed/1e6);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////
+bool TraceWriteChrome(const char * fileName)
+{
+  FILE * output = fopen(fileName, "w");
+
+  if (output == NULL) {
+    printf("Error opening file [%s]\n", fileName);
+    return false;
+  }
+
+  fprintf(output, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  fprintf(output, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"main\"}}");
+  {
+    std::lock_guard<std::mutex> guard(traceLock);
+    for (const TTraceEvent & event : traceEvents)
+      fprintf(output, ",\n{\"name\": \"%s\", \"cat\": \"seqMatcher\", \"ph\": \"X\", \"ts\": %.3lf, \"dur\": %.3lf, "
+              "\"pid\": 1, \"tid\": %u}", event.name, event.start/1e3, event.duration/1e3, event.thread);
+  }
+  fprintf(output, "\n]}\n");
+
+  bool ok = !ferror(output);
+  ok = (fclose(output) == 0) && ok;
+  if (!ok)
+    printf("Error writing [%s]\n", fileName);
+  return ok;
+}
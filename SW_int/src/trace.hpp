@@ -0,0 +1,40 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <stdint.h>
+
+// Requires <stdint.h>
+
+// Scoped timing of the phases of the host program (device setup, parsing, job submission, waiting for the
+// accelerator, dumping the scores...). TRACE_SCOPE("name") records the time from its declaration to the end of the
+// enclosing block, with the thread that ran it. Recording is off until TraceEnable() is called, and then costs two
+// clock reads and one locked append per scope, so the scopes can stay in the code. The events are reported as a
+// table with the total time of every phase, and as a Chrome trace-event file (chrome://tracing, Perfetto).
+
+class CTraceScope {
+  protected:
+    const char * name;
+    uint64_t start;
+
+  public:
+    // name must be a string literal (it is kept until the trace is written)
+    CTraceScope(const char * Name);
+    ~CTraceScope();
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) CTraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+// Starts recording. The timestamps of the trace are relative to this call.
+void TraceEnable();
+bool TraceEnabled();
+
+// Prints, for every phase, the number of scopes, their total, mean and maximum time and the percentage of the time
+// since TraceEnable(). Nested phases are included in their parents, so the percentages add up to more than 100.
+void TracePrintSummary();
+
+// Writes the events as complete ("X") events of the Chrome trace-event format. Returns false on error.
+bool TraceWriteChrome(const char * fileName);
+
+#endif // TRACE_HPP
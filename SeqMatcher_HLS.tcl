@@ -1,8 +1,13 @@
 open_project SeqMatcher_HW_HLS
 set_top SeqMatcher_HW
+# Compile-time variants of the kernel are selected through the HLS_CFLAGS environment variable
+set hls_cflags ""
+if { [info exists ::env(HLS_CFLAGS)] } {
+  set hls_cflags $::env(HLS_CFLAGS)
+}
 add_files HLS/seqMatcher.h
-add_files HLS/seqMatcher.cpp
-add_files -tb HLS/testbench.cpp
+add_files HLS/seqMatcher.cpp -cflags $hls_cflags
+add_files -tb HLS/testbench.cpp -cflags $hls_cflags
 open_solution "solution1" -flow_target vivado
 set_part {xc7z020clg400-1}
 create_clock -period 10 -name default
@@ -1,4 +1,4 @@
 source "SeqMatcher_HLS.tcl"
-add_files -tb HLS/testbench.cpp
+add_files -tb HLS/testbench.cpp -cflags $hls_cflags
 csim_design -O
 quit